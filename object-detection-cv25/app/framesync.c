@@ -0,0 +1,215 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "framesync.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+
+#include "vdo-frame.h"
+
+/**
+ * @brief Give back the oldest frames of a history.
+ *
+ * @param history History to remove the frames from.
+ * @param numFrames Number of frames to give back.
+ */
+static void dropOldestFrames(FrameHistory_t* history, unsigned int numFrames) {
+    for (unsigned int i = 0; i < numFrames; i++) {
+        returnFrame(history->provider, history->frames[i]);
+    }
+    history->numFrames -= numFrames;
+    memmove(history->frames, history->frames + numFrames, history->numFrames * sizeof(VdoBuffer*));
+    memmove(history->timestamps,
+            history->timestamps + numFrames,
+            history->numFrames * sizeof(uint64_t));
+}
+
+/**
+ * @brief Take one frame out of a history and give back all frames older than it.
+ *
+ * @param history History to take the frame from.
+ * @param index Index of the frame in the history.
+ * @return The frame.
+ */
+static VdoBuffer* takeFrame(FrameHistory_t* history, unsigned int index) {
+    VdoBuffer* frame = history->frames[index];
+    for (unsigned int i = 0; i < index; i++) {
+        returnFrame(history->provider, history->frames[i]);
+    }
+    history->numFrames -= index + 1;
+    memmove(history->frames, history->frames + index + 1, history->numFrames * sizeof(VdoBuffer*));
+    memmove(history->timestamps,
+            history->timestamps + index + 1,
+            history->numFrames * sizeof(uint64_t));
+    return frame;
+}
+
+/**
+ * @brief Fetch new frames of a stream into its history.
+ *
+ * When the history is full the oldest frames are given back.
+ *
+ * @param sync FrameSync owning the history.
+ * @param history History to fill.
+ * @param block Wait for at least one new frame.
+ * @return Number of fetched frames. 0 when blocking means the provider is stopped.
+ */
+static unsigned int fetchFrames(FrameSync_t* sync, FrameHistory_t* history, bool block) {
+    VdoBuffer* frames[FRAME_SYNC_MAX_HISTORY];
+    unsigned int numFrames = block ? getFramesBlocking(history->provider, frames, sync->historySize)
+                                   : getFrames(history->provider, frames, sync->historySize);
+    if (numFrames == 0) {
+        return 0;
+    }
+
+    if (history->numFrames + numFrames > sync->historySize) {
+        unsigned int numDropped = history->numFrames + numFrames - sync->historySize;
+        if (history == &sync->primary) {
+            sync->numUnmatched += numDropped;
+        }
+        dropOldestFrames(history, numDropped);
+    }
+
+    for (unsigned int i = 0; i < numFrames; i++) {
+        VdoFrame* frame                         = vdo_buffer_get_frame(frames[i]);
+        history->frames[history->numFrames]     = frames[i];
+        history->timestamps[history->numFrames] = vdo_frame_get_timestamp(frame);
+        history->numFrames++;
+    }
+    return numFrames;
+}
+
+/**
+ * @brief Find the newest primary frame that has a secondary frame within the tolerance.
+ *
+ * @param sync FrameSync with the histories to search.
+ * @param primaryIndex Set to the index of the primary frame.
+ * @param secondaryIndex Set to the index of the closest secondary frame.
+ * @return False if no pair was found, otherwise true.
+ */
+static bool findPair(const FrameSync_t* sync,
+                     unsigned int* primaryIndex,
+                     unsigned int* secondaryIndex) {
+    for (unsigned int i = sync->primary.numFrames; i-- > 0;) {
+        uint64_t timestamp  = sync->primary.timestamps[i];
+        uint64_t bestDiff   = UINT64_MAX;
+        unsigned int bestIx = 0;
+        for (unsigned int j = 0; j < sync->secondary.numFrames; j++) {
+            uint64_t other = sync->secondary.timestamps[j];
+            uint64_t diff  = other > timestamp ? other - timestamp : timestamp - other;
+            if (diff < bestDiff) {
+                bestDiff = diff;
+                bestIx   = j;
+            }
+        }
+        if (bestDiff <= sync->toleranceUs) {
+            *primaryIndex   = i;
+            *secondaryIndex = bestIx;
+            return true;
+        }
+    }
+    return false;
+}
+
+FrameSync_t* createFrameSync(ImgProvider_t* primary,
+                             ImgProvider_t* secondary,
+                             unsigned int historySize,
+                             uint64_t toleranceUs) {
+    if (historySize < 1 || historySize > FRAME_SYNC_MAX_HISTORY) {
+        syslog(LOG_ERR,
+               "%s: History size must be between 1 and %d",
+               __func__,
+               FRAME_SYNC_MAX_HISTORY);
+        return NULL;
+    }
+
+    FrameSync_t* sync = calloc(1, sizeof(FrameSync_t));
+    if (!sync) {
+        syslog(LOG_ERR, "%s: Unable to allocate FrameSync: %s", __func__, strerror(errno));
+        return NULL;
+    }
+    sync->primary.provider   = primary;
+    sync->secondary.provider = secondary;
+    sync->historySize        = historySize;
+    sync->toleranceUs        = toleranceUs;
+
+    return sync;
+}
+
+void destroyFrameSync(FrameSync_t* sync) {
+    if (!sync) {
+        return;
+    }
+    syslog(LOG_INFO,
+           "%s: Paired %lu frames, %lu frames had no match",
+           __func__,
+           sync->numPairs,
+           sync->numUnmatched);
+
+    dropOldestFrames(&sync->primary, sync->primary.numFrames);
+    dropOldestFrames(&sync->secondary, sync->secondary.numFrames);
+    free(sync);
+}
+
+bool getSyncedFrames(FrameSync_t* sync, VdoBuffer** primaryFrame, VdoBuffer** secondaryFrame) {
+    if (fetchFrames(sync, &sync->primary, true) == 0) {
+        return false;
+    }
+    fetchFrames(sync, &sync->secondary, false);
+
+    unsigned int primaryIndex;
+    unsigned int secondaryIndex;
+    for (unsigned int numWaits = 0; !findPair(sync, &primaryIndex, &secondaryIndex); numWaits++) {
+        unsigned int newest = sync->primary.numFrames - 1;
+        if (numWaits == sync->historySize) {
+            syslog(LOG_WARNING, "%s: No secondary frame within tolerance", __func__);
+            // The older frames are dropped and the newest is returned without a match
+            sync->numUnmatched += newest + 1;
+            *primaryFrame   = takeFrame(&sync->primary, newest);
+            *secondaryFrame = NULL;
+            return true;
+        }
+
+        // If the secondary stream lags behind, the matching frame has not been delivered yet.
+        // Otherwise it is ahead and we wait for the next primary frame instead.
+        FrameHistory_t* history = &sync->primary;
+        if (sync->secondary.numFrames == 0 ||
+            sync->secondary.timestamps[sync->secondary.numFrames - 1] + sync->toleranceUs <
+                sync->primary.timestamps[newest]) {
+            history = &sync->secondary;
+        }
+        if (fetchFrames(sync, history, true) == 0) {
+            return false;
+        }
+    }
+
+    // Frames older than the pair can never be paired later
+    sync->numUnmatched += primaryIndex;
+    sync->numPairs++;
+    *primaryFrame   = takeFrame(&sync->primary, primaryIndex);
+    *secondaryFrame = takeFrame(&sync->secondary, secondaryIndex);
+    return true;
+}
+
+void returnSyncedFrames(FrameSync_t* sync, VdoBuffer* primaryFrame, VdoBuffer* secondaryFrame) {
+    returnFrame(sync->primary.provider, primaryFrame);
+    if (secondaryFrame) {
+        returnFrame(sync->secondary.provider, secondaryFrame);
+    }
+}
@@ -0,0 +1,107 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This header file handles pairing of frames from two streams by timestamp.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "imgprovider.h"
+
+/// Largest number of frames kept per stream while looking for a pair
+#define FRAME_SYNC_MAX_HISTORY (4)
+
+/**
+ * @brief Frames of one stream that have not been paired yet, oldest first.
+ */
+typedef struct FrameHistory {
+    ImgProvider_t* provider;
+    VdoBuffer* frames[FRAME_SYNC_MAX_HISTORY];
+    /// VDO timestamps of the frames in microseconds.
+    uint64_t timestamps[FRAME_SYNC_MAX_HISTORY];
+    unsigned int numFrames;
+} FrameHistory_t;
+
+/**
+ * @brief Pairs the frames of a primary and a secondary stream by timestamp.
+ *
+ * Each stream keeps a small history of fetched frames. A pair is the newest
+ * primary frame that has a secondary frame within the tolerance, together with
+ * the closest such secondary frame. Frames older than a returned pair are
+ * given back to their ImgProvider, newer frames are kept for the next pair.
+ */
+typedef struct FrameSync {
+    FrameHistory_t primary;
+    FrameHistory_t secondary;
+    unsigned int historySize;
+    uint64_t toleranceUs;
+
+    /// Number of returned pairs.
+    unsigned long numPairs;
+    /// Number of primary frames given back without a secondary frame.
+    unsigned long numUnmatched;
+} FrameSync_t;
+
+/**
+ * @brief Create a FrameSync on top of two started ImgProviders.
+ *
+ * The frames of both providers must only be fetched through the FrameSync.
+ *
+ * @param primary ImgProvider whose frames drive the pairing, normally the one inferred on.
+ * @param secondary ImgProvider whose frames are matched to the primary frames.
+ * @param historySize Number of frames kept per stream, at most FRAME_SYNC_MAX_HISTORY.
+ * @param toleranceUs Largest timestamp difference of a pair in microseconds.
+ * @return Pointer to new FrameSync, or NULL if failed.
+ */
+FrameSync_t* createFrameSync(ImgProvider_t* primary,
+                             ImgProvider_t* secondary,
+                             unsigned int historySize,
+                             uint64_t toleranceUs);
+
+/**
+ * @brief Give back all frames in the histories and free the FrameSync.
+ *
+ * @param sync Pointer to FrameSync to be destroyed.
+ */
+void destroyFrameSync(FrameSync_t* sync);
+
+/**
+ * @brief Get a pair of frames whose timestamps are within the tolerance.
+ *
+ * Blocks until there is a new primary frame. If the secondary stream lags
+ * behind, this also waits for the secondary frame that matches. When no match
+ * is found within historySize waits, the newest primary frame is returned with
+ * secondaryFrame set to NULL.
+ *
+ * @param sync FrameSync from createFrameSync.
+ * @param primaryFrame Set to the primary frame.
+ * @param secondaryFrame Set to the matching secondary frame, or NULL.
+ * @return False if any errors occur or the providers are stopped, otherwise true.
+ */
+bool getSyncedFrames(FrameSync_t* sync, VdoBuffer** primaryFrame, VdoBuffer** secondaryFrame);
+
+/**
+ * @brief Give back a pair from getSyncedFrames to the ImgProviders.
+ *
+ * @param sync FrameSync the frames were fetched from.
+ * @param primaryFrame Primary frame.
+ * @param secondaryFrame Secondary frame, may be NULL.
+ */
+void returnSyncedFrames(FrameSync_t* sync, VdoBuffer* primaryFrame, VdoBuffer* secondaryFrame);
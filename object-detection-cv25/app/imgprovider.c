@@ -23,13 +23,19 @@
 #include <assert.h>
 #include <errno.h>
 #include <gmodule.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
 #include <syslog.h>
+#include <unistd.h>
 
 #include "vdo-map.h"
 #include <vdo-channel.h>
 
 #define VDO_CHANNEL (1)
 
+_Static_assert((FRAME_RING_SIZE & (FRAME_RING_SIZE - 1)) == 0,
+               "FRAME_RING_SIZE must be a power of two");
+
 /**
  * brief Set up a stream through VDO.
  *
@@ -61,31 +67,49 @@ static bool allocateVdoBuffers(ImgProvider_t* provider, VdoStream* vdoStream);
  */
 static void releaseVdoBuffers(ImgProvider_t* provider);
 
+/**
+ * brief Add a frame at the tail of a ring.
+ *
+ * Must only be called by the thread owning the tail, and only when the ring
+ * has room for the frame.
+ *
+ * param ring Ring to add the frame to.
+ * param buffer Frame to add.
+ */
+static void pushFrame(FrameRing_t* ring, VdoBuffer* buffer);
+
+/**
+ * brief Remove the frame at the head of a ring.
+ *
+ * param ring Ring to remove the frame from.
+ * param maxFrames Only remove a frame if the ring holds more than this many.
+ * return The removed frame, or NULL if the ring held too few frames.
+ */
+static VdoBuffer* popOldestFrame(FrameRing_t* ring, unsigned int maxFrames);
+
 /**
  * brief Starting point function for the thread fetching frames.
  *
  * Responsible for fetching buffers/frames from VDO and re-enqueue buffers back
  * to VDO when they are not needed by the application. The ImgProvider always
  * keeps one or several of the most recent frames available in the application.
- * There are two queues involved: deliveredFrames and processedFrames.
+ * There are two lock-free rings involved: deliveredFrames and processedFrames.
  * - deliveredFrames are frames delivered from VDO and
- *   not processed by the client.
- * - processedFrames are frames that the client has consumed and handed
- *   back to the ImgProvider.
+ *   not fetched by the client. Only this thread adds frames to it.
+ * - processedFrames are frames that the client has consumed, or skipped, and
+ *   handed back to the ImgProvider. Only the client adds frames to it.
  * The thread works roughly like this:
  * 1. The thread blocks on vdo_stream_get_buffer() until VDO deliver a new
- * frame.
- * 2. The fresh frame is put at the end of the deliveredFrame queue. If the
- *    client want to fetch a frame the item at the end of deliveredFrame
- *    list is returned.
- * 3. If there are any frames in the processedFrames list one of these are
- *    enqueued back to VDO to keep the flow of buffers.
- * 4. If the processedFrames list is empty we instead check if there are
- *    frames available in the deliveredFrames list. We want to make sure
- *    there is at least numAppFrames buffers available to the client to
- *    fetch. If there are more than numAppFrames in deliveredFrames we
- *    pick the first buffer (oldest) in the list and enqueue it to VDO.
-
+ *    frame.
+ * 2. The fresh frame is put at the tail of the deliveredFrames ring. If the
+ *    client is waiting for a frame it is woken up through frameEventFd.
+ * 3. All frames in the processedFrames ring are enqueued back to VDO to keep
+ *    the flow of buffers.
+ * 4. We want to make sure there is at most numAppFrames buffers available to
+ *    the client to fetch. If there are more than numAppFrames in
+ *    deliveredFrames we take the oldest one and enqueue it to VDO.
+ * No locks are taken, so the thread never waits for the client.
+ *
  * param data Pointer to ImgProvider owning thread.
  * return Pointer to unused return data.
  */
@@ -93,42 +117,26 @@ static void* threadEntry(void* data);
 
 ImgProvider_t*
 createImgProvider(unsigned int w, unsigned int h, unsigned int numFrames, VdoFormat format) {
-    bool mtxInitialized  = false;
-    bool condInitialized = false;
-
     ImgProvider_t* provider = calloc(1, sizeof(ImgProvider_t));
     if (!provider) {
         syslog(LOG_ERR, "%s: Unable to allocate ImgProvider: %s", __func__, strerror(errno));
         goto errorExit;
     }
+    provider->frameEventFd = -1;
 
-    provider->vdoFormat    = format;
-    provider->numAppFrames = numFrames;
-
-    if (pthread_mutex_init(&provider->frameMutex, NULL)) {
-        syslog(LOG_ERR, "%s: Unable to initialize mutex: %s", __func__, strerror(errno));
-        goto errorExit;
-    }
-    mtxInitialized = true;
-
-    if (pthread_cond_init(&provider->frameDeliverCond, NULL)) {
+    if (numFrames < 1 || numFrames >= FRAME_RING_SIZE) {
         syslog(LOG_ERR,
-               "%s: Unable to initialize condition variable: %s",
+               "%s: Number of frames must be between 1 and %d",
                __func__,
-               strerror(errno));
-        goto errorExit;
-    }
-    condInitialized = true;
-
-    provider->deliveredFrames = g_queue_new();
-    if (!provider->deliveredFrames) {
-        syslog(LOG_ERR, "%s: Unable to create deliveredFrames queue!", __func__);
+               FRAME_RING_SIZE - 1);
         goto errorExit;
     }
+    provider->vdoFormat    = format;
+    provider->numAppFrames = numFrames;
 
-    provider->processedFrames = g_queue_new();
-    if (!provider->processedFrames) {
-        syslog(LOG_ERR, "%s: Unable to create processedFrames queue!", __func__);
+    provider->frameEventFd = eventfd(0, EFD_CLOEXEC);
+    if (provider->frameEventFd < 0) {
+        syslog(LOG_ERR, "%s: Unable to create eventfd: %s", __func__, strerror(errno));
         goto errorExit;
     }
 
@@ -140,17 +148,8 @@ createImgProvider(unsigned int w, unsigned int h, unsigned int numFrames, VdoFor
     return provider;
 
 errorExit:
-    if (mtxInitialized) {
-        pthread_mutex_destroy(&provider->frameMutex);
-    }
-    if (condInitialized) {
-        pthread_cond_destroy(&provider->frameDeliverCond);
-    }
-    if (provider->deliveredFrames) {
-        g_queue_free(provider->deliveredFrames);
-    }
-    if (provider->processedFrames) {
-        g_queue_free(provider->processedFrames);
+    if (provider && provider->frameEventFd >= 0) {
+        close(provider->frameEventFd);
     }
 
     free(provider);
@@ -164,13 +163,11 @@ void destroyImgProvider(ImgProvider_t* provider) {
         return;
     }
 
-    releaseVdoBuffers(provider);
+    syslog(LOG_INFO, "%s: Dropped %lu frames", __func__, atomic_load(&provider->droppedFrames));
 
-    pthread_mutex_destroy(&provider->frameMutex);
-    pthread_cond_destroy(&provider->frameDeliverCond);
+    releaseVdoBuffers(provider);
 
-    g_queue_free(provider->deliveredFrames);
-    g_queue_free(provider->processedFrames);
+    close(provider->frameEventFd);
 
     free(provider);
 }
@@ -376,31 +373,135 @@ static void releaseVdoBuffers(ImgProvider_t* provider) {
     }
 }
 
-VdoBuffer* getLastFrameBlocking(ImgProvider_t* provider) {
-    VdoBuffer* returnBuf = NULL;
-    pthread_mutex_lock(&provider->frameMutex);
+static void pushFrame(FrameRing_t* ring, VdoBuffer* buffer) {
+    unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    assert(tail - atomic_load(&ring->head) < FRAME_RING_SIZE);
 
-    while (g_queue_get_length(provider->deliveredFrames) < 1) {
-        if (pthread_cond_wait(&provider->frameDeliverCond, &provider->frameMutex)) {
-            syslog(LOG_ERR, "%s: Failed to wait on condition: %s", __func__, strerror(errno));
-            goto errorExit;
+    atomic_store_explicit(&ring->slots[tail % FRAME_RING_SIZE], buffer, memory_order_relaxed);
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+static VdoBuffer* popOldestFrame(FrameRing_t* ring, unsigned int maxFrames) {
+    unsigned int head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    for (;;) {
+        unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        if (tail - head <= maxFrames) {
+            return NULL;
+        }
+        VdoBuffer* buffer =
+            atomic_load_explicit(&ring->slots[head % FRAME_RING_SIZE], memory_order_relaxed);
+        // The other side may have taken the frame meanwhile, then head is reloaded and we retry
+        if (atomic_compare_exchange_weak_explicit(&ring->head,
+                                                  &head,
+                                                  head + 1,
+                                                  memory_order_acq_rel,
+                                                  memory_order_acquire)) {
+            return buffer;
+        }
+    }
+}
+
+unsigned int getFrames(ImgProvider_t* provider, VdoBuffer** frames, unsigned int maxFrames) {
+    FrameRing_t* ring = &provider->deliveredFrames;
+    VdoBuffer* taken[FRAME_RING_SIZE];
+    unsigned int numFrames = 0;
+
+    unsigned int head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    do {
+        unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        numFrames         = tail - head;
+        for (unsigned int i = 0; i < numFrames; i++) {
+            taken[i] = atomic_load_explicit(&ring->slots[(head + i) % FRAME_RING_SIZE],
+                                            memory_order_relaxed);
         }
+        // Take all frames at once. If the fetcher thread dropped the oldest one meanwhile,
+        // head is reloaded and we try again.
+    } while (numFrames > 0 && !atomic_compare_exchange_weak_explicit(&ring->head,
+                                                                      &head,
+                                                                      head + numFrames,
+                                                                      memory_order_acq_rel,
+                                                                      memory_order_acquire));
+
+    // Keep the newest maxFrames frames and hand back the older ones
+    unsigned int numSkipped = numFrames > maxFrames ? numFrames - maxFrames : 0;
+    for (unsigned int i = 0; i < numSkipped; i++) {
+        pushFrame(&provider->processedFrames, taken[i]);
     }
+    atomic_fetch_add_explicit(&provider->droppedFrames, numSkipped, memory_order_relaxed);
 
-    returnBuf = g_queue_pop_tail(provider->deliveredFrames);
+    for (unsigned int i = numSkipped; i < numFrames; i++) {
+        frames[i - numSkipped] = taken[i];
+    }
 
-errorExit:
-    pthread_mutex_unlock(&provider->frameMutex);
+    return numFrames - numSkipped;
+}
+
+unsigned int
+getFramesBlocking(ImgProvider_t* provider, VdoBuffer** frames, unsigned int maxFrames) {
+    unsigned int numFrames = getFrames(provider, frames, maxFrames);
+
+    while (numFrames == 0 && !provider->shutDown) {
+        // Announce that we wait before checking a last time, so that the fetcher thread either
+        // sees the flag or delivers a frame we find here.
+        atomic_store(&provider->clientWaiting, true);
+        numFrames = getFrames(provider, frames, maxFrames);
+        if (numFrames > 0 || provider->shutDown) {
+            atomic_store(&provider->clientWaiting, false);
+            break;
+        }
+
+        uint64_t numEvents;
+        if (read(provider->frameEventFd, &numEvents, sizeof(numEvents)) < 0 && errno != EINTR) {
+            syslog(LOG_ERR, "%s: Failed to wait for frame: %s", __func__, strerror(errno));
+            atomic_store(&provider->clientWaiting, false);
+            break;
+        }
+        atomic_store(&provider->clientWaiting, false);
+        numFrames = getFrames(provider, frames, maxFrames);
+    }
+
+    return numFrames;
+}
+
+VdoBuffer* getLastFrameBlocking(ImgProvider_t* provider) {
+    VdoBuffer* returnBuf = NULL;
+    getFramesBlocking(provider, &returnBuf, 1);
 
     return returnBuf;
 }
 
 void returnFrame(ImgProvider_t* provider, VdoBuffer* buffer) {
-    pthread_mutex_lock(&provider->frameMutex);
+    pushFrame(&provider->processedFrames, buffer);
+}
 
-    g_queue_push_tail(provider->processedFrames, buffer);
+/**
+ * brief Wake up the client if it is blocked in getLastFrameBlocking().
+ *
+ * param provider Pointer to an ImgProvider fetching frames.
+ */
+static void wakeClient(ImgProvider_t* provider) {
+    uint64_t event = 1;
+    if (write(provider->frameEventFd, &event, sizeof(event)) < 0) {
+        syslog(LOG_WARNING, "%s: Failed to signal frame: %s", __func__, strerror(errno));
+    }
+}
 
-    pthread_mutex_unlock(&provider->frameMutex);
+/**
+ * brief Enqueue a buffer back to VDO.
+ *
+ * param provider Pointer to an ImgProvider fetching frames.
+ * param buffer Buffer to enqueue.
+ */
+static void enqueueFrame(ImgProvider_t* provider, VdoBuffer* buffer) {
+    GError* error = NULL;
+    if (!vdo_stream_buffer_enqueue(provider->vdoStream, buffer, &error)) {
+        // Fail but we continue anyway hoping for the best.
+        syslog(LOG_WARNING,
+               "%s: Failed enqueueing buffer to vdo: %s",
+               __func__,
+               (error != NULL) ? error->message : "N/A");
+        g_clear_error(&error);
+    }
 }
 
 static void* threadEntry(void* data) {
@@ -420,38 +521,27 @@ static void* threadEntry(void* data) {
             g_clear_error(&error);
             continue;
         }
-        pthread_mutex_lock(&provider->frameMutex);
-
-        g_queue_push_tail(provider->deliveredFrames, newBuffer);
-
-        VdoBuffer* oldBuffer = NULL;
-
-        // First check if there are any frames returned from app
-        // processing
-        if (g_queue_get_length(provider->processedFrames) > 0) {
-            oldBuffer = g_queue_pop_head(provider->processedFrames);
-        } else {
-            // Client specifies the number-of-recent-frames it needs to collect
-            // in one chunk (numAppFrames). Thus only enqueue buffers back to
-            // VDO if we have collected more buffers than numAppFrames.
-            if (g_queue_get_length(provider->deliveredFrames) > provider->numAppFrames) {
-                oldBuffer = g_queue_pop_head(provider->deliveredFrames);
-            }
+
+        pushFrame(&provider->deliveredFrames, newBuffer);
+        g_object_unref(newBuffer);  // Release the ref from vdo_stream_get_buffer
+        // Only signal when the client waits, a busy client finds the frame on its next fetch
+        if (atomic_load(&provider->clientWaiting)) {
+            wakeClient(provider);
         }
 
-        if (oldBuffer) {
-            if (!vdo_stream_buffer_enqueue(provider->vdoStream, oldBuffer, &error)) {
-                // Fail but we continue anyway hoping for the best.
-                syslog(LOG_WARNING,
-                       "%s: Failed enqueueing buffer to vdo: %s",
-                       __func__,
-                       (error != NULL) ? error->message : "N/A");
-                g_clear_error(&error);
-            }
+        // First give back all frames returned from app processing
+        VdoBuffer* oldBuffer;
+        while ((oldBuffer = popOldestFrame(&provider->processedFrames, 0))) {
+            enqueueFrame(provider, oldBuffer);
+        }
+
+        // Client specifies the number-of-recent-frames it needs to collect
+        // in one chunk (numAppFrames). Thus enqueue buffers back to VDO
+        // if we have collected more buffers than numAppFrames.
+        while ((oldBuffer = popOldestFrame(&provider->deliveredFrames, provider->numAppFrames))) {
+            atomic_fetch_add_explicit(&provider->droppedFrames, 1, memory_order_relaxed);
+            enqueueFrame(provider, oldBuffer);
         }
-        g_object_unref(newBuffer);  // Release the ref from vdo_stream_get_buffer
-        pthread_cond_signal(&provider->frameDeliverCond);
-        pthread_mutex_unlock(&provider->frameMutex);
     }
     return provider;
 }
@@ -470,6 +560,7 @@ bool startFrameFetch(ImgProvider_t* provider) {
 
 bool stopFrameFetch(ImgProvider_t* provider) {
     provider->shutDown = true;
+    wakeClient(provider);
 
     if (pthread_join(provider->fetcherThread, NULL)) {
         syslog(LOG_ERR,
@@ -28,6 +28,21 @@
 #include "vdo-types.h"
 
 #define NUM_VDO_BUFFERS (8)
+/// Capacity of a FrameRing, a power of two that fits all VDO buffers
+#define FRAME_RING_SIZE (NUM_VDO_BUFFERS)
+
+/**
+ * brief A fixed-capacity lock-free ring of VDO buffers.
+ *
+ * head and tail are free running counters and the ring holds the frames from
+ * head up to tail. Only one thread adds frames at tail. The slots are atomic
+ * since the oldest frame may be removed from either side.
+ */
+typedef struct FrameRing {
+    _Atomic(VdoBuffer*) slots[FRAME_RING_SIZE];
+    atomic_uint head;
+    atomic_uint tail;
+} FrameRing_t;
 
 /**
  * brief A type representing a provider of frames from VDO.
@@ -45,16 +60,19 @@ typedef struct ImgProvider {
     VdoBuffer* vdoBuffers[NUM_VDO_BUFFERS];
 
     /// Keeping track of frames' statuses.
-    GQueue* deliveredFrames;
-    GQueue* processedFrames;
-    /// Number of frames to keep in the deliveredFrames queue.
+    FrameRing_t deliveredFrames;
+    FrameRing_t processedFrames;
+    /// Number of frames to keep in the deliveredFrames ring.
     unsigned int numAppFrames;
+    /// Number of frames given back to VDO without being fetched by the client.
+    atomic_ulong droppedFrames;
 
     /// To support fetching frames asynchonously with VDO.
-    pthread_mutex_t frameMutex;
-    pthread_cond_t frameDeliverCond;
     pthread_t fetcherThread;
     atomic_bool shutDown;
+    /// Wakes up the client when it waits for a frame.
+    int frameEventFd;
+    atomic_bool clientWaiting;
 } ImgProvider_t;
 
 /**
@@ -84,7 +102,7 @@ bool chooseStreamResolution(unsigned int reqWidth,
  *
  * param w Requested output image width.
  * param h Requested ouput image height.
- * param numFrames Number of fetched frames to keep.
+ * param numFrames Number of fetched frames to keep, at most FRAME_RING_SIZE - 1.
  * param vdoFormat Image format to be output by stream.
  * return Pointer to new ImgProvider, or NULL if failed.
  */
@@ -117,11 +135,40 @@ bool stopFrameFetch(ImgProvider_t* provider);
 /**
  * brief Get the most recent frame the thread has fetched from VDO.
  *
+ * Older frames that have not been fetched are given back and counted as
+ * dropped. If there is no new frame this blocks until the thread delivers one.
+ *
  * param provider Pointer to an ImgProvider fetching frames.
- * return Pointer to an image buffer on success, otherwise NULL.
+ * return Pointer to an image buffer on success, otherwise NULL. NULL is also
+ * returned once stopFrameFetch has been called.
  */
 VdoBuffer* getLastFrameBlocking(ImgProvider_t* provider);
 
+/**
+ * brief Get the frames the thread has fetched from VDO since the last call.
+ *
+ * The frames are returned oldest first. If there are more than maxFrames
+ * frames the older ones are given back and counted as dropped. Each returned
+ * frame must be released with returnFrame().
+ *
+ * param provider Pointer to an ImgProvider fetching frames.
+ * param frames Array of at least maxFrames buffers to fill.
+ * param maxFrames Maximum number of frames to return, at least 1.
+ * return Number of returned frames, 0 if there are no new frames.
+ */
+unsigned int getFrames(ImgProvider_t* provider, VdoBuffer** frames, unsigned int maxFrames);
+
+/**
+ * brief Like getFrames() but blocks until there is at least one new frame.
+ *
+ * param provider Pointer to an ImgProvider fetching frames.
+ * param frames Array of at least maxFrames buffers to fill.
+ * param maxFrames Maximum number of frames to return, at least 1.
+ * return Number of returned frames, 0 on error or once stopFrameFetch has
+ * been called.
+ */
+unsigned int getFramesBlocking(ImgProvider_t* provider, VdoBuffer** frames, unsigned int maxFrames);
+
 /**
  * brief Release reference to an image buffer.
  *
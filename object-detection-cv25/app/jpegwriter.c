@@ -0,0 +1,389 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "jpegwriter.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+
+/** Note that jpeglib.h must come after stdio.h
+ */
+#include <jpeglib.h>
+
+/**
+ * @brief Encode one crop with a compressor that is reused between jobs.
+ *
+ * The planes of the crop are passed to libjpeg as raw downsampled data, so
+ * libjpeg does neither color conversion nor chroma downsampling.
+ *
+ * @param jpeg Compressor created once by the worker.
+ * @param job Job holding the crop.
+ * @param quality The desired jpeg quality (0-100).
+ * @param outBuffer Output buffer of the worker, replaced if libjpeg had to grow it.
+ * @param outCapacity Size of outBuffer.
+ * @return Size of the encoded jpeg.
+ */
+static unsigned long encodeJob(struct jpeg_compress_struct* jpeg,
+                               const JpegJob_t* job,
+                               int quality,
+                               unsigned char** outBuffer,
+                               unsigned long* outCapacity) {
+    jpeg->image_width      = job->width;
+    jpeg->image_height     = job->height;
+    jpeg->input_components = 3;
+    jpeg->in_color_space   = JCS_YCbCr;
+    jpeg_set_defaults(jpeg);
+    jpeg_set_quality(jpeg, quality, TRUE);
+
+    // 4:2:0, one chroma sample for each 2x2 luma samples
+    jpeg->raw_data_in                = TRUE;
+    jpeg->comp_info[0].h_samp_factor = 2;
+    jpeg->comp_info[0].v_samp_factor = 2;
+    jpeg->comp_info[1].h_samp_factor = 1;
+    jpeg->comp_info[1].v_samp_factor = 1;
+    jpeg->comp_info[2].h_samp_factor = 1;
+    jpeg->comp_info[2].v_samp_factor = 1;
+
+    // libjpeg writes into the given buffer and only allocates a new one if it is too small
+    unsigned char* buffer = *outBuffer;
+    unsigned long size    = *outCapacity;
+    jpeg_mem_dest(jpeg, &buffer, &size);
+    jpeg_start_compress(jpeg, TRUE);
+
+    // Raw data is written one MCU row at a time, which is 16 luma rows and 8 chroma rows
+    JSAMPROW yRows[JPEG_WRITER_MCU_SIZE];
+    JSAMPROW cbRows[JPEG_WRITER_MCU_SIZE / 2];
+    JSAMPROW crRows[JPEG_WRITER_MCU_SIZE / 2];
+    JSAMPARRAY planes[3] = {yRows, cbRows, crRows};
+    while (jpeg->next_scanline < jpeg->image_height) {
+        size_t row = jpeg->next_scanline;
+        for (size_t i = 0; i < JPEG_WRITER_MCU_SIZE; i++) {
+            yRows[i] = job->yPlane + (row + i) * job->yStride;
+        }
+        for (size_t i = 0; i < JPEG_WRITER_MCU_SIZE / 2; i++) {
+            cbRows[i] = job->cbPlane + (row / 2 + i) * job->chromaStride;
+            crRows[i] = job->crPlane + (row / 2 + i) * job->chromaStride;
+        }
+        jpeg_write_raw_data(jpeg, planes, JPEG_WRITER_MCU_SIZE);
+    }
+    jpeg_finish_compress(jpeg);
+
+    if (buffer != *outBuffer) {
+        free(*outBuffer);
+        *outBuffer   = buffer;
+        *outCapacity = size;
+    }
+    return size;
+}
+
+// Round up to a whole number of MCUs
+static unsigned int mcuCeil(unsigned int value) {
+    return (value + JPEG_WRITER_MCU_SIZE - 1) / JPEG_WRITER_MCU_SIZE * JPEG_WRITER_MCU_SIZE;
+}
+
+/**
+ * @brief Pad a plane to its full size by repeating its last column and row.
+ *
+ * libjpeg reads whole MCUs, so the samples outside the crop must be set.
+ *
+ * @param plane First sample of the plane.
+ * @param stride Row length of the plane in samples.
+ * @param width Number of samples in each row that belong to the crop.
+ * @param height Number of rows that belong to the crop.
+ * @param paddedHeight Number of rows of the plane.
+ */
+static void padPlane(unsigned char* plane,
+                     size_t stride,
+                     size_t width,
+                     size_t height,
+                     size_t paddedHeight) {
+    if (width < stride) {
+        for (size_t row = 0; row < height; row++) {
+            unsigned char* line = plane + row * stride;
+            memset(line + width, line[width - 1], stride - width);
+        }
+    }
+    for (size_t row = height; row < paddedHeight; row++) {
+        memcpy(plane + row * stride, plane + (height - 1) * stride, stride);
+    }
+}
+
+/**
+ * @brief Write a jpeg to a temporary file and rename it to its final name.
+ *
+ * @param fileName The path of the output file.
+ * @param buffer The jpeg data.
+ * @param size The size of the jpeg data.
+ */
+static void writeJob(const char* fileName, const unsigned char* buffer, unsigned long size) {
+    char tmpName[JPEG_WRITER_MAX_FILE_NAME + 4];
+    snprintf(tmpName, sizeof(tmpName), "%s.tmp", fileName);
+
+    FILE* fp = fopen(tmpName, "wb");
+    if (!fp) {
+        syslog(LOG_WARNING, "%s: Unable to open %s: %s", __func__, tmpName, strerror(errno));
+        return;
+    }
+    bool written = fwrite(buffer, sizeof(unsigned char), size, fp) == size;
+    if (fclose(fp) != 0 || !written) {
+        syslog(LOG_WARNING, "%s: Unable to write %s", __func__, tmpName);
+        remove(tmpName);
+        return;
+    }
+    if (rename(tmpName, fileName) != 0) {
+        syslog(LOG_WARNING, "%s: Unable to rename %s: %s", __func__, tmpName, strerror(errno));
+        remove(tmpName);
+    }
+}
+
+static void* workerEntry(void* data) {
+    JpegWriter_t* writer = (JpegWriter_t*)data;
+
+    struct jpeg_compress_struct jpeg;
+    struct jpeg_error_mgr jerr;
+    jpeg.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&jpeg);
+    unsigned char* outBuffer  = NULL;
+    unsigned long outCapacity = 0;
+
+    pthread_mutex_lock(&writer->mutex);
+    while (true) {
+        while (!writer->shutDown && writer->numPendingJobs == 0) {
+            pthread_cond_wait(&writer->jobCond, &writer->mutex);
+        }
+        if (writer->shutDown) {
+            break;
+        }
+        unsigned int jobIdx = writer->pendingJobs[writer->pendingHead];
+        writer->pendingHead = (writer->pendingHead + 1) % writer->numJobs;
+        writer->numPendingJobs--;
+        pthread_mutex_unlock(&writer->mutex);
+
+        JpegJob_t* job     = &writer->jobs[jobIdx];
+        unsigned long size = encodeJob(&jpeg, job, writer->quality, &outBuffer, &outCapacity);
+        writeJob(job->fileName, outBuffer, size);
+
+        pthread_mutex_lock(&writer->mutex);
+        writer->freeJobs[writer->numFreeJobs++] = jobIdx;
+    }
+    pthread_mutex_unlock(&writer->mutex);
+
+    jpeg_destroy_compress(&jpeg);
+    free(outBuffer);
+
+    return NULL;
+}
+
+JpegWriter_t* createJpegWriter(unsigned int numWorkers, unsigned int numJobs, int quality) {
+    bool mtxInitialized  = false;
+    bool condInitialized = false;
+
+    if (numWorkers == 0 || numWorkers > JPEG_WRITER_MAX_WORKERS || numJobs == 0) {
+        syslog(LOG_ERR,
+               "%s: Invalid number of workers %u or jobs %u",
+               __func__,
+               numWorkers,
+               numJobs);
+        return NULL;
+    }
+
+    JpegWriter_t* writer = calloc(1, sizeof(JpegWriter_t));
+    if (!writer) {
+        syslog(LOG_ERR, "%s: Unable to allocate JpegWriter: %s", __func__, strerror(errno));
+        return NULL;
+    }
+    writer->quality     = quality;
+    writer->numJobs     = numJobs;
+    writer->jobs        = calloc(numJobs, sizeof(JpegJob_t));
+    writer->freeJobs    = calloc(numJobs, sizeof(unsigned int));
+    writer->pendingJobs = calloc(numJobs, sizeof(unsigned int));
+    if (!writer->jobs || !writer->freeJobs || !writer->pendingJobs) {
+        syslog(LOG_ERR, "%s: Unable to allocate job slots", __func__);
+        goto errorExit;
+    }
+    for (unsigned int i = 0; i < numJobs; i++) {
+        writer->freeJobs[i] = i;
+    }
+    writer->numFreeJobs = numJobs;
+
+    if (pthread_mutex_init(&writer->mutex, NULL)) {
+        syslog(LOG_ERR, "%s: Unable to initialize mutex: %s", __func__, strerror(errno));
+        goto errorExit;
+    }
+    mtxInitialized = true;
+
+    if (pthread_cond_init(&writer->jobCond, NULL)) {
+        syslog(LOG_ERR,
+               "%s: Unable to initialize condition variable: %s",
+               __func__,
+               strerror(errno));
+        goto errorExit;
+    }
+    condInitialized = true;
+
+    for (; writer->numWorkers < numWorkers; writer->numWorkers++) {
+        if (pthread_create(&writer->workers[writer->numWorkers], NULL, workerEntry, writer)) {
+            syslog(LOG_ERR, "%s: Failed to start worker thread: %s", __func__, strerror(errno));
+            goto errorExit;
+        }
+    }
+
+    return writer;
+
+errorExit:
+    if (writer->numWorkers > 0) {
+        // Stops and joins the workers that were started and frees everything
+        destroyJpegWriter(writer);
+        return NULL;
+    }
+    if (mtxInitialized) {
+        pthread_mutex_destroy(&writer->mutex);
+    }
+    if (condInitialized) {
+        pthread_cond_destroy(&writer->jobCond);
+    }
+    free(writer->jobs);
+    free(writer->freeJobs);
+    free(writer->pendingJobs);
+    free(writer);
+
+    return NULL;
+}
+
+void destroyJpegWriter(JpegWriter_t* writer) {
+    if (!writer) {
+        return;
+    }
+
+    pthread_mutex_lock(&writer->mutex);
+    writer->shutDown = true;
+    pthread_cond_broadcast(&writer->jobCond);
+    pthread_mutex_unlock(&writer->mutex);
+
+    for (unsigned int i = 0; i < writer->numWorkers; i++) {
+        if (pthread_join(writer->workers[i], NULL)) {
+            syslog(LOG_ERR, "%s: Failed to join worker thread: %s", __func__, strerror(errno));
+        }
+    }
+    if (writer->droppedJobs > 0) {
+        syslog(LOG_INFO, "Dropped %lu crops since all jpeg workers were busy", writer->droppedJobs);
+    }
+
+    pthread_mutex_destroy(&writer->mutex);
+    pthread_cond_destroy(&writer->jobCond);
+    for (unsigned int i = 0; i < writer->numJobs; i++) {
+        free(writer->jobs[i].cropBuffer);
+    }
+    free(writer->jobs);
+    free(writer->freeJobs);
+    free(writer->pendingJobs);
+    free(writer);
+}
+
+bool submitJpegJob(JpegWriter_t* writer,
+                   const uint8_t* nv12,
+                   unsigned int imageWidth,
+                   unsigned int imageHeight,
+                   unsigned int cropX,
+                   unsigned int cropY,
+                   unsigned int cropWidth,
+                   unsigned int cropHeight,
+                   const char* fileName) {
+    // Align the crop to whole MCUs and clip it to the image
+    unsigned int cropRight  = mcuCeil(cropX + cropWidth);
+    unsigned int cropBottom = mcuCeil(cropY + cropHeight);
+    cropX                   = cropX / JPEG_WRITER_MCU_SIZE * JPEG_WRITER_MCU_SIZE;
+    cropY                   = cropY / JPEG_WRITER_MCU_SIZE * JPEG_WRITER_MCU_SIZE;
+    if (cropRight > imageWidth) {
+        cropRight = imageWidth;
+    }
+    if (cropBottom > imageHeight) {
+        cropBottom = imageHeight;
+    }
+    if (cropX >= cropRight || cropY >= cropBottom) {
+        return false;
+    }
+    cropWidth  = cropRight - cropX;
+    cropHeight = cropBottom - cropY;
+
+    pthread_mutex_lock(&writer->mutex);
+    if (writer->numFreeJobs == 0) {
+        writer->droppedJobs++;
+        pthread_mutex_unlock(&writer->mutex);
+        return false;
+    }
+    unsigned int jobIdx = writer->freeJobs[--writer->numFreeJobs];
+    pthread_mutex_unlock(&writer->mutex);
+
+    // The slot is owned by this thread until it is added to the pending jobs. The planes are
+    // padded to whole MCUs, which only matters at the right and bottom edges of the image.
+    JpegJob_t* job      = &writer->jobs[jobIdx];
+    size_t yStride      = mcuCeil(cropWidth);
+    size_t paddedHeight = mcuCeil(cropHeight);
+    size_t lumaSize     = yStride * paddedHeight;
+    size_t cropSize     = lumaSize + lumaSize / 2;
+    if (cropSize > job->cropCapacity) {
+        unsigned char* buffer = realloc(job->cropBuffer, cropSize);
+        if (!buffer) {
+            syslog(LOG_WARNING, "%s: Unable to allocate crop buffer", __func__);
+            pthread_mutex_lock(&writer->mutex);
+            writer->freeJobs[writer->numFreeJobs++] = jobIdx;
+            pthread_mutex_unlock(&writer->mutex);
+            return false;
+        }
+        job->cropBuffer   = buffer;
+        job->cropCapacity = cropSize;
+    }
+    job->width        = (int)cropWidth;
+    job->height       = (int)cropHeight;
+    job->yStride      = yStride;
+    job->chromaStride = yStride / 2;
+    job->yPlane       = job->cropBuffer;
+    job->cbPlane      = job->cropBuffer + lumaSize;
+    job->crPlane      = job->cbPlane + lumaSize / 4;
+
+    // Copy the luma rows, and split the interleaved chroma rows into the two chroma planes
+    const uint8_t* ySrc  = nv12 + (size_t)cropY * imageWidth + cropX;
+    const uint8_t* uvSrc = nv12 + (size_t)imageWidth * (imageHeight + cropY / 2) + cropX;
+    for (unsigned int row = 0; row < cropHeight; row++) {
+        memcpy(job->yPlane + row * yStride, ySrc + (size_t)row * imageWidth, cropWidth);
+    }
+    for (unsigned int row = 0; row < cropHeight / 2; row++) {
+        const uint8_t* uv = uvSrc + (size_t)row * imageWidth;
+        unsigned char* cb = job->cbPlane + row * job->chromaStride;
+        unsigned char* cr = job->crPlane + row * job->chromaStride;
+        for (unsigned int x = 0; x < cropWidth / 2; x++) {
+            cb[x] = uv[2 * x];
+            cr[x] = uv[2 * x + 1];
+        }
+    }
+    padPlane(job->yPlane, yStride, cropWidth, cropHeight, paddedHeight);
+    padPlane(job->cbPlane, job->chromaStride, cropWidth / 2, cropHeight / 2, paddedHeight / 2);
+    padPlane(job->crPlane, job->chromaStride, cropWidth / 2, cropHeight / 2, paddedHeight / 2);
+    snprintf(job->fileName, sizeof(job->fileName), "%s", fileName);
+
+    pthread_mutex_lock(&writer->mutex);
+    unsigned int tail         = (writer->pendingHead + writer->numPendingJobs) % writer->numJobs;
+    writer->pendingJobs[tail] = jobIdx;
+    writer->numPendingJobs++;
+    pthread_cond_signal(&writer->jobCond);
+    pthread_mutex_unlock(&writer->mutex);
+
+    return true;
+}
@@ -0,0 +1,133 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This header file handles encoding and saving of detection crops on worker threads.
+ */
+
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define JPEG_WRITER_MAX_WORKERS (4)
+#define JPEG_WRITER_MAX_FILE_NAME (64)
+/// Size in pixels of a 4:2:0 MCU, crops are aligned to this
+#define JPEG_WRITER_MCU_SIZE (16)
+
+/**
+ * @brief A crop waiting to be encoded, or a free slot.
+ *
+ * The crop is stored as three planes, Y in full resolution and Cb and Cr in
+ * half resolution, padded to whole MCUs. The crop buffer is kept between jobs
+ * and only grows when a larger crop arrives.
+ */
+typedef struct JpegJob {
+    unsigned char* cropBuffer;
+    size_t cropCapacity;
+    int width;
+    int height;
+    unsigned char* yPlane;
+    unsigned char* cbPlane;
+    unsigned char* crPlane;
+    size_t yStride;
+    size_t chromaStride;
+    char fileName[JPEG_WRITER_MAX_FILE_NAME];
+} JpegJob_t;
+
+/**
+ * @brief A bounded pool of threads that encode crops as jpeg and write them to file.
+ *
+ * Each worker keeps its own libjpeg compressor and output buffer for its whole
+ * lifetime. The crops are encoded from their YCbCr planes with the raw data
+ * interface of libjpeg, so they are never converted to RGB. A job slot
+ * is taken when a crop is submitted and returned when the file has been written.
+ * When all slots are taken new crops are dropped, so the caller never waits for
+ * the encoding.
+ */
+typedef struct JpegWriter {
+    int quality;
+
+    /// All job slots, and the indices of the free and pending ones.
+    JpegJob_t* jobs;
+    unsigned int numJobs;
+    unsigned int* freeJobs;
+    unsigned int numFreeJobs;
+    /// Ring buffer of pending job indices, oldest first.
+    unsigned int* pendingJobs;
+    unsigned int pendingHead;
+    unsigned int numPendingJobs;
+
+    pthread_t workers[JPEG_WRITER_MAX_WORKERS];
+    unsigned int numWorkers;
+    pthread_mutex_t mutex;
+    pthread_cond_t jobCond;
+    bool shutDown;
+
+    /// Number of crops dropped because all job slots were taken.
+    unsigned long droppedJobs;
+} JpegWriter_t;
+
+/**
+ * @brief Create a JpegWriter and start its worker threads.
+ *
+ * @param numWorkers Number of worker threads, at most JPEG_WRITER_MAX_WORKERS.
+ * @param numJobs Maximum number of crops that are queued or being encoded.
+ * @param quality The desired jpeg quality (0-100).
+ * @return Pointer to new JpegWriter, or NULL if failed.
+ */
+JpegWriter_t* createJpegWriter(unsigned int numWorkers, unsigned int numJobs, int quality);
+
+/**
+ * @brief Stop the worker threads and free the JpegWriter.
+ *
+ * Crops that are still queued are discarded, crops being encoded are finished.
+ *
+ * @param writer Pointer to JpegWriter to be destroyed.
+ */
+void destroyJpegWriter(JpegWriter_t* writer);
+
+/**
+ * @brief Copy a crop from an NV12 image and queue it for encoding.
+ *
+ * Only the crop is copied, so the image can be reused as soon as this returns.
+ * The crop is grown to whole MCUs of JPEG_WRITER_MCU_SIZE pixels and clipped
+ * to the image. The jpeg is written to a temporary file
+ * that is renamed to fileName, so a reader never sees a partial file.
+ *
+ * @param writer JpegWriter from createJpegWriter.
+ * @param nv12 NV12 image with a luma plane of imageWidth x imageHeight bytes followed by
+ * the interleaved chroma plane.
+ * @param imageWidth The image's width in pixels, must be even.
+ * @param imageHeight The image's height in pixels, must be even.
+ * @param cropX The leftmost pixel coordinate of the crop.
+ * @param cropY The top pixel coordinate of the crop.
+ * @param cropWidth The width of the crop in pixels.
+ * @param cropHeight The height of the crop in pixels.
+ * @param fileName The path of the output file.
+ * @return False if the crop was dropped, otherwise true.
+ */
+bool submitJpegJob(JpegWriter_t* writer,
+                   const uint8_t* nv12,
+                   unsigned int imageWidth,
+                   unsigned int imageHeight,
+                   unsigned int cropX,
+                   unsigned int cropY,
+                   unsigned int cropWidth,
+                   unsigned int cropHeight,
+                   const char* fileName);
@@ -54,7 +54,6 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
@@ -62,10 +61,13 @@
 #include <unistd.h>
 
 #include "argparse.h"
+#include "framesync.h"
 #include "imgprovider.h"
 #include "imgutils.h"
+#include "jpegwriter.h"
 #include "larod.h"
 #include "postprocessing.h"
+#include "tensorbuffer.h"
 #include "vdo-frame.h"
 #include "vdo-types.h"
 
@@ -80,18 +82,25 @@ static void freeLabels(char** labelsArray, char* labelFileBuffer) {
     free(labelFileBuffer);
 }
 
-static void padImageWidth(uint8_t* srcimage,
+/**
+ * @brief Copy a planar image into a buffer where each row is followed by padding.
+ *
+ * Only used when the preprocessing can not write the padded rows itself.
+ *
+ * @param srcimage Planar image with rows of width bytes.
+ * @param dstimage Planar image with rows of width + padding bytes.
+ * @param width Width of the image.
+ * @param height Height of the image.
+ * @param padding Number of padding bytes after each row.
+ */
+static void padImageWidth(const uint8_t* srcimage,
                           uint8_t* dstimage,
                           unsigned int width,
                           unsigned int height,
                           unsigned int padding) {
-    for (size_t k = 0; k < 3; k++) {
-        for (size_t i = 0; i < height; i++) {
-            for (size_t j = 0; j < width; j++) {
-                dstimage[k * ((width + padding) * height) + i * (width + padding) + j] =
-                    srcimage[k * (width * height) + i * width + j];
-            }
-        }
+    const size_t dstPitch = width + padding;
+    for (size_t row = 0; row < 3 * (size_t)height; row++) {
+        memcpy(dstimage + row * dstPitch, srcimage + row * width, width);
     }
 }
 
@@ -264,71 +273,6 @@ static void sigintHandler(int sig) {
     stopRunning = true;
 }
 
-/**
- * @brief Creates a temporary fd and truncated to correct size and mapped.
- *
- * This convenience function creates temp files to be used for input and output.
- *
- * @param fileName Pattern for how the temp file will be named in file system.
- * @param fileSize How much space needed to be allocated (truncated) in fd.
- * @param mappedAddr Pointer to the address of the fd mapped for this process.
- * @param Pointer to the generated fd.
- * @return Positive errno style return code (zero means success).
- */
-static bool createAndMapTmpFile(char* fileName, size_t fileSize, void** mappedAddr, int* convFd) {
-    syslog(LOG_INFO,
-           "%s: Setting up a temp fd with pattern %s and size %zu",
-           __func__,
-           fileName,
-           fileSize);
-
-    int fd = mkstemp(fileName);
-    if (fd < 0) {
-        syslog(LOG_ERR, "%s: Unable to open temp file %s: %s", __func__, fileName, strerror(errno));
-        goto error;
-    }
-
-    // Allocate enough space in for the fd.
-    if (ftruncate(fd, (off_t)fileSize) < 0) {
-        syslog(LOG_ERR,
-               "%s: Unable to truncate temp file %s: %s",
-               __func__,
-               fileName,
-               strerror(errno));
-        goto error;
-    }
-
-    // Remove since we don't actually care about writing to the file system.
-    if (unlink(fileName)) {
-        syslog(LOG_ERR,
-               "%s: Unable to unlink from temp file %s: %s",
-               __func__,
-               fileName,
-               strerror(errno));
-        goto error;
-    }
-
-    // Get an address to fd's memory for this process's memory space.
-    void* data = mmap(NULL, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-
-    if (data == MAP_FAILED) {
-        syslog(LOG_ERR, "%s: Unable to mmap temp file %s: %s", __func__, fileName, strerror(errno));
-        goto error;
-    }
-
-    *mappedAddr = data;
-    *convFd     = fd;
-
-    return true;
-
-error:
-    if (fd >= 0) {
-        close(fd);
-    }
-
-    return false;
-}
-
 /**
  * @brief Sets up and configures a connection to larod, and loads a model.
  *
@@ -413,68 +357,49 @@ int main(int argc, char** argv) {
     const unsigned int FLOATSIZE   = 4;
     const unsigned int TENSOR1SIZE = 1917 * 4 * FLOATSIZE;
     const unsigned int TENSOR2SIZE = 1917 * 91 * FLOATSIZE;
-
-    // Name patterns for the temp file we will create.
-
-    // Pre-processing of the High resolution frame input and output
-    char PP_HD_INPUT_FILE_PATTERN[]  = "/tmp/larod.pp.hd.test-XXXXXX";
-    char PP_HD_OUTPUT_FILE_PATTERN[] = "/tmp/larod.pp.hd.out.test-XXXXXX";
-
-    // Pre-processing of the Low resolution frame input and output
-    char PP_SD_INPUT_FILE_PATTERN[]  = "/tmp/larod.pp.test-XXXXXX";
-    char PP_SD_OUTPUT_FILE_PATTERN[] = "/tmp/larod.pp.out.test-XXXXXX";
-
-    char OBJECT_DETECTOR_INPUT_FILE_PATTERN[] = "/tmp/larod.in.test-XXXXXX";
-
-    char OBJECT_DETECTOR_OUT1_FILE_PATTERN[] = "/tmp/larod.out1.test-XXXXXX";
-    char OBJECT_DETECTOR_OUT2_FILE_PATTERN[] = "/tmp/larod.out2.test-XXXXXX";
-
-    bool ret                        = false;
-    ImgProvider_t* sdImageProvider  = NULL;
-    ImgProvider_t* hdImageProvider  = NULL;
-    larodError* error               = NULL;
-    larodConnection* conn           = NULL;
-    larodMap* ppMap                 = NULL;
-    larodMap* cropMap               = NULL;
-    larodMap* ppMapHD               = NULL;
-    larodModel* ppModel             = NULL;
-    larodModel* ppModelHD           = NULL;
-    larodModel* model               = NULL;
-    larodTensor** ppInputTensors    = NULL;
-    size_t ppNumInputs              = 0;
-    larodTensor** ppOutputTensors   = NULL;
-    size_t ppNumOutputs             = 0;
-    larodTensor** ppInputTensorsHD  = NULL;
-    size_t ppNumInputsHD            = 0;
-    larodTensor** ppOutputTensorsHD = NULL;
-    size_t ppNumOutputsHD           = 0;
-    larodTensor** inputTensors      = NULL;
-    size_t numInputs                = 0;
-    larodTensor** outputTensors     = NULL;
-    size_t numOutputs               = 0;
-    larodJobRequest* ppReq          = NULL;
-    larodJobRequest* ppReqHD        = NULL;
-    larodJobRequest* infReq         = NULL;
-    void* cropAddr                  = NULL;
-    void* ppInputAddr               = MAP_FAILED;
-    void* ppOutputAddr              = MAP_FAILED;
-    void* ppInputAddrHD             = MAP_FAILED;
-    void* ppOutputAddrHD            = MAP_FAILED;
-    void* larodInputAddr            = MAP_FAILED;
-    void* larodOutput1Addr          = MAP_FAILED;
-    void* larodOutput2Addr          = MAP_FAILED;
-    int larodModelFd                = -1;
-    int ppInputFd                   = -1;
-    int ppOutputFd                  = -1;
-    int ppInputFdHD                 = -1;
-    int ppOutputFdHD                = -1;
-    int larodInputFd                = -1;
-    int larodOutput1Fd              = -1;
-    int larodOutput2Fd              = -1;
-    box* boxes                      = NULL;
-    char** labels                   = NULL;  // This is the array of label strings. The label
-                                             // entries points into the large labelFileData buffer.
-    size_t numLabels    = 0;                 // Number of entries in the labels array.
+    // Hardcode the number of best scoring boxes that are passed to non-maximum suppression.
+    const int TOP_K = 100;
+    // Hardcode the number of threads encoding detection crops and the number of queued crops.
+    const unsigned int NUM_JPEG_WORKERS = 2;
+    const unsigned int NUM_JPEG_JOBS    = 8;
+    // Hardcode how many frames of each stream are kept for pairing, and the largest timestamp
+    // difference of a pair. Half a frame interval at 30 fps.
+    const unsigned int FRAME_SYNC_HISTORY   = 3;
+    const uint64_t FRAME_SYNC_TOLERANCE_US = 16000;
+
+    bool ret                       = false;
+    ImgProvider_t* sdImageProvider = NULL;
+    ImgProvider_t* hdImageProvider = NULL;
+    FrameSync_t* frameSync         = NULL;
+    larodError* error              = NULL;
+    larodConnection* conn          = NULL;
+    larodMap* ppMap                = NULL;
+    larodMap* cropMap              = NULL;
+    larodModel* ppModel            = NULL;
+    larodModel* model              = NULL;
+    larodTensor** ppInputTensors   = NULL;
+    size_t ppNumInputs             = 0;
+    larodTensor** ppOutputTensors  = NULL;
+    size_t ppNumOutputs            = 0;
+    larodTensor** inputTensors     = NULL;
+    size_t numInputs               = 0;
+    larodTensor** outputTensors    = NULL;
+    size_t numOutputs              = 0;
+    larodJobRequest* ppReq         = NULL;
+    larodJobRequest* infReq        = NULL;
+    TensorBufferPool_t* bufferPool = NULL;
+    TensorBuffer_t* ppInputBuffer  = NULL;
+    TensorBuffer_t* ppOutputBuffer = NULL;
+    TensorBuffer_t* larodInput     = NULL;
+    TensorBuffer_t* larodOutput1   = NULL;
+    TensorBuffer_t* larodOutput2   = NULL;
+    int larodModelFd               = -1;
+    box* boxes                     = NULL;
+    PostProcessor_t* postProcessor = NULL;
+    JpegWriter_t* jpegWriter       = NULL;
+    char** labels                  = NULL;  // This is the array of label strings. The label
+                                            // entries points into the large labelFileData buffer.
+    size_t numLabels    = 0;                // Number of entries in the labels array.
     char* labelFileData = NULL;  // Buffer holding the complete collection of label strings.
 
     args_t args;
@@ -496,6 +421,8 @@ int main(int argc, char** argv) {
     const int numberOfClasses    = args.numLabels;      // number of classes
     char* anchorFile             = args.anchorsFile;
     const int padding            = args.padding;
+    // True when the preprocessing output buffer is also the model input buffer
+    bool sharedInput = true;
 
     if (strcmp(chipString, "ambarella-cvflow") != 0) {
         syslog(LOG_ERR, "This example supports only cv25 device ");
@@ -591,24 +518,9 @@ int main(int argc, char** argv) {
         syslog(LOG_ERR, "Failed setting preprocessing parameters: %s", error->msg);
         goto end;
     }
-    ppMapHD = larodCreateMap(&error);
-    if (!ppMapHD) {
-        syslog(LOG_ERR, "Could not create preprocessing high resolution larodMap %s", error->msg);
-        goto end;
-    }
-    if (!larodMapSetStr(ppMapHD, "image.input.format", "nv12", &error)) {
-        syslog(LOG_ERR, "Failed setting preprocessing parameters: %s", error->msg);
-        goto end;
-    }
-    if (!larodMapSetIntArr2(ppMapHD, "image.input.size", widthFrameHD, heightFrameHD, &error)) {
-        syslog(LOG_ERR, "Failed setting preprocessing parameters: %s", error->msg);
-        goto end;
-    }
-    if (!larodMapSetStr(ppMapHD, "image.output.format", "rgb-interleaved", &error)) {
-        syslog(LOG_ERR, "Failed setting preprocessing parameters: %s", error->msg);
-        goto end;
-    }
-    if (!larodMapSetIntArr2(ppMapHD, "image.output.size", widthFrameHD, heightFrameHD, &error)) {
+    // Write the rows with the padded pitch of the model input, so that the preprocessing output
+    // can be used as model input without any copy.
+    if (!larodMapSetInt(ppMap, "image.output.row-pitch", inputWidth + padding, &error)) {
         syslog(LOG_ERR, "Failed setting preprocessing parameters: %s", error->msg);
         goto end;
     }
@@ -645,22 +557,19 @@ int main(int argc, char** argv) {
     const larodDevice* dev_pp;
     dev_pp  = larodGetDevice(conn, larodLibyuvPP, 0, &error);
     ppModel = larodLoadModel(conn, -1, dev_pp, LAROD_ACCESS_PRIVATE, "", ppMap, &error);
-    if (!ppModel) {
-        syslog(LOG_ERR,
-               "Unable to load preprocessing model with chip %s: %s",
-               larodLibyuvPP,
+    if (!ppModel && padding > 0) {
+        syslog(LOG_WARNING,
+               "Preprocessing can not write padded rows (%s), padding rows by copying instead",
                error->msg);
-        goto end;
-    } else {
-        syslog(LOG_INFO, "Loading preprocessing model with chip %s", larodLibyuvPP);
+        larodClearError(&error);
+        sharedInput = false;
+        if (!larodMapSetInt(ppMap, "image.output.row-pitch", inputWidth, &error)) {
+            syslog(LOG_ERR, "Failed setting preprocessing parameters: %s", error->msg);
+            goto end;
+        }
+        ppModel = larodLoadModel(conn, -1, dev_pp, LAROD_ACCESS_PRIVATE, "", ppMap, &error);
     }
-
-    // run image processing also on the high resolution frame
-
-    const larodDevice* dev_pp_hd;
-    dev_pp_hd = larodGetDevice(conn, larodLibyuvPP, 0, &error);
-    ppModelHD = larodLoadModel(conn, -1, dev_pp_hd, LAROD_ACCESS_PRIVATE, "", ppMapHD, &error);
-    if (!ppModelHD) {
+    if (!ppModel) {
         syslog(LOG_ERR,
                "Unable to load preprocessing model with chip %s: %s",
                larodLibyuvPP,
@@ -683,17 +592,6 @@ int main(int argc, char** argv) {
         goto end;
     }
 
-    ppInputTensorsHD = larodCreateModelInputs(ppModelHD, &ppNumInputsHD, &error);
-    if (!ppInputTensorsHD) {
-        syslog(LOG_ERR, "Failed retrieving input tensors: %s", error->msg);
-        goto end;
-    }
-    ppOutputTensorsHD = larodCreateModelOutputs(ppModelHD, &ppNumOutputsHD, &error);
-    if (!ppOutputTensorsHD) {
-        syslog(LOG_ERR, "Failed retrieving output tensors: %s", error->msg);
-        goto end;
-    }
-
     inputTensors = larodCreateModelInputs(model, &numInputs, &error);
     if (!inputTensors) {
         syslog(LOG_ERR, "Failed retrieving input tensors: %s", error->msg);
@@ -720,7 +618,8 @@ int main(int argc, char** argv) {
         goto end;
     }
     size_t rgbBufferSize = ppOutputPitches->pitches[0];
-    size_t expectedSize  = inputWidth * inputHeight * CHANNELS;
+    size_t rgbRowPitch   = sharedInput ? inputWidth + padding : inputWidth;
+    size_t expectedSize  = rgbRowPitch * inputHeight * CHANNELS;
     if (expectedSize != rgbBufferSize) {
         syslog(LOG_ERR, "Expected video output size %zu, actual %zu", expectedSize, rgbBufferSize);
         goto end;
@@ -733,81 +632,62 @@ int main(int argc, char** argv) {
 
     // Allocate space for input tensor
     syslog(LOG_INFO, "Allocate memory for input/output buffers");
-    if (!createAndMapTmpFile(PP_SD_INPUT_FILE_PATTERN, yuyvBufferSize, &ppInputAddr, &ppInputFd)) {
+    bufferPool = createTensorBufferPool();
+    if (!bufferPool) {
         goto end;
     }
-    if (!createAndMapTmpFile(PP_SD_OUTPUT_FILE_PATTERN,
-                             rgbBufferSize,
-                             &ppOutputAddr,
-                             &ppOutputFd)) {
+    ppInputBuffer = acquireTensorBuffer(bufferPool, "larod.pp.in", yuyvBufferSize);
+    if (!ppInputBuffer) {
         goto end;
     }
-    if (!createAndMapTmpFile(OBJECT_DETECTOR_INPUT_FILE_PATTERN,
-                             (inputWidth + padding) * inputHeight * CHANNELS,
-                             &larodInputAddr,
-                             &larodInputFd)) {
-        goto end;
+    if (!sharedInput) {
+        ppOutputBuffer = acquireTensorBuffer(bufferPool, "larod.pp.out", rgbBufferSize);
+        if (!ppOutputBuffer) {
+            goto end;
+        }
     }
-    if (!createAndMapTmpFile(PP_HD_INPUT_FILE_PATTERN,
-                             widthFrameHD * heightFrameHD * CHANNELS / 2,
-                             &ppInputAddrHD,
-                             &ppInputFdHD)) {
+    larodInput = acquireTensorBuffer(bufferPool,
+                                     "larod.in",
+                                     (inputWidth + padding) * inputHeight * CHANNELS);
+    if (!larodInput) {
         goto end;
     }
-    if (!createAndMapTmpFile(PP_HD_OUTPUT_FILE_PATTERN,
-                             widthFrameHD * heightFrameHD * CHANNELS,
-                             &ppOutputAddrHD,
-                             &ppOutputFdHD)) {
+    larodOutput1 = acquireTensorBuffer(bufferPool, "larod.out1", TENSOR1SIZE);
+    if (!larodOutput1) {
         goto end;
     }
-
-    if (!createAndMapTmpFile(OBJECT_DETECTOR_OUT1_FILE_PATTERN,
-                             TENSOR1SIZE,
-                             &larodOutput1Addr,
-                             &larodOutput1Fd)) {
-        goto end;
-    }
-    if (!createAndMapTmpFile(OBJECT_DETECTOR_OUT2_FILE_PATTERN,
-                             TENSOR2SIZE,
-                             &larodOutput2Addr,
-                             &larodOutput2Fd)) {
+    larodOutput2 = acquireTensorBuffer(bufferPool, "larod.out2", TENSOR2SIZE);
+    if (!larodOutput2) {
         goto end;
     }
 
-    // Connect tensors to file descriptors
+    // Connect tensors to file descriptors. The tensors map the buffers, so the file positions
+    // of the fds are never used and don't have to be rewound between jobs.
     syslog(LOG_INFO, "Connect tensors to file descriptors");
     syslog(LOG_INFO, "Set pp input tensors");
-    if (!larodSetTensorFd(ppInputTensors[0], ppInputFd, &error)) {
-        syslog(LOG_ERR, "Failed setting input tensor fd: %s", error->msg);
-        goto end;
-    }
-    if (!larodSetTensorFd(ppOutputTensors[0], ppOutputFd, &error)) {
+    if (!setTensorBuffer(ppInputTensors[0], ppInputBuffer, &error)) {
         syslog(LOG_ERR, "Failed setting input tensor fd: %s", error->msg);
         goto end;
     }
-    syslog(LOG_INFO, "Set pp input tensors for high resolution frame");
-    if (!larodSetTensorFd(ppInputTensorsHD[0], ppInputFdHD, &error)) {
-        syslog(LOG_ERR, "Failed setting input tensor fd: %s", error->msg);
-        goto end;
-    }
-    if (!larodSetTensorFd(ppOutputTensorsHD[0], ppOutputFdHD, &error)) {
+    // With a shared input the preprocessing writes straight into the model input buffer
+    if (!setTensorBuffer(ppOutputTensors[0], sharedInput ? larodInput : ppOutputBuffer, &error)) {
         syslog(LOG_ERR, "Failed setting input tensor fd: %s", error->msg);
         goto end;
     }
 
     syslog(LOG_INFO, "Set input tensors");
-    if (!larodSetTensorFd(inputTensors[0], larodInputFd, &error)) {
+    if (!setTensorBuffer(inputTensors[0], larodInput, &error)) {
         syslog(LOG_ERR, "Failed setting input tensor fd: %s", error->msg);
         goto end;
     }
 
     syslog(LOG_INFO, "Set output tensors");
-    if (!larodSetTensorFd(outputTensors[0], larodOutput1Fd, &error)) {
+    if (!setTensorBuffer(outputTensors[0], larodOutput1, &error)) {
         syslog(LOG_ERR, "Failed setting output tensor fd: %s", error->msg);
         goto end;
     }
 
-    if (!larodSetTensorFd(outputTensors[1], larodOutput2Fd, &error)) {
+    if (!setTensorBuffer(outputTensors[1], larodOutput2, &error)) {
         syslog(LOG_ERR, "Failed setting output tensor fd: %s", error->msg);
         goto end;
     }
@@ -825,19 +705,6 @@ int main(int argc, char** argv) {
         syslog(LOG_ERR, "Failed creating preprocessing job request: %s", error->msg);
         goto end;
     }
-    ppReqHD = larodCreateJobRequest(ppModelHD,
-                                    ppInputTensorsHD,
-                                    ppNumInputsHD,
-                                    ppOutputTensorsHD,
-                                    ppNumOutputsHD,
-                                    NULL,
-                                    &error);
-    if (!ppReqHD) {
-        syslog(LOG_ERR,
-               "Failed creating high resolution preprocessing job request: %s",
-               error->msg);
-        goto end;
-    }
 
     // App supports only one input/output tensor.
     infReq = larodCreateJobRequest(model,
@@ -871,34 +738,56 @@ int main(int argc, char** argv) {
         goto end;
     }
 
+    // The crops are taken from the high resolution frame with the same timestamp as the frame
+    // the detections were made on.
+    frameSync = createFrameSync(sdImageProvider,
+                                hdImageProvider,
+                                FRAME_SYNC_HISTORY,
+                                FRAME_SYNC_TOLERANCE_US);
+    if (!frameSync) {
+        syslog(LOG_ERR, "%s: Could not create frame synchronizer", __func__);
+        goto end;
+    }
+
     // This contains the box coordinates and class scores for each detected object.
-    boxes = (box*)malloc(sizeof(box) * numberOfDetections);
+    boxes = (box*)malloc(sizeof(box) * TOP_K);
+
+    // The anchors are read once, post-processing of each frame only uses the prior table.
+    postProcessor = createPostProcessor(anchorFile, numberOfDetections, numberOfClasses, TOP_K);
+    if (!postProcessor) {
+        syslog(LOG_ERR, "%s: Could not create post-processor", __func__);
+        goto end;
+    }
+
+    // Detection crops are encoded on worker threads so that they never delay the next frame.
+    jpegWriter = createJpegWriter(NUM_JPEG_WORKERS, NUM_JPEG_JOBS, quality);
+    if (!jpegWriter) {
+        syslog(LOG_ERR, "%s: Could not create jpeg writer", __func__);
+        goto end;
+    }
 
     while (true) {
         struct timeval startTs, endTs;
         unsigned int elapsedMs = 0;
 
-        // Get latest frame from image pipeline.
-        VdoBuffer* buf = getLastFrameBlocking(sdImageProvider);
-        if (!buf) {
+        // Get latest frame from image pipeline, and the high resolution frame taken at the
+        // same time.
+        VdoBuffer* buf    = NULL;
+        VdoBuffer* buf_hq = NULL;
+        if (!getSyncedFrames(frameSync, &buf, &buf_hq)) {
             syslog(LOG_ERR, "buf empty in provider");
             goto end;
         }
 
-        VdoBuffer* buf_hq = getLastFrameBlocking(hdImageProvider);
-        if (!buf_hq) {
-            syslog(LOG_ERR, "buf empty in provider high resolution");
-            goto end;
-        }
-
-        // Get data from latest frame.
+        // Get data from latest frame. The high resolution frame is never converted as a whole,
+        // only the crops of the detections are read from it.
         uint8_t* nv12Data    = (uint8_t*)vdo_buffer_get_data(buf);
-        uint8_t* nv12Data_hq = (uint8_t*)vdo_buffer_get_data(buf_hq);
+        uint8_t* nv12Data_hq = buf_hq ? (uint8_t*)vdo_buffer_get_data(buf_hq) : NULL;
 
         // Covert image data from NV12 format to interleaved uint8_t RGB format.
         gettimeofday(&startTs, NULL);
 
-        memcpy(ppInputAddr, nv12Data, yuyvBufferSize);
+        memcpy(ppInputBuffer->addr, nv12Data, yuyvBufferSize);
         if (!larodRunJob(conn, ppReq, &error)) {
             syslog(LOG_ERR,
                    "Unable to run job to preprocess model: %s (%d)",
@@ -907,15 +796,8 @@ int main(int argc, char** argv) {
             goto end;
         }
 
-        padImageWidth(ppOutputAddr, larodInputAddr, inputWidth, inputHeight, padding);
-
-        memcpy(ppInputAddrHD, nv12Data_hq, widthFrameHD * heightFrameHD * CHANNELS / 2);
-        if (!larodRunJob(conn, ppReqHD, &error)) {
-            syslog(LOG_ERR,
-                   "Unable to run job to preprocess model: %s (%d)",
-                   error->msg,
-                   error->code);
-            goto end;
+        if (!sharedInput) {
+            padImageWidth(ppOutputBuffer->addr, larodInput->addr, inputWidth, inputHeight, padding);
         }
 
         gettimeofday(&endTs, NULL);
@@ -924,19 +806,6 @@ int main(int argc, char** argv) {
                                    ((endTs.tv_usec - startTs.tv_usec) / 1000));
         syslog(LOG_INFO, "Converted image in %u ms", elapsedMs);
 
-        // Since larodOutputAddr points to the beginning of the fd we should
-        // rewind the file position before each job.
-        if (lseek(larodOutput1Fd, 0, SEEK_SET) == -1) {
-            syslog(LOG_ERR, "Unable to rewind output file position: %s", strerror(errno));
-            goto end;
-        }
-
-        if (lseek(larodOutput2Fd, 0, SEEK_SET) == -1) {
-            syslog(LOG_ERR, "Unable to rewind output file position: %s", strerror(errno));
-
-            goto end;
-        }
-
         gettimeofday(&startTs, NULL);
         if (!larodRunJob(conn, infReq, &error)) {
             syslog(LOG_ERR,
@@ -952,39 +821,37 @@ int main(int argc, char** argv) {
                                    ((endTs.tv_usec - startTs.tv_usec) / 1000));
         syslog(LOG_INFO, "Ran inference for %u ms", elapsedMs);
 
-        float* locations = (float*)larodOutput1Addr;
-        float* classes   = (float*)larodOutput2Addr;
+        float* locations = (float*)larodOutput1->addr;
+        float* classes   = (float*)larodOutput2->addr;
 
         // hyperparameters depend on the model used. For the model used in this example
         // the values come from the config file used to train the model.
         // https://github.com/tensorflow/models/blob/master/research/object_detection/samples/configs/ssd_mobilenet_v2_coco.config#L11
-        int confidenceThreshold = threshold / 100.0;
-        int iouThreshold        = 0.5;
-        int yScale              = 10;
-        int xScale              = 10;
-        int hScale              = 5;
-        int wScale              = 5;
+        float confidenceThreshold = threshold / 100.0f;
+        float iouThreshold        = 0.5f;
+        float yScale              = 10.0f;
+        float xScale              = 10.0f;
+        float hScale              = 5.0f;
+        float wScale              = 5.0f;
 
         gettimeofday(&startTs, NULL);
         // postprocessing the output of the network. This will fill the boxes array.
-        postProcessing(locations,
-                       classes,
-                       numberOfDetections,
-                       anchorFile,
-                       numberOfClasses,
-                       confidenceThreshold,
-                       iouThreshold,
-                       yScale,
-                       xScale,
-                       hScale,
-                       wScale,
-                       boxes);
+        int numberOfBoxes = postProcessing(postProcessor,
+                                           locations,
+                                           classes,
+                                           confidenceThreshold,
+                                           iouThreshold,
+                                           yScale,
+                                           xScale,
+                                           hScale,
+                                           wScale,
+                                           boxes);
         gettimeofday(&endTs, NULL);
 
         elapsedMs = (unsigned int)(((endTs.tv_sec - startTs.tv_sec) * 1000) +
                                    ((endTs.tv_usec - startTs.tv_usec) / 1000));
         syslog(LOG_INFO, "Postprocesing in %u ms", elapsedMs);
-        for (int i = 0; i < numberOfDetections; i++) {
+        for (int i = 0; i < numberOfBoxes; i++) {
             float top    = boxes[i].y_min;
             float left   = boxes[i].x_min;
             float bottom = boxes[i].y_max;
@@ -997,42 +864,39 @@ int main(int argc, char** argv) {
             unsigned int crop_w = (right - left) * croppedWidthHD;
             unsigned int crop_h = (bottom - top) * heightFrameHD;
 
-            if (boxes[i].score >= threshold / 100.0 && boxes[i].label != 0) {
-                syslog(LOG_INFO,
-                       "Object %d: Classes: %s - Scores: %f - Locations: [%f,%f,%f,%f]",
-                       i,
-                       labels[boxes[i].label - 1],
-                       boxes[i].score,
-                       top,
-                       left,
-                       bottom,
-                       right);
-
-                unsigned char* crop_buffer = crop_interleaved(ppOutputAddrHD,
-                                                              widthFrameHD,
-                                                              heightFrameHD,
-                                                              CHANNELS,
-                                                              crop_x,
-                                                              crop_y,
-                                                              crop_w,
-                                                              crop_h);
-
-                unsigned long jpeg_size    = 0;
-                unsigned char* jpeg_buffer = NULL;
-                struct jpeg_compress_struct jpeg_conf;
-                set_jpeg_configuration(crop_w, crop_h, CHANNELS, quality, &jpeg_conf);
-                buffer_to_jpeg(crop_buffer, &jpeg_conf, &jpeg_size, &jpeg_buffer);
-                char file_name[32];
-                snprintf(file_name, sizeof(char) * 32, "/tmp/detection_%i.jpg", i);
-                jpeg_to_file(file_name, jpeg_buffer, jpeg_size);
-                free(crop_buffer);
-                free(jpeg_buffer);
+            syslog(LOG_INFO,
+                   "Object %d: Classes: %s - Scores: %f - Locations: [%f,%f,%f,%f]",
+                   i,
+                   labels[boxes[i].label - 1],
+                   boxes[i].score,
+                   top,
+                   left,
+                   bottom,
+                   right);
+
+            // Without a matching high resolution frame the crop would not show the object
+            if (!nv12Data_hq) {
+                continue;
+            }
+
+            // The NV12 crop is copied here, the encoding is done by the jpeg writer
+            char file_name[32];
+            snprintf(file_name, sizeof(char) * 32, "/tmp/detection_%i.jpg", i);
+            if (!submitJpegJob(jpegWriter,
+                               nv12Data_hq,
+                               widthFrameHD,
+                               heightFrameHD,
+                               crop_x,
+                               crop_y,
+                               crop_w,
+                               crop_h,
+                               file_name)) {
+                syslog(LOG_WARNING, "Dropped crop of object %d", i);
             }
         }
 
-        // Release frame reference to provider.
-        returnFrame(sdImageProvider, buf);
-        returnFrame(hdImageProvider, buf_hq);
+        // Release frame references to the providers.
+        returnSyncedFrames(frameSync, buf, buf_hq);
     }
 
     syslog(LOG_INFO, "Stop streaming video from VDO");
@@ -1043,6 +907,10 @@ int main(int argc, char** argv) {
     ret = true;
 
 end:
+    // Stop the jpeg workers first since they may still be writing files
+    destroyJpegWriter(jpegWriter);
+    // Give back the frames kept for pairing before the providers are destroyed
+    destroyFrameSync(frameSync);
     if (sdImageProvider) {
         destroyImgProvider(sdImageProvider);
     }
@@ -1054,9 +922,7 @@ end:
     // larodDisconnect().
     larodDestroyMap(&ppMap);
     larodDestroyMap(&cropMap);
-    larodDestroyMap(&ppMapHD);
     larodDestroyModel(&ppModel);
-    larodDestroyModel(&ppModelHD);
     larodDestroyModel(&model);
     if (conn) {
         larodDisconnect(&conn, NULL);
@@ -1064,57 +930,9 @@ end:
     if (larodModelFd >= 0) {
         close(larodModelFd);
     }
-    if (larodInputAddr != MAP_FAILED) {
-        munmap(larodInputAddr, inputWidth * inputHeight * CHANNELS);
-    }
-    if (larodInputFd >= 0) {
-        close(larodInputFd);
-    }
-    if (ppInputAddr != MAP_FAILED) {
-        munmap(ppInputAddr, inputWidth * inputHeight * CHANNELS);
-    }
-    if (ppOutputAddr != MAP_FAILED) {
-        munmap(ppOutputAddr, inputWidth * inputHeight * CHANNELS);
-    }
-    if (ppInputFd >= 0) {
-        close(ppInputFd);
-    }
-    if (ppOutputFd >= 0) {
-        close(ppOutputFd);
-    }
-    if (ppInputAddrHD != MAP_FAILED) {
-        munmap(ppInputAddrHD, widthFrameHD * heightFrameHD * CHANNELS / 2);
-    }
-    if (ppInputFdHD >= 0) {
-        close(ppInputFdHD);
-    }
-    if (ppOutputAddrHD != MAP_FAILED) {
-        munmap(ppOutputAddrHD, widthFrameHD * heightFrameHD * CHANNELS);
-    }
-    if (ppOutputFdHD >= 0) {
-        close(ppOutputFdHD);
-    }
-    if (cropAddr != MAP_FAILED) {
-        munmap(cropAddr, widthFrameHD * heightFrameHD * CHANNELS);
-    }
-    if (larodOutput1Addr != MAP_FAILED) {
-        munmap(larodOutput1Addr, TENSOR1SIZE);
-    }
-
-    if (larodOutput2Addr != MAP_FAILED) {
-        munmap(larodOutput2Addr, TENSOR2SIZE);
-    }
-
-    if (larodOutput1Fd >= 0) {
-        close(larodOutput1Fd);
-    }
-
-    if (larodOutput2Fd >= 0) {
-        close(larodOutput2Fd);
-    }
+    destroyTensorBufferPool(bufferPool);
 
     larodDestroyJobRequest(&ppReq);
-    larodDestroyJobRequest(&ppReqHD);
     larodDestroyJobRequest(&infReq);
     larodDestroyTensors(conn, &inputTensors, numInputs, &error);
     larodDestroyTensors(conn, &outputTensors, numOutputs, &error);
@@ -1126,6 +944,7 @@ end:
     if (boxes) {
         free(boxes);
     }
+    destroyPostProcessor(postProcessor);
 
 earlyend:
     syslog(LOG_INFO, "Exit %s", argv[0]);
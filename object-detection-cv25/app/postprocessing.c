@@ -15,182 +15,398 @@
  */
 
 #include "postprocessing.h"
+#include "argmax.h"
 #include <math.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <syslog.h>
 
-// structure detection
-typedef struct {
-    float dy;
-    float dx;
-    float dh;
-    float dw;
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Constants for the exp approximation, see expInPlace
+#define EXP_HI        88.3762626647949f
+#define EXP_LO        -88.3762626647949f
+#define EXP_LOG2E     1.44269504088896341f
+#define EXP_LN2_HI    0.693359375f
+#define EXP_LN2_LO    -2.12194440e-4f
+#define EXP_POLY_0    1.9875691500E-4f
+#define EXP_POLY_1    1.3981999507E-3f
+#define EXP_POLY_2    8.3334519073E-3f
+#define EXP_POLY_3    4.1665795894E-2f
+#define EXP_POLY_4    1.6666665459E-1f
+#define EXP_POLY_5    5.0000001201E-1f
+
+// Anchor whose best class passed the score threshold
+struct candidate {
     float score;
     int label;
-    float anchor_ymin;
-    float anchor_xmin;
-    float anchor_ymax;
-    float anchor_xmax;
-} detection;
+    int index;
+};
 
-/*
- * This function loads the data structure reading the anchors from file, and the detections from
- * parameter. It expects detections in he format [dy,dx,dh,dw] and the anchors in the format
- * [xmin,ymin,xmax,ymax]
- *
- */
-static int loadDetectionStruct(const float* locations,
-                               float* classes,
-                               int num_of_detections,
-                               int num_of_classes,
-                               const char* anchor_file,
-                               detection* dets) {
-    // Open anchor file
-    FILE* fp;
+PostProcessor_t* createPostProcessor(const char* anchor_file,
+                                     int num_of_detections,
+                                     int num_of_classes,
+                                     int top_k) {
+    float* anchors                 = NULL;
+    FILE* fp                       = NULL;
+    PostProcessor_t* postProcessor = calloc(1, sizeof(PostProcessor_t));
+    if (postProcessor == NULL) {
+        syslog(LOG_ERR, "%s: Unable to allocate PostProcessor", __func__);
+        goto error;
+    }
+    postProcessor->numDetections = num_of_detections;
+    postProcessor->numClasses    = num_of_classes;
+    postProcessor->topK          = top_k;
+
+    size_t n                     = (size_t)num_of_detections;
+    size_t k                     = (size_t)top_k;
+    postProcessor->priorCenterY  = malloc(n * sizeof(float));
+    postProcessor->priorCenterX  = malloc(n * sizeof(float));
+    postProcessor->priorHeight   = malloc(n * sizeof(float));
+    postProcessor->priorWidth    = malloc(n * sizeof(float));
+    postProcessor->candidates    = malloc(n * sizeof(struct candidate));
+    postProcessor->topBoxes      = malloc(k * sizeof(box));
+    postProcessor->decodedHeight = malloc(k * sizeof(float));
+    postProcessor->decodedWidth  = malloc(k * sizeof(float));
+    postProcessor->bucketStart   = malloc(((size_t)num_of_classes + 1) * sizeof(int));
+    postProcessor->bucketOrder   = malloc(k * sizeof(int));
+    postProcessor->suppressed    = malloc(k * sizeof(bool));
+    anchors                      = malloc(n * 4 * sizeof(float));
+    if (!postProcessor->priorCenterY || !postProcessor->priorCenterX ||
+        !postProcessor->priorHeight || !postProcessor->priorWidth || !postProcessor->candidates ||
+        !postProcessor->topBoxes || !postProcessor->decodedHeight ||
+        !postProcessor->decodedWidth || !postProcessor->bucketStart ||
+        !postProcessor->bucketOrder || !postProcessor->suppressed || !anchors) {
+        syslog(LOG_ERR, "%s: Unable to allocate prior table", __func__);
+        goto error;
+    }
+
+    // Read all anchors with one call, they are stored as [xmin,ymin,xmax,ymax]
     fp = fopen(anchor_file, "rb");
     if (fp == NULL) {
-        printf("Error opening anchor file");
-        return 1;
-    }
-
-    // Load detections and anchors in struct array
-    for (int i = 0; i < num_of_detections; i++) {
-        dets[i].dy    = locations[i * 4];
-        dets[i].dx    = locations[i * 4 + 1];
-        dets[i].dh    = locations[i * 4 + 2];
-        dets[i].dw    = locations[i * 4 + 3];
-        dets[i].score = 0;
-        for (int j = 0; j < num_of_classes; j++) {
-            if (classes[i * num_of_classes + j] > dets[i].score) {
-                dets[i].score = classes[i * num_of_classes + j];
-                dets[i].label = j;
-            }
-        }
-        if (fread(&dets[i].anchor_xmin, sizeof(float), 1, fp) != 1) {
-            syslog(LOG_ERR, "Error when reading anchor file");
-            return 1;
-        }
-        if (fread(&dets[i].anchor_ymin, sizeof(float), 1, fp) != 1) {
-            syslog(LOG_ERR, "Error when reading anchor file");
-            return 1;
-        }
-        if (fread(&dets[i].anchor_xmax, sizeof(float), 1, fp) != 1) {
-            syslog(LOG_ERR, "Error when reading anchor file");
-            return 1;
-        }
-        if (fread(&dets[i].anchor_ymax, sizeof(float), 1, fp) != 1) {
-            syslog(LOG_ERR, "Error when reading anchor file");
-            return 1;
-        }
+        syslog(LOG_ERR, "%s: Error opening anchor file %s", __func__, anchor_file);
+        goto error;
+    }
+    if (fread(anchors, sizeof(float), n * 4, fp) != n * 4) {
+        syslog(LOG_ERR,
+               "%s: Anchor file %s does not hold %d anchors",
+               __func__,
+               anchor_file,
+               num_of_detections);
+        goto error;
     }
-
-    // Close anchor file
     fclose(fp);
-    return 0;
+    fp = NULL;
+
+    for (size_t i = 0; i < n; i++) {
+        float xmin = anchors[i * 4];
+        float ymin = anchors[i * 4 + 1];
+        float xmax = anchors[i * 4 + 2];
+        float ymax = anchors[i * 4 + 3];
+
+        postProcessor->priorCenterX[i] = (xmin + xmax) / 2.0f;
+        postProcessor->priorCenterY[i] = (ymin + ymax) / 2.0f;
+        postProcessor->priorWidth[i]   = xmax - xmin;
+        postProcessor->priorHeight[i]  = ymax - ymin;
+    }
+    free(anchors);
+
+    return postProcessor;
+
+error:
+    if (fp) {
+        fclose(fp);
+    }
+    free(anchors);
+    destroyPostProcessor(postProcessor);
+
+    return NULL;
 }
 
-// Apply anchors to detections to obtain boxes
-static void applyAnchors(detection* dets,
-                         int num_of_detections,
-                         box* boxes,
-                         float y_scale,
-                         float x_scale,
-                         float h_scale,
-                         float w_scale) {
-    float prior_center_y, prior_center_x, prior_height, prior_width;
-    float center_y, center_x, height, width;
-    for (int i = 0; i < num_of_detections; i++) {
-        prior_center_x = (dets[i].anchor_xmin + dets[i].anchor_xmax) / 2.0;
-        prior_center_y = (dets[i].anchor_ymin + dets[i].anchor_ymax) / 2.0;
-        prior_width    = dets[i].anchor_xmax - dets[i].anchor_xmin;
-        prior_height   = dets[i].anchor_ymax - dets[i].anchor_ymin;
-
-        center_x = dets[i].dx * prior_width / x_scale + prior_center_x;
-        center_y = dets[i].dy * prior_height / y_scale + prior_center_y;
-        width    = exp(dets[i].dw / w_scale) * prior_width;
-        height   = exp(dets[i].dh / h_scale) * prior_height;
-
-        boxes[i].x_min = center_x - width / 2.0;
-        boxes[i].y_min = center_y - height / 2.0;
-        boxes[i].x_max = center_x + width / 2.0;
-        boxes[i].y_max = center_y + height / 2.0;
-        boxes[i].score = dets[i].score;
-        boxes[i].label = dets[i].label;
+void destroyPostProcessor(PostProcessor_t* postProcessor) {
+    if (!postProcessor) {
+        return;
+    }
+    free(postProcessor->priorCenterY);
+    free(postProcessor->priorCenterX);
+    free(postProcessor->priorHeight);
+    free(postProcessor->priorWidth);
+    free(postProcessor->candidates);
+    free(postProcessor->topBoxes);
+    free(postProcessor->decodedHeight);
+    free(postProcessor->decodedWidth);
+    free(postProcessor->bucketStart);
+    free(postProcessor->bucketOrder);
+    free(postProcessor->suppressed);
+    free(postProcessor);
+}
 
-        // Limit boxes from 0 to 1
-        boxes[i].x_min = fmaxf(0, boxes[i].x_min);
-        boxes[i].y_min = fmaxf(0, boxes[i].y_min);
-        boxes[i].x_max = fminf(1, boxes[i].x_max);
-        boxes[i].y_max = fminf(1, boxes[i].y_max);
+/*
+ * Replace every value with its exponential. The vector versions split the input into n*ln(2) + r
+ * and use a polynomial for exp(r), which has a relative error of about 2e-7 in the range used for
+ * box sizes. Inputs are clamped to the range of a float.
+ */
+static void expInPlace(float* values, int count) {
+    int i = 0;
+#if defined(__ARM_NEON)
+    const float32x4_t hi    = vdupq_n_f32(EXP_HI);
+    const float32x4_t lo    = vdupq_n_f32(EXP_LO);
+    const float32x4_t log2e = vdupq_n_f32(EXP_LOG2E);
+    const float32x4_t half  = vdupq_n_f32(0.5f);
+    const float32x4_t one   = vdupq_n_f32(1.0f);
+    for (; i + 4 <= count; i += 4) {
+        float32x4_t x = vld1q_f32(values + i);
+        x             = vmaxq_f32(vminq_f32(x, hi), lo);
+
+        // n = floor(x * log2(e) + 0.5)
+        float32x4_t fx = vmlaq_f32(half, x, log2e);
+        float32x4_t tx = vcvtq_f32_s32(vcvtq_s32_f32(fx));
+        // Subtract 1 where the truncation rounded up
+        uint32x4_t mask = vandq_u32(vcgtq_f32(tx, fx), vreinterpretq_u32_f32(one));
+        fx              = vsubq_f32(tx, vreinterpretq_f32_u32(mask));
+
+        x = vmlsq_f32(x, fx, vdupq_n_f32(EXP_LN2_HI));
+        x = vmlsq_f32(x, fx, vdupq_n_f32(EXP_LN2_LO));
+
+        float32x4_t x2 = vmulq_f32(x, x);
+        float32x4_t y  = vdupq_n_f32(EXP_POLY_0);
+        y              = vmlaq_f32(vdupq_n_f32(EXP_POLY_1), y, x);
+        y              = vmlaq_f32(vdupq_n_f32(EXP_POLY_2), y, x);
+        y              = vmlaq_f32(vdupq_n_f32(EXP_POLY_3), y, x);
+        y              = vmlaq_f32(vdupq_n_f32(EXP_POLY_4), y, x);
+        y              = vmlaq_f32(vdupq_n_f32(EXP_POLY_5), y, x);
+        y              = vmlaq_f32(vaddq_f32(x, one), y, x2);
+
+        // Multiply by 2^n by building the exponent bits directly
+        int32x4_t n   = vaddq_s32(vcvtq_s32_f32(fx), vdupq_n_s32(127));
+        float32x4_t p = vreinterpretq_f32_s32(vshlq_n_s32(n, 23));
+        vst1q_f32(values + i, vmulq_f32(y, p));
+    }
+#elif defined(__SSE2__)
+    const __m128 hi    = _mm_set1_ps(EXP_HI);
+    const __m128 lo    = _mm_set1_ps(EXP_LO);
+    const __m128 log2e = _mm_set1_ps(EXP_LOG2E);
+    const __m128 half  = _mm_set1_ps(0.5f);
+    const __m128 one   = _mm_set1_ps(1.0f);
+    for (; i + 4 <= count; i += 4) {
+        __m128 x = _mm_loadu_ps(values + i);
+        x        = _mm_max_ps(_mm_min_ps(x, hi), lo);
+
+        // n = floor(x * log2(e) + 0.5)
+        __m128 fx = _mm_add_ps(_mm_mul_ps(x, log2e), half);
+        __m128 tx = _mm_cvtepi32_ps(_mm_cvttps_epi32(fx));
+        fx        = _mm_sub_ps(tx, _mm_and_ps(_mm_cmpgt_ps(tx, fx), one));
+
+        x = _mm_sub_ps(x, _mm_mul_ps(fx, _mm_set1_ps(EXP_LN2_HI)));
+        x = _mm_sub_ps(x, _mm_mul_ps(fx, _mm_set1_ps(EXP_LN2_LO)));
+
+        __m128 x2 = _mm_mul_ps(x, x);
+        __m128 y  = _mm_set1_ps(EXP_POLY_0);
+        y         = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(EXP_POLY_1));
+        y         = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(EXP_POLY_2));
+        y         = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(EXP_POLY_3));
+        y         = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(EXP_POLY_4));
+        y         = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(EXP_POLY_5));
+        y         = _mm_add_ps(_mm_mul_ps(y, x2), _mm_add_ps(x, one));
+
+        // Multiply by 2^n by building the exponent bits directly
+        __m128i n = _mm_add_epi32(_mm_cvttps_epi32(fx), _mm_set1_epi32(127));
+        __m128 p  = _mm_castsi128_ps(_mm_slli_epi32(n, 23));
+        _mm_storeu_ps(values + i, _mm_mul_ps(y, p));
+    }
+#endif
+    for (; i < count; i++) {
+        values[i] = expf(values[i]);
     }
 }
 
-// Suppress low score boxes
-static void suppressLowScoreBoxes(box* boxes, int num_of_detections, float score_threshold) {
-    for (int i = 0; i < num_of_detections; i++) {
-        if (boxes[i].score < score_threshold) {
-            boxes[i].score = 0;
+/*
+ * Find the best class of every anchor and compact the anchors whose score passes the threshold
+ * into the candidate array. Anchors where the background class wins are never reported, so they
+ * are dropped here. Returns the number of candidates.
+ */
+static int collectCandidates(PostProcessor_t* postProcessor,
+                             const float* classes,
+                             float score_threshold) {
+    struct candidate* candidates = postProcessor->candidates;
+    int numCandidates            = 0;
+    int numClasses               = postProcessor->numClasses;
+    for (int i = 0; i < postProcessor->numDetections; i++) {
+        const float* scores = &classes[i * numClasses];
+        int label           = (int)argmax_f32(scores, numClasses);
+        float score         = fmaxf(scores[label], 0);
+        if (label != 0 && score >= score_threshold) {
+            candidates[numCandidates].score = score;
+            candidates[numCandidates].label = label;
+            candidates[numCandidates].index = i;
+            numCandidates++;
         }
     }
+    return numCandidates;
+}
+
+// Order of candidates, higher score first and lower anchor index first on equal scores
+static bool isBetter(const struct candidate* a, const struct candidate* b) {
+    return a->score > b->score || (!(a->score < b->score) && a->index < b->index);
 }
 
-// Sort boxes by score efficiently
-static void sortBoxesEfficient(box* boxes, int num_of_detections) {
-    box temp;
-    int i       = 0;
-    int j       = num_of_detections - 1;
-    float pivot = boxes[num_of_detections / 2].score;
-    while (i <= j) {
-        while (boxes[i].score > pivot) i++;
-        while (boxes[j].score < pivot) j--;
-        if (i <= j) {
-            temp     = boxes[i];
-            boxes[i] = boxes[j];
-            boxes[j] = temp;
-            i++;
-            j--;
+// Restore a heap where the worst candidate is at the root
+static void siftDown(struct candidate* heap, int size, int i) {
+    struct candidate item = heap[i];
+    while (true) {
+        int child = 2 * i + 1;
+        if (child >= size) {
+            break;
+        }
+        if (child + 1 < size && isBetter(&heap[child], &heap[child + 1])) {
+            child++;
+        }
+        if (!isBetter(&item, &heap[child])) {
+            break;
         }
+        heap[i] = heap[child];
+        i       = child;
+    }
+    heap[i] = item;
+}
+
+/*
+ * Move the best top_k candidates to the front of the array, sorted with the highest score first.
+ * A heap holding the best candidates so far is kept in the front of the array, so this runs in
+ * O(N log K). Returns the number of selected candidates.
+ */
+static int selectTopCandidates(struct candidate* candidates, int numCandidates, int top_k) {
+    int size = numCandidates < top_k ? numCandidates : top_k;
+    for (int i = size / 2 - 1; i >= 0; i--) {
+        siftDown(candidates, size, i);
+    }
+    for (int i = size; i < numCandidates; i++) {
+        if (isBetter(&candidates[i], &candidates[0])) {
+            candidates[0] = candidates[i];
+            siftDown(candidates, size, 0);
+        }
+    }
+
+    // Move the worst remaining candidate to the back until the heap is empty
+    for (int end = size - 1; end > 0; end--) {
+        struct candidate worst = candidates[0];
+        candidates[0]          = candidates[end];
+        candidates[end]        = worst;
+        siftDown(candidates, end, 0);
+    }
+    return size;
+}
+
+// Apply anchors to the selected candidates to obtain boxes
+static void decodeCandidates(PostProcessor_t* postProcessor,
+                             int numCandidates,
+                             const float* locations,
+                             float y_scale,
+                             float x_scale,
+                             float h_scale,
+                             float w_scale) {
+    const struct candidate* candidates = postProcessor->candidates;
+    box* boxes                         = postProcessor->topBoxes;
+    float* height                      = postProcessor->decodedHeight;
+    float* width                       = postProcessor->decodedWidth;
+
+    // Gather the size deltas so that all exponentials can be computed in one vectorized pass
+    for (int c = 0; c < numCandidates; c++) {
+        int i     = candidates[c].index;
+        height[c] = locations[i * 4 + 2] / h_scale;
+        width[c]  = locations[i * 4 + 3] / w_scale;
+    }
+    expInPlace(height, numCandidates);
+    expInPlace(width, numCandidates);
+
+    for (int c = 0; c < numCandidates; c++) {
+        int i = candidates[c].index;
+
+        float center_y = locations[i * 4] * postProcessor->priorHeight[i] / y_scale +
+                         postProcessor->priorCenterY[i];
+        float center_x = locations[i * 4 + 1] * postProcessor->priorWidth[i] / x_scale +
+                         postProcessor->priorCenterX[i];
+        float h = height[c] * postProcessor->priorHeight[i];
+        float w = width[c] * postProcessor->priorWidth[i];
+
+        // Limit boxes from 0 to 1
+        boxes[c].x_min = fmaxf(0, center_x - w / 2.0f);
+        boxes[c].y_min = fmaxf(0, center_y - h / 2.0f);
+        boxes[c].x_max = fminf(1, center_x + w / 2.0f);
+        boxes[c].y_max = fminf(1, center_y + h / 2.0f);
+        boxes[c].score = candidates[c].score;
+        boxes[c].label = candidates[c].label;
     }
-    if (j > 0)
-        sortBoxesEfficient(boxes, j + 1);
-    if (i < num_of_detections - 1)
-        sortBoxesEfficient(boxes + i, num_of_detections - i);
 }
 
 // Calculate IOU
-static float calculateIOU(box box1, box box2) {
-    float intersection_xmin = fmaxf(box1.x_min, box2.x_min);
-    float intersection_ymin = fmaxf(box1.y_min, box2.y_min);
-    float intersection_xmax = fminf(box1.x_max, box2.x_max);
-    float intersection_ymax = fminf(box1.y_max, box2.y_max);
+static float calculateIOU(const box* box1, const box* box2) {
+    float intersection_xmin = fmaxf(box1->x_min, box2->x_min);
+    float intersection_ymin = fmaxf(box1->y_min, box2->y_min);
+    float intersection_xmax = fminf(box1->x_max, box2->x_max);
+    float intersection_ymax = fminf(box1->y_max, box2->y_max);
     float intersection_area = fmaxf(intersection_xmax - intersection_xmin, 0) *
                               fmaxf(intersection_ymax - intersection_ymin, 0);
-    float union_area = (box1.x_max - box1.x_min) * (box1.y_max - box1.y_min) +
-                       (box2.x_max - box2.x_min) * (box2.y_max - box2.y_min) - intersection_area;
+    float union_area = (box1->x_max - box1->x_min) * (box1->y_max - box1->y_min) +
+                       (box2->x_max - box2->x_min) * (box2->y_max - box2->y_min) -
+                       intersection_area;
     return intersection_area / union_area;
 }
 
-// Suppress overlapping boxes (non-maxima-suppression) return sorted boxes by score, without
-// overlapping
-static void suppressOverlappingBoxes(box* boxes, int num_of_detections, float iou_threshold) {
-    sortBoxesEfficient(boxes, num_of_detections);
-    float iou;
-    for (int i = 0; i < num_of_detections; i++) {
-        for (int j = i + 1; j < num_of_detections; j++) {
-            iou = calculateIOU(boxes[i], boxes[j]);
-            if (iou > iou_threshold && boxes[i].label == boxes[j].label) {
-                boxes[j].score = 0;
+/*
+ * Suppress overlapping boxes (non-maxima-suppression). Boxes only suppress boxes of the same
+ * class, so the sorted boxes are first split into one bucket per class with a counting sort that
+ * keeps the score order, and the IoU is only calculated within each bucket.
+ */
+static void suppressOverlappingBoxes(PostProcessor_t* postProcessor,
+                                     int numBoxes,
+                                     float iou_threshold) {
+    const box* boxes = postProcessor->topBoxes;
+    int* bucketStart = postProcessor->bucketStart;
+    int* bucketOrder = postProcessor->bucketOrder;
+    bool* suppressed = postProcessor->suppressed;
+    int numClasses   = postProcessor->numClasses;
+
+    memset(bucketStart, 0, ((size_t)numClasses + 1) * sizeof(int));
+    for (int c = 0; c < numBoxes; c++) {
+        bucketStart[boxes[c].label + 1]++;
+        suppressed[c] = false;
+    }
+    for (int label = 0; label < numClasses; label++) {
+        bucketStart[label + 1] += bucketStart[label];
+    }
+    // Fill the buckets from the back so that bucketStart ends up at the start of each bucket
+    for (int c = numBoxes - 1; c >= 0; c--) {
+        bucketOrder[--bucketStart[boxes[c].label + 1]] = c;
+    }
+
+    for (int label = 0; label < numClasses; label++) {
+        int first = bucketStart[label + 1];
+        int last  = label + 1 < numClasses ? bucketStart[label + 2] : numBoxes;
+        for (int i = first; i < last; i++) {
+            if (suppressed[bucketOrder[i]]) {
+                continue;
+            }
+            const box* kept = &boxes[bucketOrder[i]];
+            for (int j = i + 1; j < last; j++) {
+                if (!suppressed[bucketOrder[j]] &&
+                    calculateIOU(kept, &boxes[bucketOrder[j]]) > iou_threshold) {
+                    suppressed[bucketOrder[j]] = true;
+                }
             }
         }
     }
 }
 
-int postProcessing(float* locations,
-                   float* classes,
-                   int num_of_detections,
-                   const char* anchor_file,
-                   int num_of_classes,
+int postProcessing(PostProcessor_t* postProcessor,
+                   const float* locations,
+                   const float* classes,
                    float score_threshold,
                    float nms_threshold,
                    float y_scale,
@@ -198,24 +414,17 @@ int postProcessing(float* locations,
                    float h_scale,
                    float w_scale,
                    box* boxes) {
-    // Load detections and anchors in struct array
-    detection* dets = (detection*)malloc(num_of_detections * sizeof(detection));
-    if (loadDetectionStruct(locations,
-                            classes,
-                            num_of_detections,
-                            num_of_classes,
-                            anchor_file,
-                            dets) != 0) {
-        printf("Error loading detection struct");
-        free(dets);
-        return 1;
-    }
-
-    // Convert detections to boxes
-    applyAnchors(dets, num_of_detections, boxes, y_scale, x_scale, h_scale, w_scale);
-    free(dets);
-    suppressLowScoreBoxes(boxes, num_of_detections, score_threshold);
-    suppressOverlappingBoxes(boxes, num_of_detections, nms_threshold);
-
-    return 0;
+    int numCandidates = collectCandidates(postProcessor, classes, score_threshold);
+    numCandidates =
+        selectTopCandidates(postProcessor->candidates, numCandidates, postProcessor->topK);
+    decodeCandidates(postProcessor, numCandidates, locations, y_scale, x_scale, h_scale, w_scale);
+    suppressOverlappingBoxes(postProcessor, numCandidates, nms_threshold);
+
+    int numBoxes = 0;
+    for (int c = 0; c < numCandidates; c++) {
+        if (!postProcessor->suppressed[c]) {
+            boxes[numBoxes++] = postProcessor->topBoxes[c];
+        }
+    }
+    return numBoxes;
 }
@@ -14,6 +14,9 @@
  * limitations under the License.
  */
 
+#pragma once
+
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -28,29 +31,81 @@ typedef struct {
     int label;
 } box;
 
+/**
+ * @brief State that is kept between frames by the post-processing.
+ *
+ * The anchors are read once and stored as a table of prior boxes with center
+ * and size, together with the scratch buffers used for each frame.
+ */
+typedef struct PostProcessor {
+    int numDetections;
+    int numClasses;
+    int topK;
+
+    /// Prior boxes, one entry per anchor
+    float* priorCenterY;
+    float* priorCenterX;
+    float* priorHeight;
+    float* priorWidth;
+
+    /// Anchors whose best class passed the score threshold in the current frame
+    struct candidate* candidates;
+    /// Decoded boxes of the topK best candidates, highest score first
+    box* topBoxes;
+    float* decodedHeight;
+    float* decodedWidth;
+
+    // Scratch space for the per-class non-maximum suppression
+    int* bucketStart;
+    int* bucketOrder;
+    bool* suppressed;
+} PostProcessor_t;
+
+/**
+ * @brief Read the anchors from file and allocate the post-processing state.
+ *
+ * @param anchor_file path to file containing anchors in the format [xmin, ymin, xmax, ymax]
+ * @param num_of_detections number of detections, which is the same as the number of anchors
+ * @param num_of_classes number of classes
+ * @param top_k maximum number of boxes that are decoded and passed to non-maximum suppression
+ * @return Pointer to new PostProcessor, or NULL if failed.
+ */
+PostProcessor_t* createPostProcessor(const char* anchor_file,
+                                     int num_of_detections,
+                                     int num_of_classes,
+                                     int top_k);
+
+/**
+ * @brief Free the post-processing state.
+ *
+ * @param postProcessor Pointer to PostProcessor to be destroyed.
+ */
+void destroyPostProcessor(PostProcessor_t* postProcessor);
+
 /**
  * @brief convert output from model into detection boxes
  *
+ * The anchors whose best class score reaches score_threshold are compacted, the top_k best of
+ * them are decoded into boxes and non-maximum suppression is run separately for each class.
+ * Anchors where the background class (label 0) has the best score are never returned.
+ *
+ * @param postProcessor state from createPostProcessor
  * @param locations output from the model of size num_of_detections*4 containing the location of the
  * boxes in the format [dy, dx, dh, dw]
  * @param classes output from the model of size num_of_detections*num_of_classes containing the
  * confidence for each class
- * @param num_of_detections number of detections
- * @param anchors_file path to file containing anchors
- * @param num_of_classes number of classes
  * @param score_threshold minimum threshold for a box to be considered a detection
  * @param nms_threshold threshold for the iou non-maximum suppression
  * @param y_scale scale factor for the y coordinate
  * @param x_scale scale factor for the x coordinate
  * @param h_scale scale factor for the height
  * @param w_scale scale factor for the width
- * @param boxes output array of boxes
+ * @param boxes output array with room for top_k boxes
+ * @return Number of boxes written to boxes, sorted with the highest score first.
  */
-int postProcessing(float* locations,
-                   float* classes,
-                   int num_of_detections,
-                   const char* anchor_file,
-                   int num_of_classes,
+int postProcessing(PostProcessor_t* postProcessor,
+                   const float* locations,
+                   const float* classes,
                    float score_threshold,
                    float nms_threshold,
                    float y_scale,
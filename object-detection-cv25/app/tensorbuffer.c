@@ -0,0 +1,129 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include "tensorbuffer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <syslog.h>
+#include <unistd.h>
+
+/**
+ * @brief Create a sealed memfd of the given size and map it.
+ *
+ * @param name Name of the memfd.
+ * @param capacity Size of the memfd.
+ * @param flags Extra flags for memfd_create.
+ * @param buffer Buffer to fill in.
+ * @return False if any errors occur, otherwise true.
+ */
+static bool createMemfd(const char* name,
+                        size_t capacity,
+                        unsigned int flags,
+                        TensorBuffer_t* buffer) {
+    int fd = memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING | flags);
+    if (fd < 0) {
+        return false;
+    }
+    if (ftruncate(fd, (off_t)capacity) < 0) {
+        close(fd);
+        return false;
+    }
+    // The size never changes after this
+    if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0) {
+        syslog(LOG_WARNING, "%s: Unable to seal %s: %s", __func__, name, strerror(errno));
+    }
+    void* addr = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+
+    buffer->fd        = fd;
+    buffer->addr      = addr;
+    buffer->capacity  = capacity;
+    buffer->hugePages = (flags & MFD_HUGETLB) != 0;
+    return true;
+}
+
+TensorBufferPool_t* createTensorBufferPool(void) {
+    TensorBufferPool_t* pool = calloc(1, sizeof(TensorBufferPool_t));
+    if (!pool) {
+        syslog(LOG_ERR, "%s: Unable to allocate TensorBufferPool: %s", __func__, strerror(errno));
+    }
+    return pool;
+}
+
+void destroyTensorBufferPool(TensorBufferPool_t* pool) {
+    if (!pool) {
+        return;
+    }
+    for (unsigned int i = 0; i < pool->numBuffers; i++) {
+        munmap(pool->buffers[i].addr, pool->buffers[i].capacity);
+        close(pool->buffers[i].fd);
+    }
+    free(pool);
+}
+
+TensorBuffer_t* acquireTensorBuffer(TensorBufferPool_t* pool, const char* name, size_t size) {
+    if (pool->numBuffers == TENSOR_BUFFER_POOL_SIZE) {
+        syslog(LOG_ERR,
+               "%s: Tensor buffer pool is full (%d buffers)",
+               __func__,
+               TENSOR_BUFFER_POOL_SIZE);
+        return NULL;
+    }
+    TensorBuffer_t* buffer = &pool->buffers[pool->numBuffers];
+
+    // Large buffers are backed by huge pages if any are reserved, which saves TLB misses when
+    // the whole buffer is read. Fall back to normal pages otherwise.
+    size_t hugeCapacity = (size + TENSOR_BUFFER_HUGE_PAGE_SIZE - 1) / TENSOR_BUFFER_HUGE_PAGE_SIZE *
+                          TENSOR_BUFFER_HUGE_PAGE_SIZE;
+    if (size < TENSOR_BUFFER_HUGE_PAGE_SIZE ||
+        !createMemfd(name, hugeCapacity, MFD_HUGETLB, buffer)) {
+        if (!createMemfd(name, size, 0, buffer)) {
+            syslog(LOG_ERR,
+                   "%s: Unable to create tensor buffer %s of %zu bytes: %s",
+                   __func__,
+                   name,
+                   size,
+                   strerror(errno));
+            return NULL;
+        }
+    }
+    buffer->size = size;
+    pool->numBuffers++;
+    pool->allocatedBytes += buffer->capacity;
+
+    syslog(LOG_INFO,
+           "Allocated tensor buffer %s of %zu bytes%s, %zu bytes in total",
+           name,
+           buffer->capacity,
+           buffer->hugePages ? " in huge pages" : "",
+           pool->allocatedBytes);
+    return buffer;
+}
+
+bool setTensorBuffer(larodTensor* tensor, const TensorBuffer_t* buffer, larodError** error) {
+    return larodSetTensorFd(tensor, buffer->fd, error) &&
+           larodSetTensorFdSize(tensor, buffer->capacity, error) &&
+           larodSetTensorFdOffset(tensor, 0, error) &&
+           larodSetTensorFdProps(tensor, LAROD_FD_PROP_MAP, error);
+}
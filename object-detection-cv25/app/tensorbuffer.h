@@ -0,0 +1,99 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This header file handles the memory that backs the larod tensors.
+ *
+ * It only depends on larod, so it can be used by any application that sets
+ * the fds of its tensors itself.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "larod.h"
+
+#define TENSOR_BUFFER_POOL_SIZE (16)
+/// Buffers of at least this size are backed by huge pages when the system has them
+#define TENSOR_BUFFER_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/**
+ * @brief Memory for one tensor, an anonymous memfd mapped into this process.
+ *
+ * The size of the memfd is sealed, so larod can map it without having to
+ * handle it being resized.
+ */
+typedef struct TensorBuffer {
+    int fd;
+    void* addr;
+    /// Size of the memfd and the mapping.
+    size_t capacity;
+    /// Size requested by the user.
+    size_t size;
+    bool hugePages;
+} TensorBuffer_t;
+
+/**
+ * @brief A pool that owns the tensor buffers of an application.
+ *
+ * The tensors keep their buffers for the whole run, so the buffers stay mapped
+ * until the pool is destroyed.
+ */
+typedef struct TensorBufferPool {
+    TensorBuffer_t buffers[TENSOR_BUFFER_POOL_SIZE];
+    unsigned int numBuffers;
+    /// Total size of all buffers in the pool.
+    size_t allocatedBytes;
+} TensorBufferPool_t;
+
+/**
+ * @brief Create an empty TensorBufferPool.
+ *
+ * @return Pointer to new TensorBufferPool, or NULL if failed.
+ */
+TensorBufferPool_t* createTensorBufferPool(void);
+
+/**
+ * @brief Unmap and close all buffers and free the pool.
+ *
+ * @param pool Pointer to TensorBufferPool to be destroyed.
+ */
+void destroyTensorBufferPool(TensorBufferPool_t* pool);
+
+/**
+ * @brief Create a new buffer of at least size bytes in the pool.
+ *
+ * @param pool TensorBufferPool from createTensorBufferPool.
+ * @param name Name of the memfd, shown in /proc/<pid>/fd.
+ * @param size Number of bytes needed.
+ * @return Pointer to the buffer, or NULL if failed.
+ */
+TensorBuffer_t* acquireTensorBuffer(TensorBufferPool_t* pool, const char* name, size_t size);
+
+/**
+ * @brief Let a tensor use a buffer.
+ *
+ * The tensor is told to map the buffer from offset 0, so the file position of
+ * the fd is never used and does not have to be rewound between jobs.
+ *
+ * @param tensor Tensor to set the fd of.
+ * @param buffer Buffer from acquireTensorBuffer.
+ * @param error An uninitialized handle to an error. Must be released with larodClearError.
+ * @return False if any errors occur, otherwise true.
+ */
+bool setTensorBuffer(larodTensor* tensor, const TensorBuffer_t* buffer, larodError** error);
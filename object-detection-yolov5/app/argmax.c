@@ -0,0 +1,215 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This file provides vectorized argmax kernels for class scores.
+ *
+ * Both kernels run in two passes. The first pass finds the largest value
+ * with vector max instructions, the second pass finds the first position of
+ * that value with vector compares. The values are few enough to stay in the
+ * cache between the passes.
+ */
+
+#include "argmax.h"
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON)
+
+static uint8_t reduce_max_u8(uint8x16_t v) {
+#if defined(__aarch64__)
+    return vmaxvq_u8(v);
+#else
+    uint8x8_t m = vpmax_u8(vget_low_u8(v), vget_high_u8(v));
+    m           = vpmax_u8(m, m);
+    m           = vpmax_u8(m, m);
+    m           = vpmax_u8(m, m);
+    return vget_lane_u8(m, 0);
+#endif
+}
+
+static float reduce_max_f32(float32x4_t v) {
+#if defined(__aarch64__)
+    return vmaxvq_f32(v);
+#else
+    float32x2_t m = vpmax_f32(vget_low_f32(v), vget_high_f32(v));
+    m             = vpmax_f32(m, m);
+    return vget_lane_f32(m, 0);
+#endif
+}
+
+#endif
+
+size_t argmax_u8(const uint8_t* values, size_t count) {
+    uint8_t max = 0;
+    size_t i    = 0;
+
+    // First pass, find the largest value
+#if defined(__ARM_NEON)
+    if (count >= 16) {
+        uint8x16_t vmax = vld1q_u8(values);
+        for (i = 16; i + 16 <= count; i += 16) {
+            vmax = vmaxq_u8(vmax, vld1q_u8(values + i));
+        }
+        max = reduce_max_u8(vmax);
+    }
+#elif defined(__AVX2__)
+    if (count >= 32) {
+        __m256i vmax = _mm256_loadu_si256((const __m256i*)values);
+        for (i = 32; i + 32 <= count; i += 32) {
+            vmax = _mm256_max_epu8(vmax, _mm256_loadu_si256((const __m256i*)(values + i)));
+        }
+        __m128i m = _mm_max_epu8(_mm256_castsi256_si128(vmax), _mm256_extracti128_si256(vmax, 1));
+        m         = _mm_max_epu8(m, _mm_srli_si128(m, 8));
+        m         = _mm_max_epu8(m, _mm_srli_si128(m, 4));
+        m         = _mm_max_epu8(m, _mm_srli_si128(m, 2));
+        m         = _mm_max_epu8(m, _mm_srli_si128(m, 1));
+        max       = (uint8_t)_mm_cvtsi128_si32(m);
+    }
+#elif defined(__SSE2__)
+    if (count >= 16) {
+        __m128i m = _mm_loadu_si128((const __m128i*)values);
+        for (i = 16; i + 16 <= count; i += 16) {
+            m = _mm_max_epu8(m, _mm_loadu_si128((const __m128i*)(values + i)));
+        }
+        m   = _mm_max_epu8(m, _mm_srli_si128(m, 8));
+        m   = _mm_max_epu8(m, _mm_srli_si128(m, 4));
+        m   = _mm_max_epu8(m, _mm_srli_si128(m, 2));
+        m   = _mm_max_epu8(m, _mm_srli_si128(m, 1));
+        max = (uint8_t)_mm_cvtsi128_si32(m);
+    }
+#endif
+    for (; i < count; i++) {
+        if (values[i] > max) {
+            max = values[i];
+        }
+    }
+
+    // Second pass, find the first position of the largest value
+    i = 0;
+#if defined(__ARM_NEON)
+    uint8x16_t vtarget = vdupq_n_u8(max);
+    for (; i + 16 <= count; i += 16) {
+        if (reduce_max_u8(vceqq_u8(vld1q_u8(values + i), vtarget))) {
+            break;
+        }
+    }
+#elif defined(__AVX2__)
+    __m256i vtarget = _mm256_set1_epi8((char)max);
+    for (; i + 32 <= count; i += 32) {
+        __m256i v     = _mm256_loadu_si256((const __m256i*)(values + i));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, vtarget));
+        if (mask) {
+            return i + (size_t)__builtin_ctz(mask);
+        }
+    }
+#elif defined(__SSE2__)
+    __m128i vtarget = _mm_set1_epi8((char)max);
+    for (; i + 16 <= count; i += 16) {
+        __m128i v     = _mm_loadu_si128((const __m128i*)(values + i));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, vtarget));
+        if (mask) {
+            return i + (size_t)__builtin_ctz(mask);
+        }
+    }
+#endif
+    while (values[i] != max) {
+        i++;
+    }
+    return i;
+}
+
+size_t argmax_f32(const float* values, size_t count) {
+    float max = values[0];
+    size_t i  = 1;
+
+    // First pass, find the largest value
+#if defined(__ARM_NEON)
+    if (count >= 4) {
+        float32x4_t vmax = vld1q_f32(values);
+        for (i = 4; i + 4 <= count; i += 4) {
+            vmax = vmaxq_f32(vmax, vld1q_f32(values + i));
+        }
+        max = reduce_max_f32(vmax);
+    }
+#elif defined(__AVX2__)
+    if (count >= 8) {
+        __m256 vmax = _mm256_loadu_ps(values);
+        for (i = 8; i + 8 <= count; i += 8) {
+            vmax = _mm256_max_ps(vmax, _mm256_loadu_ps(values + i));
+        }
+        __m128 m = _mm_max_ps(_mm256_castps256_ps128(vmax), _mm256_extractf128_ps(vmax, 1));
+        m        = _mm_max_ps(m, _mm_movehl_ps(m, m));
+        m        = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+        max      = _mm_cvtss_f32(m);
+    }
+#elif defined(__SSE2__)
+    if (count >= 4) {
+        __m128 m = _mm_loadu_ps(values);
+        for (i = 4; i + 4 <= count; i += 4) {
+            m = _mm_max_ps(m, _mm_loadu_ps(values + i));
+        }
+        m   = _mm_max_ps(m, _mm_movehl_ps(m, m));
+        m   = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+        max = _mm_cvtss_f32(m);
+    }
+#endif
+    for (; i < count; i++) {
+        if (values[i] > max) {
+            max = values[i];
+        }
+    }
+
+    // Second pass, find the first position of the largest value
+    i = 0;
+#if defined(__ARM_NEON)
+    float32x4_t vtarget = vdupq_n_f32(max);
+    for (; i + 4 <= count; i += 4) {
+        uint32x4_t eq = vceqq_f32(vld1q_f32(values + i), vtarget);
+        uint32x2_t m  = vpmax_u32(vget_low_u32(eq), vget_high_u32(eq));
+        m             = vpmax_u32(m, m);
+        if (vget_lane_u32(m, 0)) {
+            break;
+        }
+    }
+#elif defined(__AVX2__)
+    __m256 vtarget = _mm256_set1_ps(max);
+    for (; i + 8 <= count; i += 8) {
+        __m256 v = _mm256_loadu_ps(values + i);
+        int mask = _mm256_movemask_ps(_mm256_cmp_ps(v, vtarget, _CMP_EQ_OQ));
+        if (mask) {
+            return i + (size_t)__builtin_ctz((unsigned int)mask);
+        }
+    }
+#elif defined(__SSE2__)
+    __m128 vtarget = _mm_set1_ps(max);
+    for (; i + 4 <= count; i += 4) {
+        int mask = _mm_movemask_ps(_mm_cmpeq_ps(_mm_loadu_ps(values + i), vtarget));
+        if (mask) {
+            return i + (size_t)__builtin_ctz((unsigned int)mask);
+        }
+    }
+#endif
+    // Exact comparison is intended, max is one of the values
+    while (values[i] < max || values[i] > max) {
+        i++;
+    }
+    return i;
+}
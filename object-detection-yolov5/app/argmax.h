@@ -0,0 +1,50 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This header file provides vectorized argmax kernels for class scores.
+ *
+ * NEON is used on the device, SSE2 or AVX2 when building for x86 and a
+ * scalar loop otherwise. All versions return the same index.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Find the index of the largest raw uint8 value.
+ *
+ * Since dequantization is monotonic this is also the index of the largest
+ * dequantized value, so only the winner has to be dequantized.
+ *
+ * @param values Array of raw values
+ * @param count  Number of values, must be larger than 0
+ *
+ * @return Index of the first occurrence of the largest value
+ */
+size_t argmax_u8(const uint8_t* values, size_t count);
+
+/**
+ * @brief Find the index of the largest float value.
+ *
+ * @param values Array of values, must not contain NaN
+ * @param count  Number of values, must be larger than 0
+ *
+ * @return Index of the first occurrence of the largest value
+ */
+size_t argmax_f32(const float* values, size_t count);
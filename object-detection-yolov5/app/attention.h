@@ -0,0 +1,116 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This header file decides which areas of a frame the detector analyzes. Most frames
+ * are only analyzed in crops around the objects that were detected in the previous
+ * frame, and every few frames the whole frame is analyzed to find new objects. A crop
+ * has at least the model resolution in stream pixels, so small objects get more
+ * pixels than when the whole frame is scaled down to the model input.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "tiling.h"
+
+/// Largest number of crops analyzed in one frame
+#define ATTENTION_MAX_CROPS (8)
+
+/// Largest number of detections that crops are planned around
+#define ATTENTION_MAX_DETECTIONS (64)
+
+/// The stream is this many times the model resolution so that crops are not upscaled
+#define ATTENTION_STREAM_SCALE (2)
+
+typedef struct attention_params {
+    // Every this many frames the whole frame is analyzed, 1 analyzes every frame in full
+    unsigned int full_frame_interval;
+    // Share of the size of a detection that its crop is padded with on each side
+    float padding;
+    // Crops closest to each other are merged until there are at most this many
+    size_t max_crops;
+} attention_params_t;
+
+/**
+ * @brief A crop is planned as a tile, so it is analyzed like the tiles of a frame.
+ */
+typedef tile_t attention_crop_t;
+
+typedef struct attention {
+    attention_params_t params;
+    unsigned int stream_width;
+    unsigned int stream_height;
+    unsigned int model_width;
+    unsigned int model_height;
+    // Frames analyzed in crops since the whole frame was analyzed
+    unsigned int frames_since_full;
+    // Normalized corners x1, y1, x2, y2 of the detections in the last analyzed frame
+    float detections[ATTENTION_MAX_DETECTIONS][4];
+    size_t num_detections;
+} attention_t;
+
+/**
+ * @brief Set up the attention of one stream.
+ *
+ * @param attention     The attention to set up
+ * @param params        How often the whole frame is analyzed and how crops are made
+ * @param stream_width  Width of the frame
+ * @param stream_height Height of the frame
+ * @param model_width   Width of the model input, the smallest crop width
+ * @param model_height  Height of the model input, the smallest crop height
+ *
+ * @return False if the parameters are out of range
+ */
+bool attention_init(attention_t* attention,
+                    const attention_params_t* params,
+                    unsigned int stream_width,
+                    unsigned int stream_height,
+                    unsigned int model_width,
+                    unsigned int model_height);
+
+/**
+ * @brief Get the crops to analyze in the next frame.
+ *
+ * The detections of the last frame are padded and grown to the aspect ratio of the
+ * model input. Crops that overlap are merged, and then the crops closest to each other
+ * until there are at most max_crops. The positions and sizes are even so they can be
+ * used as crops of NV12 frames.
+ *
+ * @param attention  The attention of the stream
+ * @param crops      Array with room for ATTENTION_MAX_CROPS crops
+ * @param full_frame Set to true if the only crop is the whole frame
+ *
+ * @return The number of crops, at least 1
+ */
+size_t attention_plan(const attention_t* attention, attention_crop_t* crops, bool* full_frame);
+
+/**
+ * @brief Forget the detections of the last frame once the next frame has been analyzed.
+ *
+ * @param attention  The attention of the stream
+ * @param full_frame If the frame was analyzed in full, see attention_plan
+ */
+void attention_start_frame(attention_t* attention, bool full_frame);
+
+/**
+ * @brief Add a detection of the frame that the next crops are planned around.
+ *
+ * The corners are normalized to the frame.
+ */
+void attention_add_detection(attention_t* attention, float x1, float y1, float x2, float y2);
@@ -26,8 +26,19 @@
 #include <string.h>
 #include <sys/mman.h>
 #include <syslog.h>
+#include <time.h>
 #include <unistd.h>
 
+#define MAX_NBR_POWER_RETRIES 50
+
+static larodJobRequest* get_imported_buffer_request(model_provider_t* provider,
+                                                    VdoBuffer* vdo_buf,
+                                                    size_t slot);
+static void release_imported_buffers(model_provider_t* provider);
+static void apply_crop(model_provider_t* provider,
+                       larodJobRequest* req,
+                       unsigned int* crop_version);
+
 bool model_get_tensor_output_info(model_provider_t* provider,
                                   unsigned int tensor_output_index,
                                   model_tensor_output_t* tensor_output) {
@@ -38,17 +49,62 @@ bool model_get_tensor_output_info(model_provider_t* provider,
     return true;
 }
 
+static void model_job_handle_no_power(int* nbr_of_retries) {
+    // Currently this will only happen when there is no power
+    //  Just a number but if no power available after 50 retries it is time to give up
+    if (*nbr_of_retries == MAX_NBR_POWER_RETRIES) {
+        panic("Still no power available when running larod job %u, giving up", *nbr_of_retries);
+    }
+    syslog(LOG_INFO, "No power available when running larod job, try nbr %u", *nbr_of_retries);
+    *nbr_of_retries = *nbr_of_retries + 1;
+    usleep(250 * 1000 * *nbr_of_retries);
+}
+
 bool model_run_preprocessing(model_provider_t* provider, VdoBuffer* vdo_buf) {
+    return model_run_tile_preprocessing(provider, vdo_buf, 0);
+}
+
+bool model_run_tile_preprocessing(model_provider_t* provider, VdoBuffer* vdo_buf, size_t tile) {
     larodError* error            = NULL;
     static int nbr_power_retries = 0;
+    larodJobRequest* pp_req      = provider->pp_req;
 
     if (!provider->use_preprocessing) {
         return true;
     }
-    uint8_t* data = vdo_buffer_get_data(vdo_buf);
+    if (provider->num_tiles > 1) {
+        if (tile >= provider->num_tiles) {
+            panic("%s: Invalid tile %zu", __func__, tile);
+        }
+        pp_req = provider->tile_reqs[tile];
+    }
+    // Without tiles the job reads the frame straight from the vdo buffer if possible
+    larodJobRequest* imported_req = NULL;
+    if (provider->zero_copy) {
+        imported_req = get_imported_buffer_request(provider, vdo_buf, 0);
+    }
+    if (imported_req) {
+        pp_req = imported_req;
+    } else if (tile == 0) {
+        // All tiles are cropped from the same frame
+        uint8_t* data = vdo_buffer_get_data(vdo_buf);
 
-    memcpy(provider->image_input_addr, data, provider->image_buffer_size);
-    if (!larodRunJob(provider->conn, provider->pp_req, &error)) {
+        memcpy(provider->image_input_addr, data, provider->image_buffer_size);
+    }
+    if (!imported_req && provider->num_tiles <= 1) {
+        apply_crop(provider, pp_req, &provider->slots[0].crop_version);
+    }
+    if (!larodRunJob(provider->conn, pp_req, &error)) {
+        if (imported_req && error->code != LAROD_ERROR_POWER_NOT_AVAILABLE) {
+            syslog(LOG_WARNING,
+                   "%s: Could not run job on vdo buffer, copying the frames instead: %s",
+                   __func__,
+                   error->msg);
+            larodClearError(&error);
+            provider->zero_copy = false;
+            release_imported_buffers(provider);
+            return model_run_tile_preprocessing(provider, vdo_buf, tile);
+        }
         if (error->code != LAROD_ERROR_POWER_NOT_AVAILABLE) {
             panic("%s: Unable to run preprocessing job: %s (%d)",
                   __func__,
@@ -56,17 +112,7 @@ bool model_run_preprocessing(model_provider_t* provider, VdoBuffer* vdo_buf) {
                   error->code);
         }
         larodClearError(&error);
-        // Currently this will only happen when there is no power
-        //  Just a number but if no power available after 50 retries it is time to give up
-        if (nbr_power_retries == 50) {
-            panic("Still no power available when running larod job %u, giving up",
-                  nbr_power_retries);
-        }
-        syslog(LOG_INFO,
-               "No power available when running larod job, try nbr %u",
-               nbr_power_retries);
-        nbr_power_retries++;
-        usleep(250 * 1000 * nbr_power_retries);
+        model_job_handle_no_power(&nbr_power_retries);
         return false;
     }
     nbr_power_retries = 0;
@@ -74,16 +120,36 @@ bool model_run_preprocessing(model_provider_t* provider, VdoBuffer* vdo_buf) {
 }
 
 bool model_run_inference(model_provider_t* provider, VdoBuffer* vdo_buf) {
-    larodError* error            = NULL;
-    static int nbr_power_retries = 0;
+    larodError* error             = NULL;
+    static int nbr_power_retries  = 0;
+    larodJobRequest* inf_req      = provider->inf_req;
+    larodJobRequest* imported_req = NULL;
 
     if (!provider->use_preprocessing) {
-        uint8_t* data = vdo_buffer_get_data(vdo_buf);
+        // The model reads the frame straight from the vdo buffer if possible
+        if (provider->zero_copy) {
+            imported_req = get_imported_buffer_request(provider, vdo_buf, 0);
+        }
+        if (imported_req) {
+            inf_req = imported_req;
+        } else {
+            uint8_t* data = vdo_buffer_get_data(vdo_buf);
 
-        memcpy(provider->image_input_addr, data, provider->image_buffer_size);
+            memcpy(provider->image_input_addr, data, provider->image_buffer_size);
+        }
     }
 
-    if (!larodRunJob(provider->conn, provider->inf_req, &error)) {
+    if (!larodRunJob(provider->conn, inf_req, &error)) {
+        if (imported_req && error->code != LAROD_ERROR_POWER_NOT_AVAILABLE) {
+            syslog(LOG_WARNING,
+                   "%s: Could not run job on vdo buffer, copying the frames instead: %s",
+                   __func__,
+                   error->msg);
+            larodClearError(&error);
+            provider->zero_copy = false;
+            release_imported_buffers(provider);
+            return model_run_inference(provider, vdo_buf);
+        }
         if (error->code != LAROD_ERROR_POWER_NOT_AVAILABLE) {
             panic("%s: Unable to run inference on model: %s (%d)",
                   __func__,
@@ -91,17 +157,7 @@ bool model_run_inference(model_provider_t* provider, VdoBuffer* vdo_buf) {
                   error->code);
         }
         larodClearError(&error);
-        // Currently this will only happen when there is no power
-        //  Just a number but if no power available after 50 retries it is time to give up
-        if (nbr_power_retries == 50) {
-            panic("Still no power available when running larod job %u, giving up",
-                  nbr_power_retries);
-        }
-        syslog(LOG_INFO,
-               "No power available when running larod job, try nbr %u",
-               nbr_power_retries);
-        nbr_power_retries++;
-        usleep(250 * 1000 * nbr_power_retries);
+        model_job_handle_no_power(&nbr_power_retries);
         return false;
     }
     nbr_power_retries = 0;
@@ -148,6 +204,132 @@ static bool setup_input_tensor_metadata(unsigned int pitch,
     return true;
 }
 
+/**
+ * @brief Give a preprocessing job request the current crop if it has an older one.
+ */
+static void apply_crop(model_provider_t* provider,
+                       larodJobRequest* req,
+                       unsigned int* crop_version) {
+    larodError* error = NULL;
+
+    if (!provider->use_preprocessing || *crop_version == provider->crop_version) {
+        return;
+    }
+    if (!larodSetJobRequestParams(req, provider->crop_map, &error)) {
+        panic("%s: Failed setting preprocessing crop: %s", __func__, error->msg);
+    }
+    *crop_version = provider->crop_version;
+}
+
+static void release_imported_buffers(model_provider_t* provider) {
+    larodError* error = NULL;
+
+    for (size_t i = 0; i < provider->num_imported_buffers; i++) {
+        model_imported_buffer_t* imported = &provider->imported_buffers[i];
+        larodDestroyJobRequest(&imported->req);
+        larodDestroyTensors(provider->conn, &imported->tensors, imported->num_tensors, &error);
+        larodClearError(&error);
+    }
+    provider->num_imported_buffers = 0;
+}
+
+/**
+ * @brief Get the job request that reads the frame straight from a vdo buffer.
+ *
+ * The fd of the vdo buffer is set on a new larod input tensor, and a job request
+ * is created with it the first time a buffer is seen. The request is reused every
+ * time vdo hands out the same buffer again. The job writes to the tensors of the slot.
+ *
+ * @return NULL if the buffer could not be imported, then the frame has to be copied.
+ */
+static larodJobRequest* get_imported_buffer_request(model_provider_t* provider,
+                                                    VdoBuffer* vdo_buf,
+                                                    size_t slot) {
+    larodError* error                = NULL;
+    uint32_t id                      = vdo_buffer_get_id(vdo_buf);
+    model_imported_buffer_t imported = {.id           = id,
+                                        .slot         = slot,
+                                        .crop_version = provider->crop_version};
+
+    for (size_t i = 0; i < provider->num_imported_buffers; i++) {
+        model_imported_buffer_t* cached = &provider->imported_buffers[i];
+        if (cached->id == id && cached->slot == slot) {
+            apply_crop(provider, cached->req, &cached->crop_version);
+            return cached->req;
+        }
+    }
+    if (provider->num_imported_buffers == MODEL_MAX_IMPORTED_BUFFERS) {
+        syslog(LOG_WARNING,
+               "%s: More than %d vdo buffer imports, copying the frames instead",
+               __func__,
+               MODEL_MAX_IMPORTED_BUFFERS);
+        provider->zero_copy = false;
+        return NULL;
+    }
+
+    // The tensor gets the metadata of the first model input, only the memory is the vdo buffer
+    larodModel* input_model = provider->use_preprocessing ? provider->pp_model : provider->model;
+    imported.tensors = larodCreateModelInputs(input_model, &imported.num_tensors, &error);
+    if (!imported.tensors) {
+        goto error;
+    }
+    if (!provider->use_preprocessing) {
+        // The stream pitches were set on the input tensor that the frames are otherwise
+        // copied to
+        const larodTensorPitches* pitches =
+            larodGetTensorPitches(provider->input_tensors[0], &error);
+        if (!pitches || !larodSetTensorPitches(imported.tensors[0], pitches, &error)) {
+            goto error;
+        }
+    }
+    if (!larodSetTensorFd(imported.tensors[0], vdo_buffer_get_fd(vdo_buf), &error) ||
+        !larodSetTensorFdOffset(imported.tensors[0], vdo_buffer_get_offset(vdo_buf), &error) ||
+        !larodSetTensorFdSize(imported.tensors[0], vdo_buffer_get_capacity(vdo_buf), &error) ||
+        !larodSetTensorFdProps(imported.tensors[0],
+                               LAROD_FD_PROP_DMABUF | LAROD_FD_PROP_MAP,
+                               &error) ||
+        !larodTrackTensor(provider->conn, imported.tensors[0], &error)) {
+        goto error;
+    }
+
+    if (provider->use_preprocessing) {
+        imported.req = larodCreateJobRequest(input_model,
+                                             imported.tensors,
+                                             imported.num_tensors,
+                                             provider->slots[slot].pp_output_tensors,
+                                             provider->pp_num_outputs,
+                                             provider->crop_map,
+                                             &error);
+    } else {
+        imported.req = larodCreateJobRequest(input_model,
+                                             imported.tensors,
+                                             imported.num_tensors,
+                                             provider->slots[slot].output_tensors,
+                                             provider->num_outputs,
+                                             NULL,
+                                             &error);
+    }
+    if (!imported.req) {
+        goto error;
+    }
+
+    provider->imported_buffers[provider->num_imported_buffers++] = imported;
+    syslog(LOG_INFO, "Imported vdo buffer %u as larod input", id);
+    return imported.req;
+
+error:
+    syslog(LOG_WARNING,
+           "%s: Could not import vdo buffer %u, copying the frames instead: %s",
+           __func__,
+           id,
+           error ? error->msg : "unknown error");
+    larodClearError(&error);
+    larodDestroyTensors(provider->conn, &imported.tensors, imported.num_tensors, &error);
+    larodClearError(&error);
+    provider->zero_copy = false;
+    return NULL;
+}
+
 static void setup_tensors(larodConnection* conn,
                           larodModel* model,
                           larodTensor*** input_tensors,
@@ -166,6 +348,398 @@ static void setup_tensors(larodConnection* conn,
     }
 }
 
+/// Sent from the larod callback to the main loop when a job of a slot is done
+typedef struct model_completion {
+    size_t slot;
+    bool failed;
+    larodErrorCode code;
+    char msg[128];
+} model_completion_t;
+
+static int async_power_retries = 0;
+
+static int64_t monotonic_us(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static model_tensor_output_t* map_output_tensors(larodTensor** output_tensors,
+                                                 size_t num_outputs) {
+    larodError* error = NULL;
+
+    model_tensor_output_t* outputs = calloc(num_outputs, sizeof(model_tensor_output_t));
+    if (!outputs) {
+        panic("%s: Unable to allocate model outputs: %s", __func__, strerror(errno));
+    }
+    // To be able to get the data from the output tensors get the fd and mmap the memory
+    for (size_t i = 0; i < num_outputs; i++) {
+        int fd = larodGetTensorFd(output_tensors[i], &error);
+        if (fd == LAROD_INVALID_FD) {
+            panic("%s: Could not get tensor fd: %s", __func__, error->msg);
+        }
+        size_t output_size           = 0;
+        void* data                   = NULL;
+        larodTensorDataType datatype = LAROD_TENSOR_DATA_TYPE_INVALID;
+
+        outputs[i].fd = fd;
+        if (!larodGetTensorFdSize(output_tensors[i], &output_size, &error)) {
+            panic("%s: Could not get byte size of tensor: %s", __func__, error->msg);
+        }
+        outputs[i].size = output_size;
+        data            = mmap(NULL, output_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (data == MAP_FAILED) {
+            panic("%s: Could not map inference output tensors fd: %s", __func__, strerror(errno));
+        }
+        outputs[i].data = data;
+        datatype        = larodGetTensorDataType(output_tensors[i], &error);
+        if (datatype == LAROD_TENSOR_DATA_TYPE_INVALID) {
+            panic("%s: Could not get output tensor data type: %s", __func__, error->msg);
+        }
+        outputs[i].datatype = datatype;
+        syslog(LOG_INFO, "Created mmaped model output %zu with size %zu", i, output_size);
+    }
+    return outputs;
+}
+
+static void* map_input_tensor(larodTensor* tensor, size_t size) {
+    larodError* error = NULL;
+
+    int fd = larodGetTensorFd(tensor, &error);
+    if (fd == LAROD_INVALID_FD) {
+        panic("%s: Could not get tensor fd: %s", __func__, error->msg);
+    }
+    void* addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        panic("%s: Could not map input tensor fd: %s", __func__, strerror(errno));
+    }
+    return addr;
+}
+
+/**
+ * @brief Let slot 0 refer to the tensors and job requests of the synchronous calls.
+ */
+static void init_sync_slot(model_provider_t* provider) {
+    model_slot_t* slot = &provider->slots[0];
+
+    slot->pp_input_tensors  = provider->pp_input_tensors;
+    slot->pp_output_tensors = provider->pp_output_tensors;
+    slot->input_tensors     = provider->input_tensors;
+    slot->output_tensors    = provider->output_tensors;
+    slot->pp_req            = provider->pp_req;
+    slot->inf_req           = provider->inf_req;
+    slot->crop_version      = provider->crop_version;
+    slot->image_input_addr  = provider->image_input_addr;
+    slot->outputs           = provider->model_output_tensors;
+    provider->num_slots     = 1;
+}
+
+/**
+ * @brief Give a slot its own tensors and job requests, the same as those of slot 0.
+ */
+static void setup_slot(model_provider_t* provider, model_slot_t* slot) {
+    larodError* error  = NULL;
+    size_t num_inputs  = 0;
+    size_t num_outputs = 0;
+
+    if (provider->use_preprocessing) {
+        setup_tensors(provider->conn,
+                      provider->pp_model,
+                      &slot->pp_input_tensors,
+                      &num_inputs,
+                      &slot->pp_output_tensors,
+                      &num_outputs);
+        slot->image_input_addr =
+            map_input_tensor(slot->pp_input_tensors[0], provider->image_buffer_size);
+        slot->pp_req = larodCreateJobRequest(provider->pp_model,
+                                             slot->pp_input_tensors,
+                                             provider->pp_num_inputs,
+                                             slot->pp_output_tensors,
+                                             provider->pp_num_outputs,
+                                             provider->crop_map,
+                                             &error);
+        if (!slot->pp_req) {
+            panic("%s: Failed creating preprocessing job request: %s", __func__, error->msg);
+        }
+        slot->crop_version = provider->crop_version;
+        slot->output_tensors =
+            larodAllocModelOutputs(provider->conn, provider->model, 0, &num_outputs, NULL, &error);
+        if (!slot->output_tensors) {
+            panic("%s: Failed retrieving output tensors: %s", __func__, error->msg);
+        }
+        slot->inf_req = larodCreateJobRequest(provider->model,
+                                              slot->pp_output_tensors,
+                                              provider->pp_num_outputs,
+                                              slot->output_tensors,
+                                              provider->num_outputs,
+                                              NULL,
+                                              &error);
+    } else {
+        setup_tensors(provider->conn,
+                      provider->model,
+                      &slot->input_tensors,
+                      &num_inputs,
+                      &slot->output_tensors,
+                      &num_outputs);
+        // The frames are copied with the stream pitches, the same as for slot 0
+        const larodTensorPitches* pitches =
+            larodGetTensorPitches(provider->input_tensors[0], &error);
+        if (!pitches || !larodSetTensorPitches(slot->input_tensors[0], pitches, &error)) {
+            panic("%s: Failed to set tensor pitches: %s", __func__, error->msg);
+        }
+        slot->image_input_addr =
+            map_input_tensor(slot->input_tensors[0], provider->image_buffer_size);
+        slot->inf_req = larodCreateJobRequest(provider->model,
+                                              slot->input_tensors,
+                                              provider->num_inputs,
+                                              slot->output_tensors,
+                                              provider->num_outputs,
+                                              NULL,
+                                              &error);
+    }
+    if (!slot->inf_req) {
+        panic("%s: Failed creating inference job request: %s", __func__, error->msg);
+    }
+    slot->outputs = map_output_tensors(slot->output_tensors, provider->num_outputs);
+}
+
+static void destroy_slots(model_provider_t* provider) {
+    larodError* error = NULL;
+
+    // Slot 0 refers to the tensors and job requests of the synchronous calls
+    for (size_t i = 1; i < provider->num_slots; i++) {
+        model_slot_t* slot = &provider->slots[i];
+        for (size_t j = 0; slot->outputs && j < provider->num_outputs; j++) {
+            munmap(slot->outputs[j].data, slot->outputs[j].size);
+        }
+        free(slot->outputs);
+        if (slot->image_input_addr) {
+            munmap(slot->image_input_addr, provider->image_buffer_size);
+        }
+        larodDestroyJobRequest(&slot->pp_req);
+        larodDestroyJobRequest(&slot->inf_req);
+        larodDestroyTensors(provider->conn,
+                            &slot->pp_input_tensors,
+                            provider->pp_num_inputs,
+                            &error);
+        larodDestroyTensors(provider->conn,
+                            &slot->pp_output_tensors,
+                            provider->pp_num_outputs,
+                            &error);
+        larodDestroyTensors(provider->conn, &slot->input_tensors, provider->num_inputs, &error);
+        larodDestroyTensors(provider->conn, &slot->output_tensors, provider->num_outputs, &error);
+        larodClearError(&error);
+    }
+    for (size_t i = 0; i < 2; i++) {
+        if (provider->completion_fds[i] >= 0) {
+            close(provider->completion_fds[i]);
+        }
+    }
+}
+
+/**
+ * @brief Called by larod on its own thread when an async job is done.
+ *
+ * Only signals the main loop, which starts the next job of the frame.
+ */
+static void job_done(void* user_data, larodError* error) {
+    model_slot_t* slot            = user_data;
+    model_completion_t completion = {.slot = slot->index};
+
+    if (error) {
+        completion.failed = true;
+        completion.code   = error->code;
+        snprintf(completion.msg, sizeof(completion.msg), "%s", error->msg);
+    }
+    // A write to a pipe of less than PIPE_BUF bytes is never split
+    if (write(slot->completion_fd, &completion, sizeof(completion)) != sizeof(completion)) {
+        syslog(LOG_ERR, "%s: Could not signal job completion: %s", __func__, strerror(errno));
+    }
+}
+
+static bool start_slot_job(model_provider_t* provider,
+                           model_slot_t* slot,
+                           larodJobRequest* req) {
+    larodError* error = NULL;
+
+    if (!larodRunJobAsync(provider->conn, req, job_done, slot, &error)) {
+        if (error->code != LAROD_ERROR_POWER_NOT_AVAILABLE) {
+            panic("%s: Unable to start %s: %s (%d)",
+                  __func__,
+                  slot->inferring ? "inference on model" : "preprocessing job",
+                  error->msg,
+                  error->code);
+        }
+        larodClearError(&error);
+        model_job_handle_no_power(&async_power_retries);
+        return false;
+    }
+    return true;
+}
+
+void model_enable_async(model_provider_t* provider, size_t num_slots) {
+    if (num_slots < 1 || num_slots > MODEL_MAX_SLOTS) {
+        panic("%s: Invalid number of slots %zu", __func__, num_slots);
+    }
+    if (provider->num_tiles > 1) {
+        panic("%s: Tiles can not be analyzed asynchronously", __func__);
+    }
+    if (pipe(provider->completion_fds) != 0) {
+        panic("%s: Could not create completion pipe: %s", __func__, strerror(errno));
+    }
+    for (size_t i = 0; i < MODEL_MAX_SLOTS; i++) {
+        provider->slots[i].index         = i;
+        provider->slots[i].completion_fd = provider->completion_fds[1];
+    }
+    for (size_t i = 1; i < num_slots; i++) {
+        setup_slot(provider, &provider->slots[i]);
+        provider->num_slots = i + 1;
+    }
+    syslog(LOG_INFO, "Analyze up to %zu frames at the same time", num_slots);
+}
+
+int model_get_completion_fd(model_provider_t* provider) {
+    return provider->completion_fds[0];
+}
+
+bool model_get_free_slot(model_provider_t* provider, size_t* slot) {
+    for (size_t i = 0; i < provider->num_slots; i++) {
+        if (!provider->slots[i].vdo_buf) {
+            *slot = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t model_get_busy_slots(model_provider_t* provider) {
+    size_t busy = 0;
+
+    for (size_t i = 0; i < provider->num_slots; i++) {
+        if (provider->slots[i].vdo_buf) {
+            busy++;
+        }
+    }
+    return busy;
+}
+
+bool model_submit_frame(model_provider_t* provider, size_t index, VdoBuffer* vdo_buf) {
+    if (index >= provider->num_slots || provider->slots[index].vdo_buf) {
+        panic("%s: Slot %zu is not free", __func__, index);
+    }
+    model_slot_t* slot = &provider->slots[index];
+
+    // The first job reads the frame, the preprocessing job if there is one
+    larodJobRequest* first_req    = provider->use_preprocessing ? slot->pp_req : slot->inf_req;
+    larodJobRequest* imported_req = NULL;
+    if (provider->zero_copy) {
+        imported_req = get_imported_buffer_request(provider, vdo_buf, index);
+    }
+    if (imported_req) {
+        first_req = imported_req;
+    } else {
+        uint8_t* data = vdo_buffer_get_data(vdo_buf);
+        memcpy(slot->image_input_addr, data, provider->image_buffer_size);
+        if (provider->use_preprocessing) {
+            apply_crop(provider, first_req, &slot->crop_version);
+        }
+    }
+
+    slot->imported  = imported_req != NULL;
+    slot->inferring = !provider->use_preprocessing;
+    slot->submit_us = monotonic_us();
+    if (!start_slot_job(provider, slot, first_req)) {
+        return false;
+    }
+    slot->vdo_buf = vdo_buf;
+    return true;
+}
+
+model_job_status_t model_handle_completion(model_provider_t* provider, size_t* index) {
+    model_completion_t completion;
+
+    if (read(provider->completion_fds[0], &completion, sizeof(completion)) !=
+        sizeof(completion)) {
+        panic("%s: Could not read job completion: %s", __func__, strerror(errno));
+    }
+    model_slot_t* slot = &provider->slots[completion.slot];
+    *index             = completion.slot;
+
+    if (completion.failed) {
+        if (slot->imported && completion.code != LAROD_ERROR_POWER_NOT_AVAILABLE) {
+            syslog(LOG_WARNING,
+                   "%s: Could not run job on vdo buffer, copying the frames instead: %s",
+                   __func__,
+                   completion.msg);
+            // The imported buffers are released when no job can use them anymore
+            provider->zero_copy = false;
+            VdoBuffer* vdo_buf  = slot->vdo_buf;
+            slot->vdo_buf       = NULL;
+            if (!model_submit_frame(provider, *index, vdo_buf)) {
+                slot->vdo_buf = vdo_buf;
+                return MODEL_JOB_NO_POWER;
+            }
+            return MODEL_JOB_PENDING;
+        }
+        if (completion.code != LAROD_ERROR_POWER_NOT_AVAILABLE) {
+            panic("%s: Unable to run %s: %s (%d)",
+                  __func__,
+                  slot->inferring ? "inference on model" : "preprocessing job",
+                  completion.msg,
+                  completion.code);
+        }
+        model_job_handle_no_power(&async_power_retries);
+        return MODEL_JOB_NO_POWER;
+    }
+    async_power_retries = 0;
+    slot->imported      = false;
+
+    if (!slot->inferring) {
+        slot->inferring = true;
+        if (!start_slot_job(provider, slot, slot->inf_req)) {
+            return MODEL_JOB_NO_POWER;
+        }
+        return MODEL_JOB_PENDING;
+    }
+
+    // The frame waited for the frames before it until the previous completion
+    int64_t now_us   = monotonic_us();
+    int64_t start_us = slot->submit_us;
+    if (provider->last_completion_us > start_us) {
+        start_us = provider->last_completion_us;
+    }
+    slot->busy_ms                = (unsigned int)((now_us - start_us) / 1000);
+    provider->last_completion_us = now_us;
+    return MODEL_JOB_DONE;
+}
+
+bool model_get_slot_output_info(model_provider_t* provider,
+                                size_t slot,
+                                unsigned int tensor_output_index,
+                                model_tensor_output_t* tensor_output) {
+    if (slot >= provider->num_slots || tensor_output_index >= provider->num_outputs) {
+        panic("%s: Invalid slot %zu or output index %u", __func__, slot, tensor_output_index);
+    }
+    *tensor_output = provider->slots[slot].outputs[tensor_output_index];
+    return true;
+}
+
+unsigned int model_get_slot_busy_ms(model_provider_t* provider, size_t slot) {
+    return provider->slots[slot].busy_ms;
+}
+
+VdoBuffer* model_release_slot(model_provider_t* provider, size_t slot) {
+    VdoBuffer* vdo_buf            = provider->slots[slot].vdo_buf;
+    provider->slots[slot].vdo_buf = NULL;
+
+    if (!provider->zero_copy && provider->num_imported_buffers > 0 &&
+        model_get_busy_slots(provider) == 0) {
+        release_imported_buffers(provider);
+    }
+    return vdo_buf;
+}
+
 static larodModel*
 create_inference_model(model_provider_t* provider, char* model_file, char* device_name) {
     larodError* error = NULL;
@@ -337,12 +911,66 @@ static larodModel* create_preprocessing_model(model_provider_t* provider,
     return model;
 }
 
+static void create_tile_requests(model_provider_t* provider,
+                                 larodModel* pp_model,
+                                 const tile_t* tiles,
+                                 size_t num_tiles) {
+    larodError* error = NULL;
+
+    provider->tile_reqs = calloc(num_tiles, sizeof(larodJobRequest*));
+    if (!provider->tile_reqs) {
+        panic("%s: Unable to allocate tile job requests: %s", __func__, strerror(errno));
+    }
+    provider->num_tiles = num_tiles;
+
+    // Every tile writes to the same model input, so the tiles are analyzed one at a time
+    for (size_t i = 0; i < num_tiles; i++) {
+        larodMap* tile_map = larodCreateMap(&error);
+        if (!tile_map) {
+            panic("%s: Could not create tile crop larodMap %s", __func__, error->msg);
+        }
+        if (!larodMapSetIntArr4(tile_map,
+                                "image.input.crop",
+                                tiles[i].x,
+                                tiles[i].y,
+                                tiles[i].width,
+                                tiles[i].height,
+                                &error)) {
+            panic("%s: Failed setting tile crop: %s", __func__, error->msg);
+        }
+        syslog(LOG_INFO,
+               "Tile %zu crops X=%u Y=%u (%u x %u)",
+               i,
+               tiles[i].x,
+               tiles[i].y,
+               tiles[i].width,
+               tiles[i].height);
+        provider->tile_reqs[i] = larodCreateJobRequest(pp_model,
+                                                       provider->pp_input_tensors,
+                                                       provider->pp_num_inputs,
+                                                       provider->pp_output_tensors,
+                                                       provider->pp_num_outputs,
+                                                       tile_map,
+                                                       &error);
+        if (!provider->tile_reqs[i]) {
+            panic("%s: Failed creating tile job request: %s", __func__, error->msg);
+        }
+        larodDestroyMap(&tile_map);
+    }
+}
+
 void destroy_model_provider(model_provider_t* provider) {
     larodError* error = NULL;
     if (!provider) {
         panic("%s: Invalid pointer to model_provider_t", __func__);
     }
 
+    release_imported_buffers(provider);
+    destroy_slots(provider);
+    larodDestroyMap(&provider->crop_map);
+    larodDestroyModel(&provider->pp_model);
+    larodDestroyModel(&provider->model);
+
     // Only the model handle is released here. We count on larod service to
     // release the privately loaded model when the session is disconnected in
     // larodDisconnect().
@@ -383,6 +1011,10 @@ void destroy_model_provider(model_provider_t* provider) {
 
     larodDestroyJobRequest(&(provider->pp_req));
     larodDestroyJobRequest(&(provider->inf_req));
+    for (size_t i = 0; provider->tile_reqs && i < provider->num_tiles; i++) {
+        larodDestroyJobRequest(&provider->tile_reqs[i]);
+    }
+    free(provider->tile_reqs);
 
     free(provider);
 }
@@ -397,6 +1029,8 @@ model_provider_t* create_model_provider(unsigned int input_width,
                                         char* model_file,
                                         char* device_name,
                                         bool allow_input_crop,
+                                        const tile_t* tiles,
+                                        size_t num_tiles,
                                         size_t* num_output_tensors) {
     model_provider_t* provider = calloc(1, sizeof(model_provider_t));
     if (!provider) {
@@ -409,9 +1043,13 @@ model_provider_t* create_model_provider(unsigned int input_width,
         panic("%s: Could not connect to larod: %s", __func__, error->msg);
     }
 
-    provider->crop_map   = NULL;
-    larodModel* pp_model = NULL;
-    larodModel* model    = create_inference_model(provider, model_file, device_name);
+    provider->crop_map          = NULL;
+    provider->stream_width      = stream_width;
+    provider->stream_height     = stream_height;
+    provider->completion_fds[0] = -1;
+    provider->completion_fds[1] = -1;
+    larodModel* pp_model        = NULL;
+    larodModel* model           = create_inference_model(provider, model_file, device_name);
     setup_tensors(provider->conn,
                   model,
                   &provider->input_tensors,
@@ -466,9 +1104,12 @@ model_provider_t* create_model_provider(unsigned int input_width,
 
     provider->use_preprocessing = false;
     if (image_format != model_format || input_width != stream_width ||
-        input_height != stream_height) {
+        input_height != stream_height || num_tiles > 1) {
         provider->use_preprocessing = true;
     }
+    if (num_tiles > 1 && allow_input_crop) {
+        panic("%s: Input crop can not be combined with tiles", __func__);
+    }
 
     if (provider->use_preprocessing) {
         pp_model = create_preprocessing_model(provider,
@@ -552,34 +1193,8 @@ model_provider_t* create_model_provider(unsigned int input_width,
         }
     }
 
-    provider->model_output_tensors = calloc(provider->num_outputs, sizeof(model_tensor_output_t));
-    // To be able to get the data from the output tensors get the fd and mmap the memory
-    for (size_t i = 0; i < provider->num_outputs; i++) {
-        int fd = larodGetTensorFd(provider->output_tensors[i], &error);
-        if (fd == LAROD_INVALID_FD) {
-            panic("%s: Could not get tensor fd: %s", __func__, error->msg);
-        }
-        size_t output_size           = 0;
-        void* data                   = NULL;
-        larodTensorDataType datatype = LAROD_TENSOR_DATA_TYPE_INVALID;
-
-        provider->model_output_tensors[i].fd = fd;
-        if (!larodGetTensorFdSize(provider->output_tensors[i], &output_size, &error)) {
-            panic("%s: Could not get byte size of tensor: %s", __func__, error->msg);
-        }
-        provider->model_output_tensors[i].size = output_size;
-        data = mmap(NULL, output_size, PROT_READ, MAP_SHARED, fd, 0);
-        if (data == MAP_FAILED) {
-            panic("%s: Could not map inference output tensors fd: %s", __func__, strerror(errno));
-        }
-        provider->model_output_tensors[i].data = data;
-        datatype = larodGetTensorDataType(provider->output_tensors[i], &error);
-        if (datatype == LAROD_TENSOR_DATA_TYPE_INVALID) {
-            panic("%s: Could not get output tensor data type: %s", __func__, error->msg);
-        }
-        provider->model_output_tensors[i].datatype = datatype;
-        syslog(LOG_INFO, "Created mmaped model output %zu with size %zu", i, output_size);
-    }
+    provider->model_output_tensors =
+        map_output_tensors(provider->output_tensors, provider->num_outputs);
 
     if (provider->use_preprocessing) {
         // Create job requests
@@ -593,7 +1208,10 @@ model_provider_t* create_model_provider(unsigned int input_width,
         if (!provider->pp_req) {
             panic("%s: Failed creating preprocessing job request: %s", __func__, error->msg);
         }
-        larodDestroyMap(&provider->crop_map);
+
+        if (num_tiles > 1) {
+            create_tile_requests(provider, pp_model, tiles, num_tiles);
+        }
 
         // App supports only one input/output tensor.
         provider->inf_req = larodCreateJobRequest(model,
@@ -621,8 +1239,60 @@ model_provider_t* create_model_provider(unsigned int input_width,
     }
 
     *num_output_tensors = provider->num_outputs;
-    larodDestroyModel(&pp_model);
-    larodDestroyModel(&model);
+    // The models and the crop map are kept to create job requests for the vdo buffers
+    // that are imported as larod input. Each tile would need its own request per buffer,
+    // so tiled frames are still copied.
+    provider->model     = model;
+    provider->pp_model  = pp_model;
+    provider->zero_copy = num_tiles <= 1;
+    init_sync_slot(provider);
 
     return provider;
 }
+
+bool model_provider_update_crop(model_provider_t* provider,
+                                uint32_t clip_x,
+                                uint32_t clip_y,
+                                uint32_t clip_w,
+                                uint32_t clip_h) {
+    larodError* error = NULL;
+
+    // Only the preprocessing job can crop, and the tiles have a job request each
+    if (!provider->use_preprocessing || provider->num_tiles > 1) {
+        syslog(LOG_WARNING,
+               "%s: The frames are not preprocessed with one crop, they can not be cropped",
+               __func__);
+        return false;
+    }
+    if (clip_w == 0 || clip_h == 0 || clip_w > provider->stream_width ||
+        clip_h > provider->stream_height || clip_x > provider->stream_width - clip_w ||
+        clip_y > provider->stream_height - clip_h) {
+        syslog(LOG_WARNING,
+               "%s: Crop X=%u Y=%u (%u x %u) is outside the frame",
+               __func__,
+               clip_x,
+               clip_y,
+               clip_w,
+               clip_h);
+        return false;
+    }
+
+    // The same map is updated in place, the job requests get it before their next job
+    if (!provider->crop_map) {
+        provider->crop_map = larodCreateMap(&error);
+        if (!provider->crop_map) {
+            panic("Could not create preprocessing crop larodMap %s", error->msg);
+        }
+    }
+    if (!larodMapSetIntArr4(provider->crop_map,
+                            "image.input.crop",
+                            clip_x,
+                            clip_y,
+                            clip_w,
+                            clip_h,
+                            &error)) {
+        panic("Failed setting preprocessing parameters: %s", error->msg);
+    }
+    provider->crop_version++;
+    return true;
+}
@@ -31,11 +31,16 @@
  */
 
 #include "argparse.h"
+#include "attention.h"
+#include "framelatency.h"
 #include "imgprovider.h"
 #include "labelparse.h"
 #include "model.h"
 #include "model_params.h"  //Generated at build time
 #include "panic.h"
+#include "pipeline.h"
+#include "postprocessing.h"
+#include "tiling.h"
 #include "vdo-error.h"
 #include "vdo-frame.h"
 #include "vdo-types.h"
@@ -43,6 +48,7 @@
 #include <bbox.h>
 
 #include <math.h>
+#include <poll.h>
 #include <signal.h>
 #include <stdio.h>
 #include <sys/time.h>
@@ -52,21 +58,15 @@
 
 volatile sig_atomic_t running = 1;
 
+// GridNms can be changed while the application runs, so that the NMS methods can be compared.
+// It is set on the main thread and read by the thread that runs NMS.
+static gint grid_nms = 0;
+
 static void shutdown(int status) {
     (void)status;
     running = 0;
 }
 
-typedef struct model_params {
-    int input_width;
-    int input_height;
-    float quantization_scale;
-    float quantization_zero_point;
-    int num_classes;
-    int num_detections;
-    int size_per_detection;
-} model_params_t;
-
 static int ax_parameter_get_int(AXParameter* handle, const char* name) {
     gchar* str_value = NULL;
     GError* error    = NULL;
@@ -89,6 +89,40 @@ static int ax_parameter_get_int(AXParameter* handle, const char* name) {
     return value;
 }
 
+static bool ax_parameter_get_bool(AXParameter* handle, const char* name) {
+    gchar* str_value = NULL;
+    GError* error    = NULL;
+
+    // Get the value of the parameter
+    if (!ax_parameter_get(handle, name, &str_value, &error)) {
+        panic("%s", error->message);
+    }
+
+    syslog(LOG_INFO, "Axparameter %s: %s", name, str_value);
+
+    bool value = !g_strcmp0(str_value, "yes");
+    g_free(str_value);
+
+    return value;
+}
+
+// This function is registered as a callback using ax_parameter_register_callback().
+// It must not call any ax_parameter_* functions, since that would cause a deadlock.
+static void grid_nms_changed(const gchar* name, const gchar* value, gpointer user_data) {
+    (void)user_data;
+    syslog(LOG_INFO, "Axparameter %s changed to %s", name, value);
+    g_atomic_int_set(&grid_nms, !g_strcmp0(value, "yes"));
+}
+
+/**
+ * @brief Run NMS with the method that GridNms is set to right now.
+ */
+static void run_nms(detection_candidates_t* candidates, const nms_params_t* nms_params) {
+    nms_params_t params = *nms_params;
+    params.method       = g_atomic_int_get(&grid_nms) ? NMS_METHOD_GRID : NMS_METHOD_EXHAUSTIVE;
+    non_maximum_suppression(candidates, &params);
+}
+
 static bbox_t* setup_bbox(void) {
     // Create box drawers
     bbox_t* bbox = bbox_view_new(1u);
@@ -111,142 +145,171 @@ static unsigned int elapsed_ms(struct timeval* start_ts, struct timeval* end_ts)
                           ((end_ts->tv_usec - start_ts->tv_usec) / 1000));
 }
 
-static float intersection_over_union(float x1,
-                                     float y1,
-                                     float w1,
-                                     float h1,
-                                     float x2,
-                                     float y2,
-                                     float w2,
-                                     float h2) {
-    float xx1 = fmax(x1 - (w1 / 2), x2 - (w2 / 2));
-    float yy1 = fmax(y1 - (h1 / 2), y2 - (h2 / 2));
-    float xx2 = fmin(x1 + (w1 / 2), x2 + (w2 / 2));
-    float yy2 = fmin(y1 + (h1 / 2), y2 + (h2 / 2));
-
-    float inter_area = fmax(0, xx2 - xx1) * fmax(0, yy2 - yy1);
-    float union_area = w1 * h1 + w2 * h2 - inter_area;
-
-    return inter_area / union_area;
+static void determine_bbox_coordinates(detection_candidates_t* candidates,
+                                       size_t candidate_idx,
+                                       float* x1,
+                                       float* y1,
+                                       float* x2,
+                                       float* y2) {
+    // Clip the corners of the object to the frame
+    *x1 = fmax(0.0, candidates->x1[candidate_idx]);
+    *y1 = fmax(0.0, candidates->y1[candidate_idx]);
+    *x2 = fmin(1.0, candidates->x2[candidate_idx]);
+    *y2 = fmin(1.0, candidates->y2[candidate_idx]);
 }
 
-static void non_maximum_suppression(uint8_t* tensor,
-                                    float iou_threshold,
-                                    model_params_t* model_params,
-                                    int* invalid_detections) {
-    int size_per_detection = model_params->size_per_detection;
-    int num_detections     = model_params->num_detections;
-    float qt_zero_point    = model_params->quantization_zero_point;
-    float qt_scale         = model_params->quantization_scale;
-
-    for (int i = 0; i < num_detections; i++) {
-        if (invalid_detections[i])  // Skip comparison if detection is already invalid
-            continue;
+/**
+ * @brief Log the detections that NMS kept and draw them as boxes on the view.
+ */
+static void draw_detections(bbox_t* bbox, detection_candidates_t* candidates, char** labels) {
+    bbox_clear(bbox);
 
-        float x1                 = (tensor[size_per_detection * i + 0] - qt_zero_point) * qt_scale;
-        float y1                 = (tensor[size_per_detection * i + 1] - qt_zero_point) * qt_scale;
-        float w1                 = (tensor[size_per_detection * i + 2] - qt_zero_point) * qt_scale;
-        float h1                 = (tensor[size_per_detection * i + 3] - qt_zero_point) * qt_scale;
-        float object1_likelihood = (tensor[size_per_detection * i + 4] - qt_zero_point) * qt_scale;
+    int valid_detection_count = 0;
 
-        for (int j = i + 1; j < num_detections; j++) {
-            if (invalid_detections[j])  // Skip comparison if detection is already invalid
-                continue;
+    for (size_t k = 0; k < candidates->num_keep; k++) {
+        size_t i = candidates->keep[k];
 
-            float x2 = (tensor[size_per_detection * j + 0] - qt_zero_point) * qt_scale;
-            float y2 = (tensor[size_per_detection * j + 1] - qt_zero_point) * qt_scale;
-            float w2 = (tensor[size_per_detection * j + 2] - qt_zero_point) * qt_scale;
-            float h2 = (tensor[size_per_detection * j + 3] - qt_zero_point) * qt_scale;
-            float object2_likelihood =
-                (tensor[size_per_detection * j + 4] - qt_zero_point) * qt_scale;
-
-            if (intersection_over_union(x1, y1, w1, h1, x2, y2, w2, h2) > iou_threshold) {
-                // invalidates the detection with lowest object likelihood score
-                if (object1_likelihood > object2_likelihood) {
-                    invalid_detections[j] = 1;
-                } else {
-                    invalid_detections[i] = 1;
-                    break;
-                }
-            }
-        }
-    }
-}
+        valid_detection_count++;
 
-static void filter_detections(uint8_t* tensor,
-                              float conf_threshold,
-                              float iou_threshold,
-                              model_params_t* model_params,
-                              int* invalid_detections) {
-    // Filter boxes by confidence
-    for (int i = 0; i < model_params->num_detections; i++) {
-        float object_likelihood = (tensor[model_params->size_per_detection * i + 4] -
-                                   model_params->quantization_zero_point) *
-                                  model_params->quantization_scale;
-
-        if (object_likelihood < conf_threshold) {
-            invalid_detections[i] = 1;
-        } else {
-            invalid_detections[i] = 0;
-        }
+        float highest_class_likelihood = candidates->class_likelihood[i];
+        int label_idx                  = candidates->class_idx[i];
+        float object_likelihood        = candidates->score[i];
+
+        // Log info about object
+        syslog(LOG_INFO,
+               "Object %d: Label=%s, Object Likelihood=%.2f, Class Likelihood=%.2f, ",
+               valid_detection_count,
+               labels[label_idx],
+               object_likelihood,
+               highest_class_likelihood);
+
+        float x1, y1, x2, y2;
+        determine_bbox_coordinates(candidates, i, &x1, &y1, &x2, &y2);
+        syslog(LOG_INFO, "Bounding Box: [%.2f, %.2f, %.2f, %.2f]", x1, y1, x2, y2);
+
+        // No need to compensate for rotation since bbox will handle this
+        bbox_coordinates_frame_normalized(bbox);
+        bbox_rectangle(bbox, x1, y1, x2, y2);
     }
 
-    non_maximum_suppression(tensor, iou_threshold, model_params, invalid_detections);
+    if (!bbox_commit(bbox, 0u)) {
+        panic("Failed to commit box drawer");
+    }
 }
 
-static void determine_class_and_object_likelihood(uint8_t* tensor,
-                                                  int detection_idx,
-                                                  int size_per_detection,
-                                                  float qt_zero_point,
-                                                  float qt_scale,
-                                                  float* highest_class_likelihood,
-                                                  int* label_idx,
-                                                  float* object_likelihood) {
-    // Find what class this object is
-    for (int j = 5; j < size_per_detection; j++) {
-        float class_likelihood =
-            (tensor[size_per_detection * detection_idx + j] - qt_zero_point) * qt_scale;
-        if (class_likelihood > *highest_class_likelihood) {
-            *highest_class_likelihood = class_likelihood;
-            *label_idx                = j - 5;
-        }
+/**
+ * @brief Plan the crops of the next frame around the detections that NMS kept.
+ */
+static void remember_detections(attention_t* attention,
+                                detection_candidates_t* candidates,
+                                bool full_frame) {
+    attention_start_frame(attention, full_frame);
+    for (size_t k = 0; k < candidates->num_keep; k++) {
+        size_t i = candidates->keep[k];
+        attention_add_detection(attention,
+                                candidates->x1[i],
+                                candidates->y1[i],
+                                candidates->x2[i],
+                                candidates->y2[i]);
     }
-
-    *object_likelihood =
-        (tensor[size_per_detection * detection_idx + 4] - qt_zero_point) * qt_scale;
 }
 
-static void
-find_corners(float x, float y, float w, float h, float* x1, float* y1, float* x2, float* y2) {
-    *x1 = fmax(0.0, x - (w / 2));
-    *y1 = fmax(0.0, y - (h / 2));
-    *x2 = fmin(1.0, x + (w / 2));
-    *y2 = fmin(1.0, y + (h / 2));
+/**
+ * Everything needed to parse the outputs of a slot and draw its detections, on the
+ * main thread or on the worker thread of the pipeline.
+ */
+typedef struct postprocess_context {
+    model_provider_t* model_provider;
+    model_tensor_output_t* tensor_outputs;
+    size_t number_output_tensors;
+    unsigned int raw_conf_threshold;
+    model_params_t* model_params;
+    nms_params_t* nms_params;
+    detection_candidates_t* tile_candidates;
+    detection_candidates_t* candidates;
+    tile_t* tile;
+    bbox_t* bbox;
+    char** labels;
+    frame_latency_t* latency;
+    // The main loop fetches frames while the worker commits the latency of others
+    GMutex latency_lock;
+    // The times of the frame in each slot until its detections are drawn
+    frame_latency_frame_t slot_frames[MODEL_MAX_SLOTS];
+} postprocess_context_t;
+
+/**
+ * @brief Parse the outputs of a slot whose larod jobs are done and draw the detections.
+ */
+static void postprocess_slot(size_t slot, void* user_data) {
+    postprocess_context_t* context = user_data;
+    struct timeval start_ts, end_ts;
+
+    for (size_t i = 0; i < context->number_output_tensors; i++) {
+        if (!model_get_slot_output_info(context->model_provider,
+                                        slot,
+                                        i,
+                                        &context->tensor_outputs[i])) {
+            panic("Failed to get output tensor info for %zu", i);
+        }
+    }
+    uint8_t* tensor_data = context->tensor_outputs[0].data;
+
+    gettimeofday(&start_ts, NULL);
+    context->candidates->count = 0;
+    collect_candidates(tensor_data,
+                       context->raw_conf_threshold,
+                       context->model_params,
+                       context->tile_candidates);
+    classify_candidates(tensor_data, context->model_params, context->tile_candidates);
+    append_tile_candidates(context->tile_candidates,
+                           context->tile->norm_x,
+                           context->tile->norm_y,
+                           context->tile->norm_width,
+                           context->tile->norm_height,
+                           context->candidates);
+    run_nms(context->candidates, context->nms_params);
+    gettimeofday(&end_ts, NULL);
+    // The frame is made current in the latency tracker only when it is committed, since
+    // the main loop fetches other frames meanwhile
+    context->slot_frames[slot].result_us = g_get_monotonic_time();
+    syslog(LOG_INFO,
+           "Ran parsing for %u ms (%zu candidates) in slot %zu",
+           elapsed_ms(&start_ts, &end_ts),
+           context->candidates->count,
+           slot);
+
+    draw_detections(context->bbox, context->candidates, context->labels);
+    g_mutex_lock(&context->latency_lock);
+    frame_latency_set_frame(context->latency, &context->slot_frames[slot]);
+    frame_latency_committed(context->latency);
+    g_mutex_unlock(&context->latency_lock);
 }
 
-static void determine_bbox_coordinates(uint8_t* tensor,
-                                       int detection_idx,
-                                       int size_per_detection,
-                                       float qt_zero_point,
-                                       float qt_scale,
-                                       float* x1,
-                                       float* y1,
-                                       float* x2,
-                                       float* y2) {
-    // Get coordinates for the object
-    float x = (tensor[size_per_detection * detection_idx + 0] - qt_zero_point) * qt_scale;
-    float y = (tensor[size_per_detection * detection_idx + 1] - qt_zero_point) * qt_scale;
-    float w = (tensor[size_per_detection * detection_idx + 2] - qt_zero_point) * qt_scale;
-    float h = (tensor[size_per_detection * detection_idx + 3] - qt_zero_point) * qt_scale;
-    find_corners(x, y, w, h, x1, y1, x2, y2);
+/**
+ * @brief Free a slot and give its frame back to vdo.
+ */
+static void return_slot_frame(model_provider_t* model_provider,
+                              img_provider_t* image_provider,
+                              size_t slot,
+                              bool flush) {
+    VdoBuffer* vdo_buf = model_release_slot(model_provider, slot);
+
+    if (!img_provider_return_frame(image_provider, &vdo_buf)) {
+        panic("%s: Failed to return frame", __func__);
+    }
+    if (flush) {
+        img_provider_flush_all_frames(image_provider);
+    }
 }
 
 int main(int argc, char** argv) {
-    g_autoptr(GError) vdo_error           = NULL;
     img_provider_t* image_provider        = NULL;
+    frame_latency_t* latency              = NULL;
     model_provider_t* model_provider      = NULL;
     model_tensor_output_t* tensor_outputs = NULL;
     bbox_t* bbox                          = NULL;
+    pipeline_t* pipeline                  = NULL;
+    img_info_t image_metadata             = {0};
 
     // Stop main loop at signal
     signal(SIGTERM, shutdown);
@@ -280,8 +343,6 @@ int main(int argc, char** argv) {
     syslog(LOG_INFO, "Number of classes: %d", model_params->num_classes);
     syslog(LOG_INFO, "Number of detections: %d", model_params->num_detections);
 
-    int invalid_detections[model_params->num_detections];
-
     // Create a new axparameter instance
     GError* axparameter_error       = NULL;
     AXParameter* axparameter_handle = ax_parameter_new(APP_NAME, &axparameter_error);
@@ -290,56 +351,176 @@ int main(int argc, char** argv) {
     }
 
     float conf_threshold = ax_parameter_get_int(axparameter_handle, "ConfThresholdPercent") / 100.0;
-    float iou_threshold  = ax_parameter_get_int(axparameter_handle, "IouThresholdPercent") / 100.0;
-
-    ax_parameter_free(axparameter_handle);
-
-    VdoFormat vdo_format = VDO_FORMAT_YUV;
-    double vdo_framerate = 30.0;
+    nms_params_t nms_params;
+    nms_params.iou_threshold =
+        ax_parameter_get_int(axparameter_handle, "IouThresholdPercent") / 100.0;
+    nms_params.class_aware    = ax_parameter_get_bool(axparameter_handle, "ClassAwareNms");
+    nms_params.max_detections = ax_parameter_get_int(axparameter_handle, "MaxDetections");
+    // The method is taken from grid_nms every time NMS runs
+    g_atomic_int_set(&grid_nms, ax_parameter_get_bool(axparameter_handle, "GridNms"));
+    if (!ax_parameter_register_callback(axparameter_handle,
+                                        "GridNms",
+                                        grid_nms_changed,
+                                        NULL,
+                                        &axparameter_error)) {
+        panic("%s", axparameter_error->message);
+    }
+    // Share of the time between frames that the analysis of a frame may use
+    double target_utilization =
+        ax_parameter_get_int(axparameter_handle, "TargetUtilizationPercent") / 100.0;
+    // Split the frame into overlapping tiles that are analyzed at the model resolution
+    unsigned int tile_columns = ax_parameter_get_int(axparameter_handle, "TileColumns");
+    unsigned int tile_rows    = ax_parameter_get_int(axparameter_handle, "TileRows");
+    float tile_overlap =
+        ax_parameter_get_int(axparameter_handle, "TileOverlapPercent") / 100.0;
+    // Number of frames larod analyzes at the same time, 1 runs the jobs synchronously
+    size_t inference_slots = ax_parameter_get_int(axparameter_handle, "InferenceSlots");
+    // Parse and draw on a worker thread while larod analyzes the next frame
+    bool pipelined = ax_parameter_get_bool(axparameter_handle, "Pipelined");
+    // Analyze crops around the detections of the previous frame between full frames
+    attention_params_t attention_params;
+    attention_params.full_frame_interval =
+        ax_parameter_get_int(axparameter_handle, "FullFrameInterval");
+    attention_params.padding =
+        ax_parameter_get_int(axparameter_handle, "CropPaddingPercent") / 100.0;
+    attention_params.max_crops = ax_parameter_get_int(axparameter_handle, "MaxCrops");
+    bool use_attention         = attention_params.full_frame_interval > 1;
+
+    // Compare the raw output bytes against the threshold so that only the
+    // detections that pass it have to be dequantized
+    unsigned int raw_conf_threshold = quantize_threshold(conf_threshold, model_params);
+    syslog(LOG_INFO, "Raw confidence threshold: %u", raw_conf_threshold);
+
+    VdoFormat vdo_format           = VDO_FORMAT_YUV;
+    double vdo_framerate           = 30.0;
+    unsigned int vdo_input_channel = 1;
 
     if (!g_strcmp0(args.device_name, "a9-dlpu-tflite")) {
         // Possible to run RGB on ARTPEC-9
         vdo_format = VDO_FORMAT_RGB;
     }
 
-    // Choose a valid stream resolution since only certain resolutions are allowed
-    unsigned int stream_width  = 0;
-    unsigned int stream_height = 0;
-    if (!choose_stream_resolution(model_params->input_width,
-                                  model_params->input_height,
-                                  vdo_format,
-                                  "native",
-                                  "all",
-                                  &stream_width,
-                                  &stream_height)) {
-        syslog(LOG_ERR, "%s: Failed choosing stream resolution", __func__);
-        goto end;
+    // The image provider chooses the smallest stream resolution with the native
+    // aspect ratio that fits the model input, since only certain resolutions are allowed
+    img_info_t requested_metadata = {
+        .format = vdo_format,
+        .width  = model_params->input_width,
+        .height = model_params->input_height,
+    };
+    // With tiles the stream is large enough for every tile to have the model resolution
+    tiling_stream_size(model_params->input_width,
+                       model_params->input_height,
+                       tile_columns,
+                       tile_rows,
+                       tile_overlap,
+                       &requested_metadata.width,
+                       &requested_metadata.height);
+    if (pipelined && inference_slots < 2) {
+        // The worker parses the outputs of one slot while larod writes to another
+        inference_slots = 2;
     }
-    syslog(LOG_INFO,
-           "Creating VDO image provider and creating stream %u x %u",
-           stream_width,
-           stream_height);
-
-    image_provider = create_img_provider(stream_width, stream_height, 2, vdo_format, vdo_framerate);
+    if (inference_slots > 1 && tile_columns * tile_rows > 1) {
+        syslog(LOG_WARNING, "Tiled frames are analyzed one at a time");
+        inference_slots = 1;
+        pipelined       = false;
+    }
+    if (use_attention && tile_columns * tile_rows > 1) {
+        syslog(LOG_WARNING, "Attention crops can not be combined with tiles");
+        use_attention = false;
+    }
+    if (use_attention) {
+        // The crops of a frame depend on the detections of the frame before it
+        if (inference_slots > 1) {
+            syslog(LOG_WARNING, "Frames with attention crops are analyzed one at a time");
+        }
+        inference_slots = 1;
+        pipelined       = false;
+        // A larger stream gives the crops more pixels than the model input has
+        requested_metadata.width  = model_params->input_width * ATTENTION_STREAM_SCALE;
+        requested_metadata.height = model_params->input_height * ATTENTION_STREAM_SCALE;
+    }
+    // Every frame in flight holds a vdo buffer, and vdo needs one more to fill
+    image_provider = img_provider_new(vdo_input_channel,
+                                      &requested_metadata,
+                                      inference_slots + 1,
+                                      vdo_framerate,
+                                      "scale");
     if (!image_provider) {
         panic("%s: Could not create image provider", __func__);
     }
+    image_metadata = img_provider_get_image_metadata(image_provider);
+    syslog(LOG_INFO,
+           "Created VDO image provider with stream %u x %u",
+           image_metadata.width,
+           image_metadata.height);
+
+    size_t num_tiles = tile_columns * tile_rows;
+    tile_t tiles[TILING_MAX_DIM * TILING_MAX_DIM];
+    if (!tiling_split(image_metadata.width,
+                      image_metadata.height,
+                      tile_columns,
+                      tile_rows,
+                      tile_overlap,
+                      tiles)) {
+        panic("%s: Could not split the frame into %u x %u tiles",
+              __func__,
+              tile_columns,
+              tile_rows);
+    }
+
+    attention_t attention = {0};
+    if (use_attention && !attention_init(&attention,
+                                         &attention_params,
+                                         image_metadata.width,
+                                         image_metadata.height,
+                                         model_params->input_width,
+                                         model_params->input_height)) {
+        panic("%s: Could not set up attention crops", __func__);
+    }
+    // Crops are analyzed one after the other like tiles
+    attention_crop_t crops[ATTENTION_MAX_CROPS];
+    size_t max_regions = num_tiles;
+    if (use_attention && attention_params.max_crops > max_regions) {
+        max_regions = attention_params.max_crops;
+    }
+
+    // The candidates of every tile are gathered and suppressed together, so that an
+    // object seen by two overlapping tiles is only reported once
+    detection_candidates_t* tile_candidates =
+        create_detection_candidates(model_params->num_detections);
+    detection_candidates_t* candidates =
+        create_detection_candidates(model_params->num_detections * max_regions);
+
+    // Let the framerate follow the analysis time so the accelerator is kept at the target
+    // utilization, instead of analyzing frames that have waited in vdo
+    img_provider_ewma_controller_init(img_provider_get_ewma_controller(image_provider),
+                                      target_utilization);
 
     size_t number_output_tensors = 0;
     model_provider               = create_model_provider(model_params->input_width,
                                            model_params->input_height,
-                                           image_provider->width,
-                                           image_provider->height,
-                                           image_provider->pitch,
-                                           image_provider->format,
+                                           image_metadata.width,
+                                           image_metadata.height,
+                                           image_metadata.pitch,
+                                           image_metadata.format,
                                            VDO_FORMAT_RGB,
                                            args.model_file,
                                            args.device_name,
                                            false,
+                                           tiles,
+                                           num_tiles,
                                            &number_output_tensors);
     if (!model_provider) {
         panic("%s: Could not create model provider", __func__);
     }
+    if (use_attention && !model_provider_update_crop(model_provider,
+                                                     0,
+                                                     0,
+                                                     image_metadata.width,
+                                                     image_metadata.height)) {
+        syslog(LOG_WARNING, "The frames can not be cropped, they are analyzed in full");
+        use_attention = false;
+    }
     tensor_outputs = calloc(number_output_tensors, sizeof(model_tensor_output_t));
     if (!tensor_outputs) {
         panic("%s: Could not allocate tensor outputs", __func__);
@@ -352,6 +533,15 @@ int main(int argc, char** argv) {
 
     parse_labels(&labels, &label_file_data, args.labels_file, &num_labels);
 
+    // Analyze the newest frame vdo has, older queued frames would make the result lag
+    img_provider_set_fetch_policy(image_provider, IMG_PROVIDER_FETCH_LATEST_FRAME);
+
+    // Report the latency percentiles and dropped frames every 100 frames
+    latency = frame_latency_new(100);
+    if (!latency) {
+        panic("%s: Could not create frame latency", __func__);
+    }
+
     syslog(LOG_INFO, "Start fetching video frames from VDO");
     if (!img_provider_start(image_provider)) {
         panic("%s: Could not start image provider", __func__);
@@ -359,14 +549,135 @@ int main(int argc, char** argv) {
 
     bbox = setup_bbox();
 
-    int size_per_detection = model_params->size_per_detection;
-    float qt_zero_point    = model_params->quantization_zero_point;
-    float qt_scale         = model_params->quantization_scale;
+    postprocess_context_t postprocess = {
+        .model_provider        = model_provider,
+        .tensor_outputs        = tensor_outputs,
+        .number_output_tensors = number_output_tensors,
+        .raw_conf_threshold    = raw_conf_threshold,
+        .model_params          = model_params,
+        .nms_params            = &nms_params,
+        .tile_candidates       = tile_candidates,
+        .candidates            = candidates,
+        .tile                  = &tiles[0],
+        .bbox                  = bbox,
+        .labels                = labels,
+        .latency               = latency,
+    };
+    g_mutex_init(&postprocess.latency_lock);
+    if (inference_slots > 1) {
+        model_enable_async(model_provider, inference_slots);
+    }
+    if (pipelined) {
+        // Report how busy each stage is every 100 frames
+        pipeline = pipeline_new(postprocess_slot, &postprocess, 100);
+        if (!pipeline) {
+            panic("%s: Could not create pipeline", __func__);
+        }
+    }
+
+    // Fetch the next frame while larod analyzes the frames in flight, and let the frames in
+    // flight finish before exiting so they can be given back to vdo
+    while (inference_slots > 1 && (running || model_get_busy_slots(model_provider) > 0)) {
+        // Run the axparameter callbacks of changes made since the last frame
+        g_main_context_iteration(NULL, FALSE);
+        size_t slot = 0;
+        // Only wait for a frame if there is a free slot to analyze it in
+        bool fetch          = running && model_get_free_slot(model_provider, &slot);
+        struct pollfd fds[] = {
+            {.fd = fetch ? img_provider_get_fd(image_provider) : -1, .events = POLLIN},
+            {.fd = model_get_completion_fd(model_provider), .events = POLLIN},
+            {.fd = pipeline ? pipeline_get_done_fd(pipeline) : -1, .events = POLLIN},
+        };
+        if (poll(fds, 3, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            panic("%s: Failed to poll: %s", __func__, strerror(errno));
+        }
+
+        if (fds[1].revents & POLLIN) {
+            size_t done_slot          = 0;
+            model_job_status_t status = model_handle_completion(model_provider, &done_slot);
+            unsigned int busy_ms      = model_get_slot_busy_ms(model_provider, done_slot);
+            bool analyze              = status == MODEL_JOB_DONE && running;
+            if (analyze) {
+                syslog(LOG_INFO,
+                       "Ran pre-processing and inference for %u ms in slot %zu",
+                       busy_ms,
+                       done_slot);
+            }
+            if (analyze && pipeline) {
+                // The worker parses the outputs while larod analyzes the next frame, the
+                // slot is given back when the worker is done with it
+                pipeline_add_busy(pipeline, PIPELINE_STAGE_LAROD, busy_ms * 1000);
+                pipeline_push(pipeline, done_slot);
+            } else if (analyze) {
+                struct timeval start_ts, end_ts;
+                gettimeofday(&start_ts, NULL);
+                postprocess_slot(done_slot, &postprocess);
+                gettimeofday(&end_ts, NULL);
+                // Parsing overlaps with larod, the slower of them limits the framerate
+                unsigned int analysis_ms = MAX(busy_ms, elapsed_ms(&start_ts, &end_ts));
+                if (!img_provider_update_framerate(image_provider, analysis_ms)) {
+                    panic("%s: Failed to update framerate", __func__);
+                }
+                return_slot_frame(model_provider, image_provider, done_slot, false);
+            } else if (status != MODEL_JOB_PENDING) {
+                return_slot_frame(model_provider,
+                                  image_provider,
+                                  done_slot,
+                                  status == MODEL_JOB_NO_POWER);
+            }
+        }
+
+        if (fds[2].revents & POLLIN) {
+            unsigned int postprocess_ms = 0;
+            size_t done_slot            = pipeline_pop_done(pipeline, &postprocess_ms);
+            unsigned int busy_ms        = model_get_slot_busy_ms(model_provider, done_slot);
+            // The stages overlap, the slowest of them limits the framerate
+            if (!img_provider_update_framerate(image_provider, MAX(busy_ms, postprocess_ms))) {
+                panic("%s: Failed to update framerate", __func__);
+            }
+            return_slot_frame(model_provider, image_provider, done_slot, false);
+            pipeline_frame_done(pipeline);
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int64_t fetch_start_us = g_get_monotonic_time();
+            VdoBuffer* vdo_buf     = img_provider_get_frame(image_provider);
+            if (!vdo_buf) {
+                syslog(LOG_INFO,
+                       "No buffer because of changed global rotation. Application needs to be "
+                       "restarted");
+                running = 0;
+                continue;
+            }
+            g_mutex_lock(&postprocess.latency_lock);
+            frame_latency_frame_dequeued(latency, vdo_buf);
+            postprocess.slot_frames[slot] = frame_latency_get_frame(latency);
+            g_mutex_unlock(&postprocess.latency_lock);
+            if (!model_submit_frame(model_provider, slot, vdo_buf)) {
+                // No power
+                if (!img_provider_return_frame(image_provider, &vdo_buf)) {
+                    panic("%s: Failed to return frame", __func__);
+                }
+                img_provider_flush_all_frames(image_provider);
+            }
+            if (pipeline) {
+                pipeline_add_busy(pipeline,
+                                  PIPELINE_STAGE_FETCH,
+                                  g_get_monotonic_time() - fetch_start_us);
+            }
+        }
+    }
 
     while (running) {
+        // Run the axparameter callbacks of changes made since the last frame
+        g_main_context_iteration(NULL, FALSE);
         struct timeval start_ts, end_ts;
         unsigned int preprocessing_ms = 0;
         unsigned int inference_ms     = 0;
+        unsigned int parsing_ms       = 0;
         unsigned int total_elapsed_ms = 0;
 
         g_autoptr(VdoBuffer) vdo_buf = img_provider_get_frame(image_provider);
@@ -378,135 +689,129 @@ int main(int argc, char** argv) {
                 "No buffer because of changed global rotation. Application needs to be restarted");
             goto end;
         }
-        // If needed convert and scale/crop to correct input format and resolution
-        // Its up to the model provider to decide if needed or not
-        // If not needed the model_run_preprocessing will return true without
-        // any work
-        gettimeofday(&start_ts, NULL);
-        if (!model_run_preprocessing(model_provider, vdo_buf)) {
-            // No power
-            if (!vdo_stream_buffer_unref(image_provider->vdo_stream, &vdo_buf, &vdo_error)) {
-                if (!vdo_error_is_expected(&vdo_error)) {
-                    panic("%s: Unexpexted error: %s", __func__, vdo_error->message);
-                }
-                g_clear_error(&vdo_error);
+        frame_latency_frame_dequeued(latency, vdo_buf);
+        img_provider_frame_info_t frame_info = img_provider_get_frame_info(image_provider);
+        syslog(LOG_INFO,
+               "Fetched a frame %u ms old, skipped %u older frames",
+               (unsigned int)(frame_info.age_us / 1000),
+               frame_info.skipped_frames);
+        candidates->count = 0;
+        bool no_power     = false;
+        // The tiles of the frame, or the crops around the detections of the previous frame
+        tile_t* regions    = tiles;
+        size_t num_regions = num_tiles;
+        bool full_frame    = true;
+        if (use_attention) {
+            num_regions = attention_plan(&attention, crops, &full_frame);
+            regions     = crops;
+            if (full_frame) {
+                syslog(LOG_INFO, "Analyze the whole frame");
+            } else {
+                syslog(LOG_INFO,
+                       "Analyze %zu crops around %zu detections",
+                       num_regions,
+                       attention.num_detections);
             }
-            img_provider_flush_all_frames(image_provider);
-            continue;
         }
-        gettimeofday(&end_ts, NULL);
-
-        preprocessing_ms = (unsigned int)(((end_ts.tv_sec - start_ts.tv_sec) * 1000) +
-                                          ((end_ts.tv_usec - start_ts.tv_usec) / 1000));
-        syslog(LOG_INFO, "Ran pre-processing for %u ms", preprocessing_ms);
+        for (size_t t = 0; t < num_regions; t++) {
+            if (use_attention && !model_provider_update_crop(model_provider,
+                                                             regions[t].x,
+                                                             regions[t].y,
+                                                             regions[t].width,
+                                                             regions[t].height)) {
+                panic("%s: Could not crop the frame", __func__);
+            }
+            // If needed convert and scale/crop to correct input format and resolution
+            // Its up to the model provider to decide if needed or not
+            // If not needed the model_run_tile_preprocessing will return true without
+            // any work
+            gettimeofday(&start_ts, NULL);
+            if (!model_run_tile_preprocessing(model_provider, vdo_buf, t)) {
+                no_power = true;
+                break;
+            }
+            gettimeofday(&end_ts, NULL);
+            preprocessing_ms += elapsed_ms(&start_ts, &end_ts);
+
+            // Retrieve detections from data
+            gettimeofday(&start_ts, NULL);
+            if (!model_run_inference(model_provider, vdo_buf)) {
+                no_power = true;
+                break;
+            }
+            gettimeofday(&end_ts, NULL);
+            inference_ms += elapsed_ms(&start_ts, &end_ts);
 
-        // Retrieve detections from data
-        gettimeofday(&start_ts, NULL);
-        if (!model_run_inference(model_provider, vdo_buf)) {
-            // No power
-            if (!vdo_stream_buffer_unref(image_provider->vdo_stream, &vdo_buf, &vdo_error)) {
-                if (!vdo_error_is_expected(&vdo_error)) {
-                    panic("%s: Unexpexted error: %s", __func__, vdo_error->message);
+            for (size_t i = 0; i < number_output_tensors; i++) {
+                if (!model_get_tensor_output_info(model_provider, i, &tensor_outputs[i])) {
+                    panic("Failed to get output tensor info for %zu", i);
                 }
-                g_clear_error(&vdo_error);
+            }
+
+            uint8_t* tensor_data = tensor_outputs[0].data;
+            // Parse the output and move the boxes from the tile to the frame
+            gettimeofday(&start_ts, NULL);
+            collect_candidates(tensor_data, raw_conf_threshold, model_params, tile_candidates);
+            classify_candidates(tensor_data, model_params, tile_candidates);
+            append_tile_candidates(tile_candidates,
+                                   regions[t].norm_x,
+                                   regions[t].norm_y,
+                                   regions[t].norm_width,
+                                   regions[t].norm_height,
+                                   candidates);
+            gettimeofday(&end_ts, NULL);
+            parsing_ms += elapsed_ms(&start_ts, &end_ts);
+        }
+        if (no_power) {
+            if (!img_provider_return_frame(image_provider, &vdo_buf)) {
+                panic("%s: Failed to return frame", __func__);
             }
             img_provider_flush_all_frames(image_provider);
             continue;
         }
-        gettimeofday(&end_ts, NULL);
-
-        inference_ms = (unsigned int)(((end_ts.tv_sec - start_ts.tv_sec) * 1000) +
-                                      ((end_ts.tv_usec - start_ts.tv_usec) / 1000));
+        syslog(LOG_INFO, "Ran pre-processing for %u ms", preprocessing_ms);
         syslog(LOG_INFO, "Ran inference for %u ms", inference_ms);
 
         total_elapsed_ms = inference_ms + preprocessing_ms;
 
         // Check if the framerate from vdo should be changed
-        img_provider_update_framerate(image_provider, total_elapsed_ms);
-
-        for (size_t i = 0; i < number_output_tensors; i++) {
-            if (!model_get_tensor_output_info(model_provider, i, &tensor_outputs[i])) {
-                panic("Failed to get output tensor info for %zu", i);
-            }
+        if (!img_provider_update_framerate(image_provider, total_elapsed_ms)) {
+            panic("%s: Failed to update framerate", __func__);
         }
 
-        uint8_t* tensor_data = tensor_outputs[0].data;
-        // Parse the output
         gettimeofday(&start_ts, NULL);
-        filter_detections(tensor_data,
-                          conf_threshold,
-                          iou_threshold,
-                          model_params,
-                          invalid_detections);
+        run_nms(candidates, &nms_params);
         gettimeofday(&end_ts, NULL);
-        syslog(LOG_INFO, "Ran parsing for %u ms", elapsed_ms(&start_ts, &end_ts));
-
-        bbox_clear(bbox);
-
-        int valid_detection_count = 0;
-
-        for (int i = 0; i < model_params->num_detections; i++) {
-            if (invalid_detections[i] == 1) {
-                continue;
-            }
-
-            valid_detection_count++;
-
-            float highest_class_likelihood = 0.0;
-            int label_idx                  = 0;
-            float object_likelihood        = 0.0;
-
-            determine_class_and_object_likelihood(tensor_data,
-                                                  i,
-                                                  size_per_detection,
-                                                  qt_zero_point,
-                                                  qt_scale,
-                                                  &highest_class_likelihood,
-                                                  &label_idx,
-                                                  &object_likelihood);
-            // Log info about object
-            syslog(LOG_INFO,
-                   "Object %d: Label=%s, Object Likelihood=%.2f, Class Likelihood=%.2f, ",
-                   valid_detection_count,
-                   labels[label_idx],
-                   object_likelihood,
-                   highest_class_likelihood);
-
-            float x1, y1, x2, y2;
-            determine_bbox_coordinates(tensor_data,
-                                       i,
-                                       size_per_detection,
-                                       qt_zero_point,
-                                       qt_scale,
-                                       &x1,
-                                       &y1,
-                                       &x2,
-                                       &y2);
-            syslog(LOG_INFO, "Bounding Box: [%.2f, %.2f, %.2f, %.2f]", x1, y1, x2, y2);
-
-            // No need to compensate for rotation since bbox will handle this
-            bbox_coordinates_frame_normalized(bbox);
-            bbox_rectangle(bbox, x1, y1, x2, y2);
+        parsing_ms += elapsed_ms(&start_ts, &end_ts);
+        frame_latency_result_ready(latency);
+        syslog(LOG_INFO,
+               "Ran parsing for %u ms (%zu candidates, %zu tiles)",
+               parsing_ms,
+               candidates->count,
+               num_regions);
+        if (use_attention) {
+            remember_detections(&attention, candidates, full_frame);
         }
 
-        if (!bbox_commit(bbox, 0u)) {
-            panic("Failed to commit box drawer");
-        }
+        draw_detections(bbox, candidates, labels);
+        frame_latency_committed(latency);
 
         // This will allow vdo to fill this buffer with data again
-        if (!vdo_stream_buffer_unref(image_provider->vdo_stream, &vdo_buf, &vdo_error)) {
-            if (!vdo_error_is_expected(&vdo_error)) {
-                panic("%s: Unexpexted error: %s", __func__, vdo_error->message);
-            }
-            g_clear_error(&vdo_error);
+        if (!img_provider_return_frame(image_provider, &vdo_buf)) {
+            panic("%s: Failed to return frame", __func__);
         }
     }
 
 end:
     // Cleanup
+    pipeline_destroy(pipeline);
+    ax_parameter_free(axparameter_handle);
     free(model_params);
+    destroy_detection_candidates(candidates);
+    destroy_detection_candidates(tile_candidates);
+    frame_latency_destroy(latency);
     if (image_provider) {
-        destroy_img_provider(image_provider);
+        img_provider_destroy(image_provider);
     }
     if (model_provider) {
         destroy_model_provider(model_provider);
@@ -0,0 +1,151 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pipeline.h"
+#include "panic.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+
+static const char* stage_names[PIPELINE_NUM_STAGES] = {
+    "fetch",
+    "larod",
+    "post-processing",
+};
+
+/// Written by the worker when it is done with a slot
+typedef struct pipeline_done {
+    size_t slot;
+    unsigned int postprocess_ms;
+} pipeline_done_t;
+
+static gpointer worker_main(gpointer data) {
+    pipeline_t* pipeline = data;
+
+    while (true) {
+        gpointer item = g_async_queue_pop(pipeline->queue);
+        size_t slot   = GPOINTER_TO_SIZE(item);
+        // Slot 0 is pushed as 1, 0 is never pushed so it is free to stop the worker
+        if (slot == 0) {
+            break;
+        }
+        slot--;
+
+        int64_t start_us = g_get_monotonic_time();
+        pipeline->postprocess(slot, pipeline->user_data);
+        int64_t busy_us = g_get_monotonic_time() - start_us;
+        pipeline_add_busy(pipeline, PIPELINE_STAGE_POSTPROCESS, busy_us);
+
+        pipeline_done_t done = {.slot = slot, .postprocess_ms = (unsigned int)(busy_us / 1000)};
+        // A write to a pipe of less than PIPE_BUF bytes is never split
+        if (write(pipeline->done_fds[1], &done, sizeof(done)) != sizeof(done)) {
+            syslog(LOG_ERR,
+                   "%s: Could not signal post-processed slot: %s",
+                   __func__,
+                   strerror(errno));
+        }
+    }
+    return NULL;
+}
+
+pipeline_t* pipeline_new(pipeline_postprocess_t postprocess,
+                         void* user_data,
+                         unsigned int report_interval) {
+    pipeline_t* pipeline = calloc(1, sizeof(pipeline_t));
+    if (!pipeline) {
+        syslog(LOG_ERR, "%s: Unable to allocate pipeline", __func__);
+        return NULL;
+    }
+    if (pipe(pipeline->done_fds) != 0) {
+        syslog(LOG_ERR, "%s: Could not create pipe: %s", __func__, strerror(errno));
+        free(pipeline);
+        return NULL;
+    }
+    pipeline->postprocess     = postprocess;
+    pipeline->user_data       = user_data;
+    pipeline->report_interval = report_interval;
+    pipeline->report_start_us = g_get_monotonic_time();
+    g_mutex_init(&pipeline->lock);
+    pipeline->queue  = g_async_queue_new();
+    pipeline->worker = g_thread_new("postprocess", worker_main, pipeline);
+    return pipeline;
+}
+
+void pipeline_destroy(pipeline_t* pipeline) {
+    if (!pipeline) {
+        return;
+    }
+    g_async_queue_push(pipeline->queue, GSIZE_TO_POINTER(0));
+    g_thread_join(pipeline->worker);
+    g_async_queue_unref(pipeline->queue);
+    g_mutex_clear(&pipeline->lock);
+    close(pipeline->done_fds[0]);
+    close(pipeline->done_fds[1]);
+    free(pipeline);
+}
+
+void pipeline_push(pipeline_t* pipeline, size_t slot) {
+    g_async_queue_push(pipeline->queue, GSIZE_TO_POINTER(slot + 1));
+}
+
+int pipeline_get_done_fd(pipeline_t* pipeline) {
+    return pipeline->done_fds[0];
+}
+
+size_t pipeline_pop_done(pipeline_t* pipeline, unsigned int* postprocess_ms) {
+    pipeline_done_t done;
+
+    if (read(pipeline->done_fds[0], &done, sizeof(done)) != sizeof(done)) {
+        panic("%s: Could not read post-processed slot: %s", __func__, strerror(errno));
+    }
+    *postprocess_ms = done.postprocess_ms;
+    return done.slot;
+}
+
+void pipeline_add_busy(pipeline_t* pipeline, pipeline_stage_t stage, int64_t busy_us) {
+    g_mutex_lock(&pipeline->lock);
+    pipeline->busy_us[stage] += busy_us;
+    g_mutex_unlock(&pipeline->lock);
+}
+
+void pipeline_frame_done(pipeline_t* pipeline) {
+    pipeline->frames++;
+    if (pipeline->report_interval == 0 || pipeline->frames < pipeline->report_interval) {
+        return;
+    }
+
+    int64_t now_us     = g_get_monotonic_time();
+    int64_t elapsed_us = now_us - pipeline->report_start_us;
+    g_mutex_lock(&pipeline->lock);
+    syslog(LOG_INFO,
+           "Pipeline occupancy of %u frames in %lld ms (%.1f fps):",
+           pipeline->frames,
+           (long long)(elapsed_us / 1000),
+           pipeline->frames * 1e6 / elapsed_us);
+    for (int stage = 0; stage < PIPELINE_NUM_STAGES; stage++) {
+        syslog(LOG_INFO,
+               "  %-15s %5.1f%%",
+               stage_names[stage],
+               100.0 * pipeline->busy_us[stage] / elapsed_us);
+        pipeline->busy_us[stage] = 0;
+    }
+    g_mutex_unlock(&pipeline->lock);
+    pipeline->frames          = 0;
+    pipeline->report_start_us = now_us;
+}
@@ -0,0 +1,119 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This header file runs the post-processing of the analyzed frames on a worker thread,
+ * so that the main loop can fetch the next frame and keep larod busy meanwhile. It also
+ * measures how busy each stage of the pipeline is.
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief The stages of the pipeline whose occupancy is reported.
+ */
+typedef enum pipeline_stage {
+    /// The main loop fetches a frame and starts its larod jobs
+    PIPELINE_STAGE_FETCH,
+    /// Larod runs the pre-processing and inference jobs of a frame
+    PIPELINE_STAGE_LAROD,
+    /// The worker parses the outputs and draws the detections
+    PIPELINE_STAGE_POSTPROCESS,
+    PIPELINE_NUM_STAGES,
+} pipeline_stage_t;
+
+/**
+ * @brief Post-processes the outputs of a slot, called on the worker thread.
+ *
+ * @param slot       The slot of the model provider whose outputs are ready
+ * @param user_data  The user_data given to pipeline_new
+ */
+typedef void (*pipeline_postprocess_t)(size_t slot, void* user_data);
+
+typedef struct pipeline {
+    GThread* worker;
+    // Slots handed to the worker, stored as slot + 1 since the queue can not hold NULL
+    GAsyncQueue* queue;
+    // The worker writes the slots it is done with to [1] that the main loop reads from [0]
+    int done_fds[2];
+    pipeline_postprocess_t postprocess;
+    void* user_data;
+
+    // Busy time of each stage since the last report, the worker adds to it as well
+    GMutex lock;
+    int64_t busy_us[PIPELINE_NUM_STAGES];
+    int64_t report_start_us;
+    unsigned int frames;
+    unsigned int report_interval;
+} pipeline_t;
+
+/**
+ * @brief Start the worker thread.
+ *
+ * @param postprocess      Called on the worker thread for every slot pushed to it
+ * @param user_data        Passed to every call of postprocess
+ * @param report_interval  Number of frames between each occupancy report, 0 for no reports
+ * @return Pointer to new pipeline, or NULL if failed.
+ */
+pipeline_t* pipeline_new(pipeline_postprocess_t postprocess,
+                         void* user_data,
+                         unsigned int report_interval);
+
+/**
+ * @brief Stop the worker thread when it has post-processed the slots pushed to it.
+ *
+ * @param pipeline The pipeline to destroy, can be NULL.
+ */
+void pipeline_destroy(pipeline_t* pipeline);
+
+/**
+ * @brief Hand a slot whose larod jobs are done to the worker.
+ *
+ * The slot must not be reused until it is returned by pipeline_pop_done.
+ */
+void pipeline_push(pipeline_t* pipeline, size_t slot);
+
+/**
+ * @brief Get the fd that is readable when the worker is done with a slot.
+ */
+int pipeline_get_done_fd(pipeline_t* pipeline);
+
+/**
+ * @brief Get a slot the worker is done with, blocks until there is one.
+ *
+ * @param pipeline        The pipeline to be used
+ * @param postprocess_ms  Set to the time the worker spent on the slot
+ * @return The slot.
+ */
+size_t pipeline_pop_done(pipeline_t* pipeline, unsigned int* postprocess_ms);
+
+/**
+ * @brief Add to the busy time of a stage.
+ */
+void pipeline_add_busy(pipeline_t* pipeline, pipeline_stage_t stage, int64_t busy_us);
+
+/**
+ * @brief Count a frame that went through all stages.
+ *
+ * Logs the share of the time each stage was busy every report_interval frames.
+ * A stage close to 100% limits the framerate of the pipeline.
+ */
+void pipeline_frame_done(pipeline_t* pipeline);
@@ -0,0 +1,407 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This file handles the YOLOv5-specific parsing of the model output.
+ */
+
+#include "postprocessing.h"
+
+#include "argmax.h"
+#include "panic.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct scored_index {
+    float score;
+    size_t idx;
+};
+
+// Sort by descending score, ties are kept in tensor order
+static int compare_scored_index(const void* a, const void* b) {
+    const struct scored_index* lhs = a;
+    const struct scored_index* rhs = b;
+    if (lhs->score > rhs->score) {
+        return -1;
+    }
+    if (lhs->score < rhs->score) {
+        return 1;
+    }
+    return (lhs->idx > rhs->idx) - (lhs->idx < rhs->idx);
+}
+
+static float intersection_over_union(const detection_candidates_t* candidates,
+                                     size_t i,
+                                     size_t j) {
+    float xx1 = fmaxf(candidates->x1[i], candidates->x1[j]);
+    float yy1 = fmaxf(candidates->y1[i], candidates->y1[j]);
+    float xx2 = fminf(candidates->x2[i], candidates->x2[j]);
+    float yy2 = fminf(candidates->y2[i], candidates->y2[j]);
+
+    float inter_area = fmaxf(0, xx2 - xx1) * fmaxf(0, yy2 - yy1);
+    float union_area = candidates->area[i] + candidates->area[j] - inter_area;
+
+    return inter_area / union_area;
+}
+
+unsigned int quantize_threshold(float threshold, const model_params_t* model_params) {
+    // Dequantization is monotonic so the first raw value that passes is the threshold.
+    // Evaluate the same expression as the dequantization to get identical results.
+    for (unsigned int raw = 0; raw <= UINT8_MAX; raw++) {
+        float value = ((float)raw - model_params->quantization_zero_point) *
+                      model_params->quantization_scale;
+        if (value >= threshold) {
+            return raw;
+        }
+    }
+    return UINT8_MAX + 1;
+}
+
+size_t collect_candidates(const uint8_t* tensor,
+                          unsigned int raw_threshold,
+                          const model_params_t* model_params,
+                          detection_candidates_t* candidates) {
+    int size_per_detection = model_params->size_per_detection;
+    float qt_zero_point    = model_params->quantization_zero_point;
+    float qt_scale         = model_params->quantization_scale;
+
+    candidates->count = 0;
+
+    const uint8_t* row = tensor;
+    for (int i = 0; i < model_params->num_detections; i++, row += size_per_detection) {
+        // Only the object likelihood is read for the rows that are discarded
+        if (row[4] < raw_threshold) {
+            continue;
+        }
+        if (candidates->count == candidates->capacity) {
+            break;
+        }
+
+        float x = (row[0] - qt_zero_point) * qt_scale;
+        float y = (row[1] - qt_zero_point) * qt_scale;
+        float w = (row[2] - qt_zero_point) * qt_scale;
+        float h = (row[3] - qt_zero_point) * qt_scale;
+
+        size_t n             = candidates->count++;
+        candidates->x1[n]    = x - (w / 2);
+        candidates->y1[n]    = y - (h / 2);
+        candidates->x2[n]    = x + (w / 2);
+        candidates->y2[n]    = y + (h / 2);
+        candidates->area[n]  = w * h;
+        candidates->score[n] = (row[4] - qt_zero_point) * qt_scale;
+        candidates->row[n]   = i;
+    }
+
+    return candidates->count;
+}
+
+void classify_candidates(const uint8_t* tensor,
+                         const model_params_t* model_params,
+                         detection_candidates_t* candidates) {
+    int size_per_detection = model_params->size_per_detection;
+    float qt_zero_point    = model_params->quantization_zero_point;
+    float qt_scale         = model_params->quantization_scale;
+
+    for (size_t i = 0; i < candidates->count; i++) {
+        const uint8_t* class_likelihoods =
+            tensor + (size_t)size_per_detection * candidates->row[i] + 5;
+
+        // Find what class this object is on the raw values, only the winner is dequantized
+        size_t label_idx       = argmax_u8(class_likelihoods, model_params->num_classes);
+        float class_likelihood = (class_likelihoods[label_idx] - qt_zero_point) * qt_scale;
+        if (class_likelihood > 0.0) {
+            candidates->class_likelihood[i] = class_likelihood;
+            candidates->class_idx[i]        = (int)label_idx;
+        } else {
+            candidates->class_likelihood[i] = 0.0;
+            candidates->class_idx[i]        = 0;
+        }
+    }
+}
+
+size_t append_tile_candidates(const detection_candidates_t* tile,
+                              float offset_x,
+                              float offset_y,
+                              float scale_x,
+                              float scale_y,
+                              detection_candidates_t* frame) {
+    for (size_t i = 0; i < tile->count && frame->count < frame->capacity; i++) {
+        size_t n                   = frame->count++;
+        frame->x1[n]               = offset_x + tile->x1[i] * scale_x;
+        frame->y1[n]               = offset_y + tile->y1[i] * scale_y;
+        frame->x2[n]               = offset_x + tile->x2[i] * scale_x;
+        frame->y2[n]               = offset_y + tile->y2[i] * scale_y;
+        frame->area[n]             = tile->area[i] * scale_x * scale_y;
+        frame->score[n]            = tile->score[i];
+        frame->class_likelihood[n] = tile->class_likelihood[i];
+        frame->class_idx[n]        = tile->class_idx[i];
+        frame->row[n]              = tile->row[i];
+    }
+    return frame->count;
+}
+
+static bool suppresses(const detection_candidates_t* candidates,
+                       const nms_params_t* params,
+                       size_t i,
+                       size_t j) {
+    if (params->class_aware && candidates->class_idx[i] != candidates->class_idx[j]) {
+        return false;
+    }
+    return intersection_over_union(candidates, i, j) > params->iou_threshold;
+}
+
+static void exhaustive_nms(detection_candidates_t* candidates, const nms_params_t* params) {
+    size_t count               = candidates->count;
+    struct scored_index* order = candidates->order;
+
+    for (size_t k = 0; k < count; k++) {
+        size_t i = order[k].idx;
+        if (candidates->suppressed[i]) {
+            continue;
+        }
+
+        candidates->keep[candidates->num_keep++] = i;
+        if (candidates->num_keep == params->max_detections) {
+            break;
+        }
+
+        // Suppress the remaining boxes with a lower score that overlap too much
+        for (size_t l = k + 1; l < count; l++) {
+            size_t j = order[l].idx;
+            if (!candidates->suppressed[j] && suppresses(candidates, params, i, j)) {
+                candidates->suppressed[j] = true;
+            }
+        }
+    }
+}
+
+// Range of grid cells covered by [lo, hi], clamped to the grid
+static void cell_range(float lo, float hi, size_t dim, size_t* first, size_t* last) {
+    float f = floorf(lo * (float)dim);
+    float l = floorf(hi * (float)dim);
+
+    *first = f < 0 ? 0 : (f >= (float)dim ? dim - 1 : (size_t)f);
+    *last  = l < 0 ? 0 : (l >= (float)dim ? dim - 1 : (size_t)l);
+}
+
+// Pick the cell size close to the mean box size so that each box covers a few cells
+static size_t grid_dim(const float* lo, const float* hi, size_t count) {
+    float sum = 0;
+    for (size_t i = 0; i < count; i++) {
+        sum += fmaxf(hi[i] - lo[i], 0);
+    }
+    float mean = sum / count;
+    if (mean * NMS_GRID_MAX_DIM <= 1) {
+        return NMS_GRID_MAX_DIM;
+    }
+    return mean >= 1 ? 1 : (size_t)(1 / mean);
+}
+
+static void build_grid(detection_candidates_t* candidates, size_t dim_x, size_t dim_y) {
+    size_t count               = candidates->count;
+    struct scored_index* order = candidates->order;
+    size_t num_cells           = dim_x * dim_y;
+    size_t x_first, x_last, y_first, y_last;
+
+    // Count the entries of each cell
+    memset(candidates->cell_start, 0, (num_cells + 1) * sizeof(size_t));
+    for (size_t i = 0; i < count; i++) {
+        if (candidates->x1[i] > candidates->x2[i] || candidates->y1[i] > candidates->y2[i]) {
+            continue;  // A box with negative size can not overlap any other box
+        }
+        cell_range(candidates->x1[i], candidates->x2[i], dim_x, &x_first, &x_last);
+        cell_range(candidates->y1[i], candidates->y2[i], dim_y, &y_first, &y_last);
+        for (size_t cy = y_first; cy <= y_last; cy++) {
+            for (size_t cx = x_first; cx <= x_last; cx++) {
+                candidates->cell_start[cy * dim_x + cx + 1]++;
+            }
+        }
+    }
+    for (size_t c = 0; c < num_cells; c++) {
+        candidates->cell_start[c + 1] += candidates->cell_start[c];
+        candidates->cell_fill[c] = candidates->cell_start[c];
+    }
+
+    size_t num_entries = candidates->cell_start[num_cells];
+    if (num_entries > candidates->cell_entries_capacity) {
+        free(candidates->cell_entries);
+        candidates->cell_entries = malloc(num_entries * sizeof(size_t));
+        if (!candidates->cell_entries) {
+            panic("%s: Unable to allocate grid cells: %s", __func__, strerror(errno));
+        }
+        candidates->cell_entries_capacity = num_entries;
+    }
+
+    // Insert in score order so that each cell is sorted by rank
+    for (size_t k = 0; k < count; k++) {
+        size_t i = order[k].idx;
+        if (candidates->x1[i] > candidates->x2[i] || candidates->y1[i] > candidates->y2[i]) {
+            continue;
+        }
+        cell_range(candidates->x1[i], candidates->x2[i], dim_x, &x_first, &x_last);
+        cell_range(candidates->y1[i], candidates->y2[i], dim_y, &y_first, &y_last);
+        for (size_t cy = y_first; cy <= y_last; cy++) {
+            for (size_t cx = x_first; cx <= x_last; cx++) {
+                candidates->cell_entries[candidates->cell_fill[cy * dim_x + cx]++] = i;
+            }
+        }
+    }
+}
+
+static void grid_nms(detection_candidates_t* candidates, const nms_params_t* params) {
+    size_t count               = candidates->count;
+    struct scored_index* order = candidates->order;
+    size_t dim_x               = grid_dim(candidates->x1, candidates->x2, count);
+    size_t dim_y               = grid_dim(candidates->y1, candidates->y2, count);
+    size_t x_first, x_last, y_first, y_last;
+
+    for (size_t k = 0; k < count; k++) {
+        candidates->rank[order[k].idx] = k;
+    }
+    build_grid(candidates, dim_x, dim_y);
+
+    for (size_t k = 0; k < count; k++) {
+        size_t i = order[k].idx;
+        if (candidates->suppressed[i]) {
+            continue;
+        }
+
+        candidates->keep[candidates->num_keep++] = i;
+        if (candidates->num_keep == params->max_detections) {
+            break;
+        }
+        if (candidates->x1[i] > candidates->x2[i] || candidates->y1[i] > candidates->y2[i]) {
+            continue;
+        }
+
+        // A box can be in several of the cells, only compare it once
+        if (++candidates->visit_stamp == 0) {
+            memset(candidates->visited, 0, candidates->capacity * sizeof(uint32_t));
+            candidates->visit_stamp = 1;
+        }
+
+        // Suppress the remaining boxes with a lower score in the same cells that overlap too much
+        cell_range(candidates->x1[i], candidates->x2[i], dim_x, &x_first, &x_last);
+        cell_range(candidates->y1[i], candidates->y2[i], dim_y, &y_first, &y_last);
+        for (size_t cy = y_first; cy <= y_last; cy++) {
+            for (size_t cx = x_first; cx <= x_last; cx++) {
+                size_t cell = cy * dim_x + cx;
+                for (size_t e = candidates->cell_start[cell]; e < candidates->cell_start[cell + 1];
+                     e++) {
+                    size_t j = candidates->cell_entries[e];
+                    if (candidates->rank[j] <= k ||
+                        candidates->visited[j] == candidates->visit_stamp) {
+                        continue;
+                    }
+                    candidates->visited[j] = candidates->visit_stamp;
+                    if (!candidates->suppressed[j] && suppresses(candidates, params, i, j)) {
+                        candidates->suppressed[j] = true;
+                    }
+                }
+            }
+        }
+    }
+}
+
+size_t non_maximum_suppression(detection_candidates_t* candidates, const nms_params_t* params) {
+    size_t count               = candidates->count;
+    struct scored_index* order = candidates->order;
+
+    candidates->num_keep = 0;
+    if (count == 0 || params->max_detections == 0) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        order[i].score            = candidates->score[i];
+        order[i].idx              = i;
+        candidates->suppressed[i] = false;
+    }
+    qsort(order, count, sizeof(*order), compare_scored_index);
+
+    switch (params->method) {
+        case NMS_METHOD_GRID:
+            grid_nms(candidates, params);
+            break;
+        case NMS_METHOD_EXHAUSTIVE:
+        default:
+            exhaustive_nms(candidates, params);
+            break;
+    }
+
+    return candidates->num_keep;
+}
+
+detection_candidates_t* create_detection_candidates(size_t capacity) {
+    detection_candidates_t* candidates = calloc(1, sizeof(detection_candidates_t));
+    if (!candidates) {
+        panic("%s: Unable to allocate detection_candidates_t: %s", __func__, strerror(errno));
+    }
+
+    candidates->x1               = malloc(capacity * sizeof(float));
+    candidates->y1               = malloc(capacity * sizeof(float));
+    candidates->x2               = malloc(capacity * sizeof(float));
+    candidates->y2               = malloc(capacity * sizeof(float));
+    candidates->area             = malloc(capacity * sizeof(float));
+    candidates->score            = malloc(capacity * sizeof(float));
+    candidates->class_likelihood = malloc(capacity * sizeof(float));
+    candidates->class_idx        = malloc(capacity * sizeof(int));
+    candidates->row              = malloc(capacity * sizeof(int));
+    candidates->keep             = malloc(capacity * sizeof(size_t));
+    candidates->order            = malloc(capacity * sizeof(struct scored_index));
+    candidates->rank             = malloc(capacity * sizeof(size_t));
+    candidates->suppressed       = malloc(capacity * sizeof(bool));
+    candidates->cell_start = malloc((NMS_GRID_MAX_DIM * NMS_GRID_MAX_DIM + 1) * sizeof(size_t));
+    candidates->cell_fill  = malloc(NMS_GRID_MAX_DIM * NMS_GRID_MAX_DIM * sizeof(size_t));
+    candidates->visited    = calloc(capacity, sizeof(uint32_t));
+    if (!candidates->x1 || !candidates->y1 || !candidates->x2 || !candidates->y2 ||
+        !candidates->area || !candidates->score || !candidates->class_likelihood ||
+        !candidates->class_idx || !candidates->row || !candidates->keep || !candidates->order ||
+        !candidates->rank || !candidates->suppressed || !candidates->cell_start ||
+        !candidates->cell_fill || !candidates->visited) {
+        panic("%s: Unable to allocate candidates: %s", __func__, strerror(errno));
+    }
+    candidates->capacity = capacity;
+
+    return candidates;
+}
+
+void destroy_detection_candidates(detection_candidates_t* candidates) {
+    if (!candidates) {
+        return;
+    }
+    free(candidates->x1);
+    free(candidates->y1);
+    free(candidates->x2);
+    free(candidates->y2);
+    free(candidates->area);
+    free(candidates->score);
+    free(candidates->class_likelihood);
+    free(candidates->class_idx);
+    free(candidates->row);
+    free(candidates->keep);
+    free(candidates->order);
+    free(candidates->rank);
+    free(candidates->suppressed);
+    free(candidates->cell_start);
+    free(candidates->cell_fill);
+    free(candidates->cell_entries);
+    free(candidates->visited);
+    free(candidates);
+}
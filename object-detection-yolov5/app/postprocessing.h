@@ -0,0 +1,206 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This header file handles the YOLOv5-specific parsing of the model output.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct model_params {
+    int input_width;
+    int input_height;
+    float quantization_scale;
+    float quantization_zero_point;
+    int num_classes;
+    int num_detections;
+    int size_per_detection;
+} model_params_t;
+
+/// Largest number of grid cells along each axis for NMS_METHOD_GRID
+#define NMS_GRID_MAX_DIM (32)
+
+typedef enum nms_method {
+    /// Compare every kept box against all remaining boxes
+    NMS_METHOD_EXHAUSTIVE,
+    /// Only compare boxes that share a cell in a uniform grid, gives the same result
+    NMS_METHOD_GRID,
+} nms_method_t;
+
+/**
+ * @brief Settings for non_maximum_suppression.
+ */
+typedef struct nms_params {
+    nms_method_t method;
+    /// IoU above which the lower scored of two detections is suppressed
+    float iou_threshold;
+    /// Only let detections of the same class suppress each other
+    bool class_aware;
+    /// Stop when this many detections have been kept
+    size_t max_detections;
+} nms_params_t;
+
+/**
+ * @brief Struct-of-arrays table of detections whose object likelihood passed the threshold.
+ *
+ * Only the rows that pass the threshold are dequantized into this table, all
+ * other rows of the output tensor are left untouched. The box corners are not
+ * clipped so they can be used for IoU calculations directly. All arrays are
+ * allocated once with room for capacity detections.
+ */
+typedef struct detection_candidates {
+    float* x1;
+    float* y1;
+    float* x2;
+    float* y2;
+    float* area;
+    /// Object likelihood, used as score when suppressing overlapping boxes
+    float* score;
+    float* class_likelihood;
+    int* class_idx;
+    /// Row index of the detection in the output tensor
+    int* row;
+
+    size_t count;
+    size_t capacity;
+
+    /// Candidate indices kept by non_maximum_suppression, highest score first
+    size_t* keep;
+    size_t num_keep;
+
+    // Scratch space for non_maximum_suppression
+    struct scored_index* order;
+    size_t* rank;
+    bool* suppressed;
+
+    // Scratch space for the grid of NMS_METHOD_GRID. The candidates in cell c
+    // are cell_entries[cell_start[c]] to cell_entries[cell_start[c + 1] - 1].
+    size_t* cell_start;
+    size_t* cell_fill;
+    size_t* cell_entries;
+    size_t cell_entries_capacity;
+    uint32_t* visited;
+    uint32_t visit_stamp;
+} detection_candidates_t;
+
+/**
+ * @brief Convert a dequantized threshold to the raw uint8 domain of the output.
+ *
+ * The returned value is the smallest raw value that dequantizes to at least
+ * threshold, so that comparing raw bytes gives the same result as comparing
+ * dequantized values. If no raw value reaches the threshold 256 is returned.
+ *
+ * @param threshold    Dequantized threshold in the range [0.0,1.0]
+ * @param model_params Quantization parameters of the model
+ *
+ * @return Raw threshold to compare output bytes against
+ */
+unsigned int quantize_threshold(float threshold, const model_params_t* model_params);
+
+/**
+ * @brief Scan the object likelihood of every row and collect the candidates.
+ *
+ * Only the object likelihood byte of each row is read. Rows that reach
+ * raw_threshold have their box dequantized and appended to candidates.
+ * Rows beyond the capacity of candidates are dropped.
+ *
+ * @param tensor        Raw output tensor from the model
+ * @param raw_threshold Threshold from quantize_threshold
+ * @param model_params  Shape and quantization parameters of the model
+ * @param candidates    List to fill, any previous content is discarded
+ *
+ * @return Number of collected candidates
+ */
+size_t collect_candidates(const uint8_t* tensor,
+                          unsigned int raw_threshold,
+                          const model_params_t* model_params,
+                          detection_candidates_t* candidates);
+
+/**
+ * @brief Find the most likely class of every candidate.
+ *
+ * @param tensor       Raw output tensor from the model
+ * @param model_params Shape and quantization parameters of the model
+ * @param candidates   Candidates from collect_candidates
+ */
+void classify_candidates(const uint8_t* tensor,
+                         const model_params_t* model_params,
+                         detection_candidates_t* candidates);
+
+/**
+ * @brief Append classified candidates of one tile to the candidates of the whole frame.
+ *
+ * The boxes are mapped from the normalized coordinates of the tile to the
+ * normalized coordinates of the frame, so that non_maximum_suppression on the
+ * frame list also merges the duplicates of objects seen by overlapping tiles.
+ * Candidates beyond the capacity of frame are dropped.
+ *
+ * @param tile     Candidates from classify_candidates on the output of one tile
+ * @param offset_x Left edge of the tile in the frame, normalized
+ * @param offset_y Top edge of the tile in the frame, normalized
+ * @param scale_x  Width of the tile relative to the frame
+ * @param scale_y  Height of the tile relative to the frame
+ * @param frame    List to append to
+ *
+ * @return Number of candidates in frame
+ */
+size_t append_tile_candidates(const detection_candidates_t* tile,
+                              float offset_x,
+                              float offset_y,
+                              float scale_x,
+                              float scale_y,
+                              detection_candidates_t* frame);
+
+/**
+ * @brief Suppress overlapping candidates.
+ *
+ * The candidates are sorted by score once and visited from the highest score.
+ * Each visited candidate that is not yet suppressed is kept and suppresses all
+ * remaining candidates with an IoU above the threshold. The kept candidates
+ * are stored in candidates->keep.
+ *
+ * With NMS_METHOD_GRID each candidate is inserted in all cells of a uniform
+ * grid that it overlaps, and a kept candidate is only compared against the
+ * candidates in its own cells. Boxes that do not overlap have an IoU of zero,
+ * so the result is the same as for NMS_METHOD_EXHAUSTIVE.
+ *
+ * @param candidates Candidates from classify_candidates
+ * @param params     IoU threshold, class mode and max number of detections
+ *
+ * @return Number of kept candidates
+ */
+size_t non_maximum_suppression(detection_candidates_t* candidates, const nms_params_t* params);
+
+/**
+ * @brief Allocate a candidate list.
+ *
+ * @param capacity Maximum number of candidates, normally the number of
+ *                 detections of the model.
+ *
+ * @return Pointer to new candidate list
+ */
+detection_candidates_t* create_detection_candidates(size_t capacity);
+
+/**
+ * @brief Free a candidate list.
+ *
+ * @param candidates Candidate list to be destroyed
+ */
+void destroy_detection_candidates(detection_candidates_t* candidates);
@@ -0,0 +1,99 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "tiling.h"
+
+#include <syslog.h>
+
+// Number of tile lengths that fit n tiles overlapping with the given share
+static float tile_spans(unsigned int n, float overlap) {
+    return (float)n - (float)(n - 1) * overlap;
+}
+
+static unsigned int round_down_even(float value) {
+    return ((unsigned int)value) & ~1u;
+}
+
+// Split one axis of the frame into n overlapping segments aligned to both edges
+static void split_axis(unsigned int length,
+                       unsigned int n,
+                       float overlap,
+                       unsigned int* starts,
+                       unsigned int* size) {
+    if (n == 1) {
+        *size     = length;
+        starts[0] = 0;
+        return;
+    }
+    *size = round_down_even((float)length / tile_spans(n, overlap));
+    // Spread the rounding over the steps so the last segment ends at the edge
+    float step = (float)(length - *size) / (float)(n - 1);
+    for (unsigned int i = 0; i < n; i++) {
+        starts[i] = round_down_even((float)i * step);
+    }
+    starts[n - 1] = length - *size;
+}
+
+void tiling_stream_size(unsigned int model_width,
+                        unsigned int model_height,
+                        unsigned int columns,
+                        unsigned int rows,
+                        float overlap,
+                        unsigned int* width,
+                        unsigned int* height) {
+    *width  = (unsigned int)((float)model_width * tile_spans(columns, overlap) + 0.5f);
+    *height = (unsigned int)((float)model_height * tile_spans(rows, overlap) + 0.5f);
+}
+
+bool tiling_split(unsigned int stream_width,
+                  unsigned int stream_height,
+                  unsigned int columns,
+                  unsigned int rows,
+                  float overlap,
+                  tile_t* tiles) {
+    unsigned int xs[TILING_MAX_DIM];
+    unsigned int ys[TILING_MAX_DIM];
+    unsigned int tile_width  = 0;
+    unsigned int tile_height = 0;
+
+    if (columns < 1 || columns > TILING_MAX_DIM || rows < 1 || rows > TILING_MAX_DIM) {
+        syslog(LOG_ERR, "%s: Invalid number of tiles %u x %u", __func__, columns, rows);
+        return false;
+    }
+    if (overlap < 0.0f || overlap > 0.5f) {
+        syslog(LOG_ERR, "%s: Invalid tile overlap %f", __func__, overlap);
+        return false;
+    }
+
+    split_axis(stream_width, columns, overlap, xs, &tile_width);
+    split_axis(stream_height, rows, overlap, ys, &tile_height);
+
+    for (unsigned int r = 0; r < rows; r++) {
+        for (unsigned int c = 0; c < columns; c++) {
+            tile_t* tile      = &tiles[r * columns + c];
+            tile->x           = xs[c];
+            tile->y           = ys[r];
+            tile->width       = tile_width;
+            tile->height      = tile_height;
+            tile->norm_x      = (float)tile->x / (float)stream_width;
+            tile->norm_y      = (float)tile->y / (float)stream_height;
+            tile->norm_width  = (float)tile->width / (float)stream_width;
+            tile->norm_height = (float)tile->height / (float)stream_height;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,86 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This header file splits a frame into overlapping tiles that are analyzed one by one
+ * at the model resolution, so small objects keep more pixels than when the whole frame
+ * is scaled down to the model input.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/// Largest number of tiles along each axis
+#define TILING_MAX_DIM (4)
+
+/**
+ * @brief A tile in stream pixels, and the same area normalized to the frame.
+ */
+typedef struct tile {
+    unsigned int x;
+    unsigned int y;
+    unsigned int width;
+    unsigned int height;
+
+    float norm_x;
+    float norm_y;
+    float norm_width;
+    float norm_height;
+} tile_t;
+
+/**
+ * @brief Get the stream size where every tile has the model resolution.
+ *
+ * @param model_width  Width of the model input
+ * @param model_height Height of the model input
+ * @param columns      Number of tiles horizontally
+ * @param rows         Number of tiles vertically
+ * @param overlap      Share of a tile that overlaps its neighbor, in the range [0.0,0.5]
+ * @param width        Set to the stream width to request
+ * @param height       Set to the stream height to request
+ */
+void tiling_stream_size(unsigned int model_width,
+                        unsigned int model_height,
+                        unsigned int columns,
+                        unsigned int rows,
+                        float overlap,
+                        unsigned int* width,
+                        unsigned int* height);
+
+/**
+ * @brief Split a frame into columns x rows overlapping tiles.
+ *
+ * The tiles are stored row by row. Neighboring tiles overlap with the given
+ * share of a tile and the outer tiles are aligned to the frame edges. The
+ * positions and sizes are even so they can be used as crops of NV12 frames.
+ *
+ * @param stream_width  Width of the frame
+ * @param stream_height Height of the frame
+ * @param columns       Number of tiles horizontally
+ * @param rows          Number of tiles vertically
+ * @param overlap       Share of a tile that overlaps its neighbor, in the range [0.0,0.5]
+ * @param tiles         Array with room for columns * rows tiles
+ *
+ * @return False if the arguments are out of range
+ */
+bool tiling_split(unsigned int stream_width,
+                  unsigned int stream_height,
+                  unsigned int columns,
+                  unsigned int rows,
+                  float overlap,
+                  tile_t* tiles);
@@ -20,15 +20,18 @@
 
 #include "argparse.h"
 
+#include "attention.h"
 #include "panic.h"
 
 #include <argp.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define KEY_USAGE (127)
 
 static int parse_pos_int(char* arg, unsigned long long* i, unsigned long long limit);
 static int parse_opt(int key, char* arg, struct argp_state* state);
+static int parse_channels(char* arg, args_t* args);
 
 const struct argp_option opts[] = {
     {"device",
@@ -37,6 +40,49 @@ const struct argp_option opts[] = {
      0,
      "Could be axis-a8-dlpu-tflite, a9-dlpu-tflite, google-edge-tpu-tflite or cpu-tflite",
      0},
+    {"channels",
+     'c',
+     "CHANNELS",
+     0,
+     "Comma separated list of channels to run detection on, e.g. 1,2,3,4. A channel can be "
+     "given a weight for the weighted policy as CHANNEL:WEIGHT, e.g. 1:3,2:1. Default is 1.",
+     0},
+    {"schedule",
+     's',
+     "POLICY",
+     0,
+     "How the channels share the model: round-robin, weighted or least-recently-served. "
+     "Default is round-robin.",
+     0},
+    {"batch-wait",
+     'w',
+     "MS",
+     0,
+     "Max time in ms to wait for frames from the other channels once the first frame of a "
+     "batch has been fetched. Only used with models that have a batch size above one. "
+     "Default is 20.",
+     0},
+    {"full-frame-interval",
+     'f',
+     "FRAMES",
+     0,
+     "Analyze the whole frame every FRAMES frames, and the frames in between only in crops "
+     "around the detections of the previous frame. Default is 1, every frame in full.",
+     0},
+    {"crop-padding",
+     'p',
+     "PERCENT",
+     0,
+     "Share in percent of the size of a detection that its crop is padded with on each side. "
+     "Default is 50.",
+     0},
+    {"max-crops",
+     'm',
+     "CROPS",
+     0,
+     "Max number of crops analyzed in one frame, at most the batch size of the model. "
+     "Default is 3.",
+     0},
     {"help", 'h', NULL, 0, "Print this help text and exit.", 0},
     {"usage", KEY_USAGE, NULL, 0, "Print short usage message and exit.", 0},
     {0}};
@@ -70,6 +116,54 @@ int parse_opt(int key, char* arg, struct argp_state* state) {
         case 'd':
             args->device_name = arg;
             break;
+        case 'c': {
+            int ret = parse_channels(arg, args);
+            if (ret) {
+                argp_failure(state, EXIT_FAILURE, ret, "invalid channels");
+            }
+            break;
+        }
+        case 's':
+            if (!scheduler_policy_from_string(arg, &args->policy)) {
+                argp_failure(state, EXIT_FAILURE, EINVAL, "invalid schedule policy");
+            }
+            break;
+        case 'w': {
+            unsigned long long batch_wait_ms;
+            int ret = parse_pos_int(arg, &batch_wait_ms, INT_MAX / 1000);
+            if (ret) {
+                argp_failure(state, EXIT_FAILURE, ret, "invalid batch wait");
+            }
+            args->batch_wait_ms = (unsigned int)batch_wait_ms;
+            break;
+        }
+        case 'f': {
+            unsigned long long full_frame_interval;
+            int ret = parse_pos_int(arg, &full_frame_interval, 100);
+            if (ret) {
+                argp_failure(state, EXIT_FAILURE, ret, "invalid full frame interval");
+            }
+            args->full_frame_interval = (unsigned int)full_frame_interval;
+            break;
+        }
+        case 'p': {
+            unsigned long long crop_padding_percent;
+            int ret = parse_pos_int(arg, &crop_padding_percent, 200);
+            if (ret) {
+                argp_failure(state, EXIT_FAILURE, ret, "invalid crop padding");
+            }
+            args->crop_padding_percent = (unsigned int)crop_padding_percent;
+            break;
+        }
+        case 'm': {
+            unsigned long long max_crops;
+            int ret = parse_pos_int(arg, &max_crops, ATTENTION_MAX_CROPS);
+            if (ret) {
+                argp_failure(state, EXIT_FAILURE, ret, "invalid max crops");
+            }
+            args->max_crops = (unsigned int)max_crops;
+            break;
+        }
         case 'h':
             argp_state_help(state, stdout, ARGP_HELP_STD_HELP);
             break;
@@ -93,10 +187,18 @@ int parse_opt(int key, char* arg, struct argp_state* state) {
             }
             break;
         case ARGP_KEY_INIT:
-            args->threshold   = 0;
-            args->device_name = NULL;
-            args->model_file  = NULL;
-            args->labels_file = NULL;
+            args->threshold            = 0;
+            args->device_name          = NULL;
+            args->model_file           = NULL;
+            args->labels_file          = NULL;
+            args->channels[0]          = 1;
+            args->weights[0]           = 1;
+            args->num_channels         = 1;
+            args->policy               = SCHEDULER_ROUND_ROBIN;
+            args->batch_wait_ms        = 20;
+            args->full_frame_interval  = 1;
+            args->crop_padding_percent = 50;
+            args->max_crops            = 3;
             break;
         case ARGP_KEY_END:
             if (state->arg_num < 1 || state->arg_num > 3) {
@@ -133,3 +235,53 @@ static int parse_pos_int(char* arg, unsigned long long* i, unsigned long long li
 
     return 0;
 }
+
+/**
+ * brief Parses a comma separated list of channels with optional weights
+ *
+ * param arg String to parse, e.g. "1:3,2".
+ * param args Arguments where the channels and weights are saved.
+ * return Positive errno style return code (zero means success).
+ */
+static int parse_channels(char* arg, args_t* args) {
+    size_t num_channels = 0;
+    char* saveptr       = NULL;
+    char* token         = strtok_r(arg, ",", &saveptr);
+
+    while (token) {
+        unsigned long long channel = 0;
+        unsigned long long weight  = 1;
+        char* weight_str           = strchr(token, ':');
+        int ret;
+
+        if (num_channels == MAX_CHANNELS) {
+            return E2BIG;
+        }
+        if (weight_str) {
+            *weight_str++ = '\0';
+            ret           = parse_pos_int(weight_str, &weight, UINT_MAX);
+            if (ret) {
+                return ret;
+            }
+        }
+        ret = parse_pos_int(token, &channel, UINT32_MAX);
+        if (ret) {
+            return ret;
+        }
+        for (size_t i = 0; i < num_channels; i++) {
+            if (args->channels[i] == channel) {
+                return EINVAL;
+            }
+        }
+        args->channels[num_channels] = (uint32_t)channel;
+        args->weights[num_channels]  = (unsigned int)weight;
+        num_channels++;
+        token = strtok_r(NULL, ",", &saveptr);
+    }
+    if (num_channels == 0) {
+        return EINVAL;
+    }
+    args->num_channels = num_channels;
+
+    return 0;
+}
@@ -23,12 +23,23 @@
 #include <stddef.h>
 
 #include "larod.h"
+#include "scheduler.h"
+
+#define MAX_CHANNELS (8)
 
 typedef struct args_t {
     char* model_file;
     char* labels_file;
     unsigned threshold;
     char* device_name;
+    uint32_t channels[MAX_CHANNELS];
+    unsigned int weights[MAX_CHANNELS];
+    size_t num_channels;
+    scheduler_policy_t policy;
+    unsigned int batch_wait_ms;
+    unsigned int full_frame_interval;
+    unsigned int crop_padding_percent;
+    unsigned int max_crops;
 } args_t;
 
 void parse_args(int argc, char** argv, args_t* args);
@@ -0,0 +1,241 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "attention.h"
+
+#include <syslog.h>
+
+// An area of the frame in stream pixels
+typedef struct area {
+    float x1;
+    float y1;
+    float x2;
+    float y2;
+} area_t;
+
+static unsigned int round_down_even(float value) {
+    return ((unsigned int)value) & ~1u;
+}
+
+static float area_size(const area_t* area) {
+    return (area->x2 - area->x1) * (area->y2 - area->y1);
+}
+
+static bool areas_overlap(const area_t* a, const area_t* b) {
+    return a->x1 < b->x2 && b->x1 < a->x2 && a->y1 < b->y2 && b->y1 < a->y2;
+}
+
+static area_t area_union(const area_t* a, const area_t* b) {
+    area_t area = {
+        .x1 = a->x1 < b->x1 ? a->x1 : b->x1,
+        .y1 = a->y1 < b->y1 ? a->y1 : b->y1,
+        .x2 = a->x2 > b->x2 ? a->x2 : b->x2,
+        .y2 = a->y2 > b->y2 ? a->y2 : b->y2,
+    };
+    return area;
+}
+
+// Move one axis of an area of the given length inside the frame, keeping its center
+static void fit_axis(float center, float length, float frame, float* start, float* end) {
+    if (length > frame) {
+        length = frame;
+    }
+    *start = center - length / 2.0f;
+    if (*start < 0.0f) {
+        *start = 0.0f;
+    } else if (*start + length > frame) {
+        *start = frame - length;
+    }
+    *end = *start + length;
+}
+
+// Grow an area to the aspect ratio and at least the size of the model input, inside the frame
+static void fit_area(const attention_t* attention, area_t* area) {
+    float model_width  = (float)attention->model_width;
+    float model_height = (float)attention->model_height;
+    float aspect       = model_width / model_height;
+    float width        = area->x2 - area->x1;
+    float height       = area->y2 - area->y1;
+
+    if (width < height * aspect) {
+        width = height * aspect;
+    } else {
+        height = width / aspect;
+    }
+    // The scaled crop would only be upscaled below the model resolution
+    if (width < model_width) {
+        width  = model_width;
+        height = model_height;
+    }
+    fit_axis((area->x1 + area->x2) / 2.0f,
+             width,
+             (float)attention->stream_width,
+             &area->x1,
+             &area->x2);
+    fit_axis((area->y1 + area->y2) / 2.0f,
+             height,
+             (float)attention->stream_height,
+             &area->y1,
+             &area->y2);
+}
+
+// Merge areas that overlap until none do, since an object would otherwise be analyzed twice
+static size_t merge_overlapping(const attention_t* attention, area_t* areas, size_t num_areas) {
+    bool merged = true;
+
+    while (merged) {
+        merged = false;
+        for (size_t i = 0; i < num_areas && !merged; i++) {
+            for (size_t j = i + 1; j < num_areas && !merged; j++) {
+                if (areas_overlap(&areas[i], &areas[j])) {
+                    areas[i] = area_union(&areas[i], &areas[j]);
+                    fit_area(attention, &areas[i]);
+                    areas[j] = areas[--num_areas];
+                    merged   = true;
+                }
+            }
+        }
+    }
+    return num_areas;
+}
+
+// Merge the two areas whose union adds the least area that neither of them covered
+static size_t merge_closest(const attention_t* attention, area_t* areas, size_t num_areas) {
+    size_t best_i   = 0;
+    size_t best_j   = 1;
+    float best_cost = 0.0f;
+
+    for (size_t i = 0; i < num_areas; i++) {
+        for (size_t j = i + 1; j < num_areas; j++) {
+            area_t merged = area_union(&areas[i], &areas[j]);
+            float cost    = area_size(&merged) - area_size(&areas[i]) - area_size(&areas[j]);
+            if ((i == 0 && j == 1) || cost < best_cost) {
+                best_i    = i;
+                best_j    = j;
+                best_cost = cost;
+            }
+        }
+    }
+    areas[best_i] = area_union(&areas[best_i], &areas[best_j]);
+    fit_area(attention, &areas[best_i]);
+    areas[best_j] = areas[--num_areas];
+    return num_areas;
+}
+
+static void set_crop(const attention_t* attention, const area_t* area, attention_crop_t* crop) {
+    crop->x           = round_down_even(area->x1);
+    crop->y           = round_down_even(area->y1);
+    crop->width       = round_down_even(area->x2 - (float)crop->x);
+    crop->height      = round_down_even(area->y2 - (float)crop->y);
+    crop->norm_x      = (float)crop->x / (float)attention->stream_width;
+    crop->norm_y      = (float)crop->y / (float)attention->stream_height;
+    crop->norm_width  = (float)crop->width / (float)attention->stream_width;
+    crop->norm_height = (float)crop->height / (float)attention->stream_height;
+}
+
+bool attention_init(attention_t* attention,
+                    const attention_params_t* params,
+                    unsigned int stream_width,
+                    unsigned int stream_height,
+                    unsigned int model_width,
+                    unsigned int model_height) {
+    if (params->full_frame_interval < 1) {
+        syslog(LOG_ERR,
+               "%s: Invalid full frame interval %u",
+               __func__,
+               params->full_frame_interval);
+        return false;
+    }
+    if (params->padding < 0.0f || params->padding > 2.0f) {
+        syslog(LOG_ERR, "%s: Invalid crop padding %f", __func__, params->padding);
+        return false;
+    }
+    if (params->max_crops < 1 || params->max_crops > ATTENTION_MAX_CROPS) {
+        syslog(LOG_ERR, "%s: Invalid max number of crops %zu", __func__, params->max_crops);
+        return false;
+    }
+    if (stream_width < 2 || stream_height < 2 || model_width < 1 || model_height < 1) {
+        syslog(LOG_ERR, "%s: Invalid stream or model size", __func__);
+        return false;
+    }
+
+    attention->params         = *params;
+    attention->stream_width   = stream_width;
+    attention->stream_height  = stream_height;
+    attention->model_width    = model_width;
+    attention->model_height   = model_height;
+    attention->num_detections = 0;
+    // The first frame is analyzed in full since nothing has been detected yet
+    attention->frames_since_full = params->full_frame_interval;
+    return true;
+}
+
+size_t attention_plan(const attention_t* attention, attention_crop_t* crops, bool* full_frame) {
+    area_t areas[ATTENTION_MAX_DETECTIONS];
+    size_t num_areas    = 0;
+    float stream_width  = (float)attention->stream_width;
+    float stream_height = (float)attention->stream_height;
+    float padding       = attention->params.padding;
+
+    *full_frame = attention->num_detections == 0 ||
+                  attention->frames_since_full + 1 >= attention->params.full_frame_interval;
+    if (*full_frame) {
+        area_t frame = {0.0f, 0.0f, stream_width, stream_height};
+        set_crop(attention, &frame, &crops[0]);
+        return 1;
+    }
+
+    for (size_t i = 0; i < attention->num_detections; i++) {
+        const float* detection = attention->detections[i];
+        float width            = (detection[2] - detection[0]) * stream_width;
+        float height           = (detection[3] - detection[1]) * stream_height;
+        area_t* area           = &areas[num_areas++];
+
+        area->x1 = detection[0] * stream_width - width * padding;
+        area->y1 = detection[1] * stream_height - height * padding;
+        area->x2 = detection[2] * stream_width + width * padding;
+        area->y2 = detection[3] * stream_height + height * padding;
+        fit_area(attention, area);
+    }
+    num_areas = merge_overlapping(attention, areas, num_areas);
+    while (num_areas > attention->params.max_crops) {
+        num_areas = merge_closest(attention, areas, num_areas);
+        num_areas = merge_overlapping(attention, areas, num_areas);
+    }
+
+    for (size_t i = 0; i < num_areas; i++) {
+        set_crop(attention, &areas[i], &crops[i]);
+    }
+    return num_areas;
+}
+
+void attention_start_frame(attention_t* attention, bool full_frame) {
+    attention->num_detections    = 0;
+    attention->frames_since_full = full_frame ? 0 : attention->frames_since_full + 1;
+}
+
+void attention_add_detection(attention_t* attention, float x1, float y1, float x2, float y2) {
+    // Crops are only planned around the detections that fit, the next full frame finds the rest
+    if (attention->num_detections == ATTENTION_MAX_DETECTIONS) {
+        return;
+    }
+    // Clip the corners to the frame, boxes may reach outside of it
+    float* detection = attention->detections[attention->num_detections++];
+    detection[0]     = x1 < 0.0f ? 0.0f : x1;
+    detection[1]     = y1 < 0.0f ? 0.0f : y1;
+    detection[2]     = x2 > 1.0f ? 1.0f : x2;
+    detection[3]     = y2 > 1.0f ? 1.0f : y2;
+}
@@ -30,6 +30,15 @@
 
 #define MAX_NBR_POWER_RETRIES 50
 
+static int nbr_power_retries = 0;
+
+static larodJobRequest* get_imported_buffer_request(model_provider_t* provider,
+                                                    VdoBuffer* vdo_buf);
+static void release_imported_buffers(model_provider_t* provider);
+static void apply_crop(model_provider_t* provider,
+                       larodJobRequest* req,
+                       unsigned int* crop_version);
+
 bool model_get_tensor_output_info(model_provider_t* provider,
                                   unsigned int tensor_output_index,
                                   model_tensor_output_t* tensor_output) {
@@ -51,27 +60,79 @@ static void model_job_handle_no_power(int* nbr_of_retries) {
     usleep(250 * 1000 * *nbr_of_retries);
 }
 
-bool model_run_inference(model_provider_t* provider, VdoBuffer* vdo_buf) {
-    larodError* error            = NULL;
-    static int nbr_power_retries = 0;
+bool model_batch_add(model_provider_t* provider, VdoBuffer* vdo_buf) {
+    larodError* error = NULL;
+
+    if (provider->batch_count == provider->batch_size) {
+        panic("%s: The batch of %zu frames is already full", __func__, provider->batch_size);
+    }
+    size_t slot_offset = provider->batch_count * provider->batch_slot_size;
 
     uint8_t* data = vdo_buffer_get_data(vdo_buf);
-    memcpy(provider->image_input_addr, data, provider->image_buffer_size);
+    if (!provider->use_preprocessing) {
+        // The frame has the model format so it is copied straight into its place in the batch
+        memcpy((uint8_t*)provider->image_input_addr + slot_offset,
+               data,
+               provider->batch_slot_size);
+        provider->batch_count++;
+        return true;
+    }
+
+    // The preprocessing job reads the frame straight from the vdo buffer if possible. It runs
+    // before the frame is given back to vdo, unlike the inference job of a batch, so this
+    // is the only job that can read from vdo buffers.
+    larodJobRequest* pp_req       = provider->pp_req;
+    larodJobRequest* imported_req = NULL;
+    if (provider->zero_copy) {
+        imported_req = get_imported_buffer_request(provider, vdo_buf);
+    }
+    if (imported_req) {
+        pp_req = imported_req;
+    } else {
+        memcpy(provider->image_input_addr, data, provider->image_buffer_size);
+        apply_crop(provider, pp_req, &provider->pp_crop_version);
+    }
     // If the inference failed because of no power no need to run
     // the preprocssing job again
-    if (provider->use_preprocessing) {
-        if (!larodRunJob(provider->conn, provider->pp_req, &error)) {
-            if (error->code != LAROD_ERROR_POWER_NOT_AVAILABLE) {
-                panic("%s: Unable to run preprocessing job: %s (%d)",
-                      __func__,
-                      error->msg,
-                      error->code);
-            }
+    if (!larodRunJob(provider->conn, pp_req, &error)) {
+        if (imported_req && error->code != LAROD_ERROR_POWER_NOT_AVAILABLE) {
+            syslog(LOG_WARNING,
+                   "%s: Could not run job on vdo buffer, copying the frames instead: %s",
+                   __func__,
+                   error->msg);
             larodClearError(&error);
-            model_job_handle_no_power(&nbr_power_retries);
-            return false;
+            provider->zero_copy = false;
+            release_imported_buffers(provider);
+            return model_batch_add(provider, vdo_buf);
+        }
+        if (error->code != LAROD_ERROR_POWER_NOT_AVAILABLE) {
+            panic("%s: Unable to run preprocessing job: %s (%d)",
+                  __func__,
+                  error->msg,
+                  error->code);
         }
-        nbr_power_retries = 0;
+        larodClearError(&error);
+        provider->batch_count = 0;
+        model_job_handle_no_power(&nbr_power_retries);
+        return false;
+    }
+    nbr_power_retries = 0;
+    // With a batch of one the preprocessing output is the model input
+    if (provider->batch_size > 1) {
+        memcpy((uint8_t*)provider->batch_input_addr + slot_offset,
+               provider->pp_output_addr,
+               provider->batch_slot_size);
+    }
+    provider->batch_count++;
+    return true;
+}
+
+bool model_batch_run(model_provider_t* provider) {
+    larodError* error = NULL;
+
+    provider->batch_results = 0;
+    if (provider->batch_count == 0) {
+        return true;
     }
 
     if (!larodRunJob(provider->conn, provider->inf_req, &error)) {
@@ -82,15 +143,45 @@ bool model_run_inference(model_provider_t* provider, VdoBuffer* vdo_buf) {
                   error->code);
         }
         larodClearError(&error);
+        provider->batch_count = 0;
         model_job_handle_no_power(&nbr_power_retries);
         return false;
     }
-    nbr_power_retries = 0;
+    nbr_power_retries       = 0;
+    provider->batch_results = provider->batch_count;
+    provider->batch_count   = 0;
+    return true;
+}
+
+bool model_run_inference(model_provider_t* provider, VdoBuffer* vdo_buf) {
+    provider->batch_count = 0;
+    if (!model_batch_add(provider, vdo_buf)) {
+        return false;
+    }
+    return model_batch_run(provider);
+}
+
+bool model_get_batch_output_info(model_provider_t* provider,
+                                 unsigned int tensor_output_index,
+                                 size_t batch_index,
+                                 model_tensor_output_t* tensor_output) {
+    if (batch_index >= provider->batch_results) {
+        panic("%s: Invalid batch index %zu, the batch had %zu results",
+              __func__,
+              batch_index,
+              provider->batch_results);
+    }
+    if (!model_get_tensor_output_info(provider, tensor_output_index, tensor_output)) {
+        return false;
+    }
+    tensor_output->size /= provider->batch_size;
+    tensor_output->data = (uint8_t*)tensor_output->data + batch_index * tensor_output->size;
     return true;
 }
 
 static bool setup_input_tensor_metadata(unsigned int pitch,
                                         unsigned int height,
+                                        size_t batch_size,
                                         larodTensorLayout model_layout,
                                         larodTensor* tensor) {
     larodError* error          = NULL;
@@ -102,21 +193,21 @@ static bool setup_input_tensor_metadata(unsigned int pitch,
             pitches.len        = 3;
             pitches.pitches[2] = pitch;
             pitches.pitches[1] = height * pitches.pitches[2];
-            pitches.pitches[0] = 3 * pitches.pitches[1] / 2;
+            pitches.pitches[0] = batch_size * 3 * pitches.pitches[1] / 2;
             break;
         case LAROD_TENSOR_LAYOUT_NHWC:
             pitches.len        = 4;
             pitches.pitches[3] = 3;
             pitches.pitches[2] = pitch;
             pitches.pitches[1] = height * pitches.pitches[2];
-            pitches.pitches[0] = 1 * pitches.pitches[1];
+            pitches.pitches[0] = batch_size * pitches.pitches[1];
             break;
         case LAROD_TENSOR_LAYOUT_NCHW:
             pitches.len        = 4;
             pitches.pitches[3] = pitch;
             pitches.pitches[2] = height * pitches.pitches[3];
             pitches.pitches[1] = 3 * pitches.pitches[2];
-            pitches.pitches[0] = 1 * pitches.pitches[1];
+            pitches.pitches[0] = batch_size * pitches.pitches[1];
             break;
         default:
             break;
@@ -129,6 +220,111 @@ static bool setup_input_tensor_metadata(unsigned int pitch,
     return true;
 }
 
+/**
+ * @brief Give a preprocessing job request the current crop if it has an older one.
+ */
+static void apply_crop(model_provider_t* provider,
+                       larodJobRequest* req,
+                       unsigned int* crop_version) {
+    larodError* error = NULL;
+
+    if (*crop_version == provider->crop_version) {
+        return;
+    }
+    if (!larodSetJobRequestParams(req, provider->crop_map, &error)) {
+        panic("%s: Failed setting preprocessing crop: %s", __func__, error->msg);
+    }
+    *crop_version = provider->crop_version;
+}
+
+static void release_imported_buffers(model_provider_t* provider) {
+    larodError* error = NULL;
+
+    for (size_t i = 0; i < provider->num_imported_buffers; i++) {
+        model_imported_buffer_t* imported = &provider->imported_buffers[i];
+        larodDestroyJobRequest(&imported->req);
+        larodDestroyTensors(provider->conn, &imported->tensors, imported->num_tensors, &error);
+        larodClearError(&error);
+    }
+    provider->num_imported_buffers = 0;
+}
+
+/**
+ * @brief Get the preprocessing job request that reads the frame straight from a vdo buffer.
+ *
+ * The fd of the vdo buffer is set on a new larod input tensor, and a job request
+ * is created with it the first time a buffer is seen. The request is reused every
+ * time vdo hands out the same buffer again.
+ *
+ * @return NULL if the buffer could not be imported, then the frame has to be copied.
+ */
+static larodJobRequest* get_imported_buffer_request(model_provider_t* provider,
+                                                    VdoBuffer* vdo_buf) {
+    larodError* error                = NULL;
+    uint32_t id                      = vdo_buffer_get_id(vdo_buf);
+    model_imported_buffer_t imported = {.fd           = vdo_buffer_get_fd(vdo_buf),
+                                        .offset       = vdo_buffer_get_offset(vdo_buf),
+                                        .crop_version = provider->crop_version};
+
+    for (size_t i = 0; i < provider->num_imported_buffers; i++) {
+        model_imported_buffer_t* cached = &provider->imported_buffers[i];
+        if (cached->fd == imported.fd && cached->offset == imported.offset) {
+            apply_crop(provider, cached->req, &cached->crop_version);
+            return cached->req;
+        }
+    }
+    if (provider->num_imported_buffers == MODEL_MAX_IMPORTED_BUFFERS) {
+        syslog(LOG_WARNING,
+               "%s: More than %d vdo buffers, copying the frames instead",
+               __func__,
+               MODEL_MAX_IMPORTED_BUFFERS);
+        provider->zero_copy = false;
+        return NULL;
+    }
+
+    // The tensor gets the metadata of the preprocessing input, only the memory is the vdo buffer
+    imported.tensors = larodCreateModelInputs(provider->pp_model, &imported.num_tensors, &error);
+    if (!imported.tensors) {
+        goto error;
+    }
+    if (!larodSetTensorFd(imported.tensors[0], imported.fd, &error) ||
+        !larodSetTensorFdOffset(imported.tensors[0], imported.offset, &error) ||
+        !larodSetTensorFdSize(imported.tensors[0], vdo_buffer_get_capacity(vdo_buf), &error) ||
+        !larodSetTensorFdProps(imported.tensors[0],
+                               LAROD_FD_PROP_DMABUF | LAROD_FD_PROP_MAP,
+                               &error) ||
+        !larodTrackTensor(provider->conn, imported.tensors[0], &error)) {
+        goto error;
+    }
+
+    imported.req = larodCreateJobRequest(provider->pp_model,
+                                         imported.tensors,
+                                         imported.num_tensors,
+                                         provider->pp_output_tensors,
+                                         provider->pp_num_outputs,
+                                         provider->crop_map,
+                                         &error);
+    if (!imported.req) {
+        goto error;
+    }
+
+    provider->imported_buffers[provider->num_imported_buffers++] = imported;
+    syslog(LOG_INFO, "Imported vdo buffer %u as larod input", id);
+    return imported.req;
+
+error:
+    syslog(LOG_WARNING,
+           "%s: Could not import vdo buffer %u, copying the frames instead: %s",
+           __func__,
+           id,
+           error ? error->msg : "unknown error");
+    larodClearError(&error);
+    larodDestroyTensors(provider->conn, &imported.tensors, imported.num_tensors, &error);
+    larodClearError(&error);
+    provider->zero_copy = false;
+    return NULL;
+}
+
 static void setup_tensors(larodConnection* conn,
                           larodModel* model,
                           larodTensor*** input_tensors,
@@ -318,6 +514,9 @@ void model_provider_destroy(model_provider_t* provider) {
         panic("%s: Invalid pointer to model_provider_t", __func__);
     }
 
+    release_imported_buffers(provider);
+    larodDestroyMap(&provider->crop_map);
+    larodDestroyModel(&provider->pp_model);
     larodDestroyModel(&provider->model);
     // Only the model handle is released here. We count on larod service to
     // release the privately loaded model when the session is disconnected in
@@ -333,6 +532,12 @@ void model_provider_destroy(model_provider_t* provider) {
     if (provider->image_input_fd >= 0) {
         close(provider->image_input_fd);
     }
+    if (provider->pp_output_addr) {
+        munmap(provider->pp_output_addr, provider->pp_output_size);
+    }
+    if (provider->batch_input_addr) {
+        munmap(provider->batch_input_addr, provider->batch_input_size);
+    }
     for (size_t i = 0; i < provider->num_outputs; i++) {
         if (provider->model_output_tensors[i].data != MAP_FAILED) {
             munmap(provider->model_output_tensors[i].data, provider->model_output_tensors[i].size);
@@ -380,6 +585,7 @@ model_provider_t* model_provider_new(char* model_file,
     if (!larodConnect(&provider->conn, &error)) {
         panic("%s: Could not connect to larod: %s", __func__, error->msg);
     }
+    provider->zero_copy = true;
 
     provider->model = create_inference_model(provider, model_file, device_name, labels_file);
     setup_tensors(provider->conn,
@@ -402,6 +608,12 @@ model_provider_t* model_provider_new(char* model_file,
     if (!provider->img_info) {
         panic("%s: Unable to allocate img info: %s", __func__, strerror(errno));
     }
+    // Models exported with a batch dimension analyze several frames in one job
+    provider->batch_size = 1;
+    if (input_dims->len == 4 && input_dims->dims[0] > 1) {
+        provider->batch_size = input_dims->dims[0];
+        syslog(LOG_INFO, "Detected model batch size %zu", provider->batch_size);
+    }
     provider->img_info->format = VDO_FORMAT_RGB;
     provider->img_info->width  = input_dims->dims[2];
     provider->img_info->height = input_dims->dims[1];
@@ -443,6 +655,19 @@ model_provider_t* model_provider_new(char* model_file,
             panic("%s: Could not get output tensor data type: %s", __func__, error->msg);
         }
         provider->model_output_tensors[i].datatype = datatype;
+        if (provider->batch_size > 1) {
+            const larodTensorDims* output_dims =
+                larodGetTensorDims(provider->output_tensors[i], &error);
+            if (!output_dims) {
+                panic("%s: Failed retrieving dim for output tensor: %s", __func__, error->msg);
+            }
+            if (output_dims->len == 0 || output_dims->dims[0] != provider->batch_size) {
+                panic("%s: Output %zu does not have the batch size %zu as first dimension",
+                      __func__,
+                      i,
+                      provider->batch_size);
+            }
+        }
         syslog(LOG_INFO, "Created mmaped model output %zu with size %zu", i, output_size);
     }
     *num_output_tensors = provider->num_outputs;
@@ -454,10 +679,29 @@ img_info_t model_provider_get_model_metadata(model_provider_t* provider) {
     return *provider->img_info;
 }
 
+static void* map_tensor(larodTensor* tensor, int prot, size_t* size) {
+    larodError* error = NULL;
+
+    int fd = larodGetTensorFd(tensor, &error);
+    if (fd == LAROD_INVALID_FD) {
+        panic("%s: Could not get tensor fd: %s", __func__, error->msg);
+    }
+    if (!larodGetTensorFdSize(tensor, size, &error)) {
+        panic("%s: Could not get byte size of tensor: %s", __func__, error->msg);
+    }
+    void* addr = mmap(NULL, *size, prot, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        panic("%s: Could not map tensor fd: %s", __func__, strerror(errno));
+    }
+    return addr;
+}
+
 bool model_provider_update_image_metadata(model_provider_t* provider, img_info_t* img_info) {
     larodError* error = NULL;
 
     larodModel* pp_model        = NULL;
+    provider->stream_width      = img_info->width;
+    provider->stream_height     = img_info->height;
     provider->use_preprocessing = false;
     if (img_info->format != provider->img_info->format ||
         provider->img_info->width != img_info->width ||
@@ -505,6 +749,23 @@ bool model_provider_update_image_metadata(model_provider_t* provider, img_info_t
                 panic("%s: Could not map pp input tensors fd: %s", __func__, strerror(errno));
             }
         }
+        if (provider->batch_size > 1) {
+            // The preprocessing output is one frame, it is copied into its place in the
+            // model input batch
+            provider->pp_output_addr   = map_tensor(provider->pp_output_tensors[0],
+                                                  PROT_READ,
+                                                  &provider->pp_output_size);
+            provider->batch_input_addr = map_tensor(provider->input_tensors[0],
+                                                    PROT_READ | PROT_WRITE,
+                                                    &provider->batch_input_size);
+            provider->batch_slot_size  = provider->batch_input_size / provider->batch_size;
+            if (provider->pp_output_size != provider->batch_slot_size) {
+                panic("%s: Preprocessing output size %zu does not match batch frame size %zu",
+                      __func__,
+                      provider->pp_output_size,
+                      provider->batch_slot_size);
+            }
+        }
     } else {
         if (provider->img_info->pitch != img_info->pitch) {
             panic("%s: Incorrect stream pitch %u != %u",
@@ -525,6 +786,7 @@ bool model_provider_update_image_metadata(model_provider_t* provider, img_info_t
         }
         setup_input_tensor_metadata(img_info->pitch,
                                     img_info->height,
+                                    provider->batch_size,
                                     model_layout,
                                     provider->input_tensors[0]);
         // Needed to be used for copying data
@@ -545,6 +807,7 @@ bool model_provider_update_image_metadata(model_provider_t* provider, img_info_t
             if (provider->image_input_addr == MAP_FAILED) {
                 panic("%s: Could not map input tensors fd: %s", __func__, strerror(errno));
             }
+            provider->batch_slot_size = provider->image_buffer_size / provider->batch_size;
         }
     }
 
@@ -555,16 +818,26 @@ bool model_provider_update_image_metadata(model_provider_t* provider, img_info_t
                                                  provider->pp_num_inputs,
                                                  provider->pp_output_tensors,
                                                  provider->pp_num_outputs,
-                                                 NULL,
+                                                 provider->crop_map,
                                                  &error);
         if (!provider->pp_req) {
             panic("%s: Failed creating preprocessing job request: %s", __func__, error->msg);
         }
+        provider->pp_crop_version = provider->crop_version;
+
+        // With a batch of one the model reads the preprocessing output directly,
+        // otherwise the frames are gathered in the model input tensor
+        larodTensor** inf_inputs = provider->pp_output_tensors;
+        size_t inf_num_inputs    = provider->pp_num_outputs;
+        if (provider->batch_size > 1) {
+            inf_inputs     = provider->input_tensors;
+            inf_num_inputs = provider->num_inputs;
+        }
 
         // App supports only one input/output tensor.
         provider->inf_req = larodCreateJobRequest(provider->model,
-                                                  provider->pp_output_tensors,
-                                                  provider->pp_num_outputs,
+                                                  inf_inputs,
+                                                  inf_num_inputs,
                                                   provider->output_tensors,
                                                   provider->num_outputs,
                                                   NULL,
@@ -586,7 +859,55 @@ bool model_provider_update_image_metadata(model_provider_t* provider, img_info_t
         }
     }
 
-    larodDestroyModel(&pp_model);
+    // Kept to create job requests for the vdo buffers that are imported as larod input
+    provider->pp_model = pp_model;
+
+    return true;
+}
 
+bool model_provider_update_crop(model_provider_t* provider,
+                                uint32_t clip_x,
+                                uint32_t clip_y,
+                                uint32_t clip_w,
+                                uint32_t clip_h) {
+    larodError* error = NULL;
+
+    // Only the preprocessing job can crop
+    if (!provider->use_preprocessing) {
+        syslog(LOG_WARNING,
+               "%s: The frames are not preprocessed, they can not be cropped",
+               __func__);
+        return false;
+    }
+    if (clip_w == 0 || clip_h == 0 || clip_w > provider->stream_width ||
+        clip_h > provider->stream_height || clip_x > provider->stream_width - clip_w ||
+        clip_y > provider->stream_height - clip_h) {
+        syslog(LOG_WARNING,
+               "%s: Crop X=%u Y=%u (%u x %u) is outside the frame",
+               __func__,
+               clip_x,
+               clip_y,
+               clip_w,
+               clip_h);
+        return false;
+    }
+
+    // The same map is updated in place, the job requests get it before their next job
+    if (!provider->crop_map) {
+        provider->crop_map = larodCreateMap(&error);
+        if (!provider->crop_map) {
+            panic("Could not create preprocessing crop larodMap %s", error->msg);
+        }
+    }
+    if (!larodMapSetIntArr4(provider->crop_map,
+                            "image.input.crop",
+                            clip_x,
+                            clip_y,
+                            clip_w,
+                            clip_h,
+                            &error)) {
+        panic("Failed setting preprocessing parameters: %s", error->msg);
+    }
+    provider->crop_version++;
     return true;
 }
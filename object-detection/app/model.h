@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include "argparse.h"
 #include "imgprovider.h"
 #include "larod.h"
 #include "vdo-buffer.h"
@@ -30,6 +31,26 @@ typedef struct model_tensor_output {
     larodTensorDataType datatype;
 } model_tensor_output_t;
 
+// Max number of vdo buffers whose memory is used directly as larod input, room for
+// every buffer of every stream that feeds the provider
+#define MODEL_MAX_IMPORTED_BUFFERS (MAX_CHANNELS * MAX_NBR_IMG_PROVIDER_BUFFERS)
+
+/**
+ * A vdo buffer imported as larod input tensor, with the job request that reads
+ * the frame straight from it. VDO recycles a few buffers so each is imported once.
+ * Buffer ids are only unique within a stream, so a buffer is known by the memory
+ * it is in, which is unique among all streams.
+ */
+typedef struct model_imported_buffer {
+    int fd;
+    int64_t offset;
+    larodTensor** tensors;
+    size_t num_tensors;
+    larodJobRequest* req;
+    // The crop of the provider that the job request was last given
+    unsigned int crop_version;
+} model_imported_buffer_t;
+
 typedef struct model_provider {
     larodConnection* conn;
     larodJobRequest* pp_req;
@@ -52,14 +73,78 @@ typedef struct model_provider {
 
     bool use_preprocessing;
 
+    // Number of frames the model takes in one job, the first dimension of the input tensor
+    size_t batch_size;
+    // Number of frames added to the batch that has not been run yet
+    size_t batch_count;
+    // Number of frames in the batch that was run last, the ones that have results
+    size_t batch_results;
+    // Byte size of one frame in the model input tensor
+    size_t batch_slot_size;
+    // The model input tensor when it is filled from the preprocessing output
+    void* batch_input_addr;
+    size_t batch_input_size;
+    void* pp_output_addr;
+    size_t pp_output_size;
+
     img_info_t* img_info;
     model_tensor_output_t* model_output_tensors;
     const char* device_name;
     larodModel* model;
+    larodModel* pp_model;
+    // The crop of the preprocessing jobs, changed in place by model_provider_update_crop
+    larodMap* crop_map;
+    // Bumped on every crop change, a job request gets the new crop before its next job
+    unsigned int crop_version;
+    // The crop that pp_req was last given
+    unsigned int pp_crop_version;
+    unsigned int stream_width;
+    unsigned int stream_height;
+    // Read the frames straight from the vdo buffers instead of copying them, turned
+    // off if larod can not import the vdo buffers
+    bool zero_copy;
+    model_imported_buffer_t imported_buffers[MODEL_MAX_IMPORTED_BUFFERS];
+    size_t num_imported_buffers;
 } model_provider_t;
 
+/**
+ * @brief Run inference on a single frame, the same as adding it to an empty batch and running it.
+ *
+ * @return False if there was no power available and the frame was not analyzed.
+ */
 bool model_run_inference(model_provider_t* provider, VdoBuffer* vdo_buf);
 
+/**
+ * @brief Copy a frame into the next free place of the model input batch.
+ *
+ * The frame is converted by the preprocessing job if needed and can be given back
+ * to vdo as soon as this returns.
+ *
+ * @return False if there was no power available, the frame and the batch are dropped.
+ */
+bool model_batch_add(model_provider_t* provider, VdoBuffer* vdo_buf);
+
+/**
+ * @brief Run one inference job on all frames added since the last run.
+ *
+ * Places in the batch that were not filled hold stale data and their results are
+ * to be ignored. The results of the added frames are read with
+ * model_get_batch_output_info.
+ *
+ * @return False if there was no power available, the added frames are dropped.
+ */
+bool model_batch_run(model_provider_t* provider);
+
+/**
+ * @brief Get the output of one frame in the batch that was run last.
+ *
+ * The output tensors are expected to have the batch as their first dimension.
+ */
+bool model_get_batch_output_info(model_provider_t* provider,
+                                 unsigned int tensor_output_index,
+                                 size_t batch_index,
+                                 model_tensor_output_t* tensor_output);
+
 bool model_get_tensor_output_info(model_provider_t* provider,
                                   unsigned int tensor_output_index,
                                   model_tensor_output_t* tensor_output);
@@ -68,6 +153,22 @@ img_info_t model_provider_get_model_metadata(model_provider_t* provider);
 
 bool model_provider_update_image_metadata(model_provider_t* provider, img_info_t* img_info);
 
+/**
+ * @brief Set the area of the frame that is scaled into the model input.
+ *
+ * Can be called for every frame added to the batch, e.g. to add several crops of the
+ * same frame. The crop map and the job requests are reused, a job request is given the
+ * new crop right before it runs its next job, so changing the crop allocates nothing.
+ *
+ * @return False if the area is outside the frame, or if the frames are not
+ *         preprocessed since the stream already has the format and size of the model input.
+ */
+bool model_provider_update_crop(model_provider_t* provider,
+                                uint32_t clip_x,
+                                uint32_t clip_y,
+                                uint32_t clip_w,
+                                uint32_t clip_h);
+
 model_provider_t* model_provider_new(char* model_file,
                                      char* device_name,
                                      const char* labels_file,
@@ -34,6 +34,9 @@
  *
  * FOURTH argument, DEVICE, is a string for which larod device to use.
  *
+ * The option -c CHANNELS selects which channels to run detection on and -s POLICY how
+ * the channels take turns using the single loaded model.
+ *
  */
 
 #include <errno.h>
@@ -48,10 +51,13 @@
 #include <unistd.h>
 
 #include "argparse.h"
+#include "attention.h"
+#include "framelatency.h"
 #include "imgprovider.h"
 #include "labelparse.h"
 #include "model.h"
 #include "panic.h"
+#include "scheduler.h"
 #include "vdo-error.h"
 #include "vdo-frame.h"
 #include "vdo-types.h"
@@ -69,6 +75,19 @@ typedef struct {
     int label;
 } box;
 
+// Everything that is needed to analyze one channel with the shared model
+typedef struct {
+    uint32_t channel;
+    img_provider_t* image_provider;
+    frame_latency_t* latency;
+    bbox_t* bbox;
+    // The crops of the frame in the batch, planned around the detections of its previous frame
+    attention_t attention;
+    attention_crop_t crops[ATTENTION_MAX_CROPS];
+    size_t num_crops;
+    bool full_frame;
+} channel_t;
+
 static void shutdown(int status) {
     (void)status;
     running = 0;
@@ -91,10 +110,20 @@ static bbox_t* setup_bbox(uint32_t channel) {
     return bbox;
 }
 
-static bool parse_and_postprocess_output_tensors(bbox_t* bbox,
+/**
+ * @brief Draw the detections of one place in the batch, a crop of the frame if crop is set.
+ *
+ * The boxes are moved from the crop to the frame, and added to the attention if it is set
+ * so that the next crops are planned around them. The caller clears and commits the boxes
+ * of the frame.
+ */
+static bool parse_and_postprocess_output_tensors(uint32_t channel,
+                                                 bbox_t* bbox,
                                                  model_tensor_output_t* tensor_outputs,
                                                  float confidence_threshold,
                                                  char** labels,
+                                                 const attention_crop_t* crop,
+                                                 attention_t* attention,
                                                  unsigned int* post_processing_ms) {
     box* boxes = NULL;
     struct timeval start_ts, end_ts;
@@ -103,23 +132,26 @@ static bool parse_and_postprocess_output_tensors(bbox_t* bbox,
     float* locations = (float*)tensor_outputs[0].data;
     float* classes   = (float*)tensor_outputs[1].data;
 
-    bbox_clear(bbox);
-
     gettimeofday(&start_ts, NULL);
 
     float* scores            = (float*)tensor_outputs[2].data;
     float* nbr_detections    = (float*)tensor_outputs[3].data;
     int number_of_detections = (int)nbr_detections[0];
     if (number_of_detections == 0) {
-        syslog(LOG_INFO, "No object is detected");
+        syslog(LOG_INFO, "Channel %u: No object is detected", channel);
         return true;
     }
-    boxes = (box*)malloc(sizeof(box) * number_of_detections);
+    // The boxes are normalized to the model input, which is the crop of the frame
+    float offset_x = crop ? crop->norm_x : 0.0f;
+    float offset_y = crop ? crop->norm_y : 0.0f;
+    float scale_x  = crop ? crop->norm_width : 1.0f;
+    float scale_y  = crop ? crop->norm_height : 1.0f;
+    boxes          = (box*)malloc(sizeof(box) * number_of_detections);
     for (int i = 0; i < number_of_detections; i++) {
-        boxes[i].y_min = locations[4 * i];
-        boxes[i].x_min = locations[4 * i + 1];
-        boxes[i].y_max = locations[4 * i + 2];
-        boxes[i].x_max = locations[4 * i + 3];
+        boxes[i].y_min = offset_y + locations[4 * i] * scale_y;
+        boxes[i].x_min = offset_x + locations[4 * i + 1] * scale_x;
+        boxes[i].y_max = offset_y + locations[4 * i + 2] * scale_y;
+        boxes[i].x_max = offset_x + locations[4 * i + 3] * scale_x;
         boxes[i].score = scores[i];
         boxes[i].label = classes[i];
     }
@@ -139,7 +171,8 @@ static bool parse_and_postprocess_output_tensors(bbox_t* bbox,
             float right  = boxes[i].x_max;
 
             syslog(LOG_INFO,
-                   "Object %d: Classes: %s - Scores: %f - Locations: [%f,%f,%f,%f]",
+                   "Channel %u: Object %d: Classes: %s - Scores: %f - Locations: [%f,%f,%f,%f]",
+                   channel,
                    i,
                    labels[boxes[i].label],
                    boxes[i].score,
@@ -149,27 +182,40 @@ static bool parse_and_postprocess_output_tensors(bbox_t* bbox,
                    right);
             bbox_coordinates_frame_normalized(bbox);
             bbox_rectangle(bbox, left, top, right, bottom);
+            if (attention) {
+                attention_add_detection(attention, left, top, right, bottom);
+            }
         }
     }
 
-    if (!bbox_commit(bbox, 0u)) {
-        panic("Failed to commit box drawer");
-    }
     if (boxes) {
         free(boxes);
     }
     return true;
 }
 
+static unsigned int elapsed_ms(struct timeval* start_ts, struct timeval* end_ts) {
+    return (unsigned int)(((end_ts->tv_sec - start_ts->tv_sec) * 1000) +
+                          ((end_ts->tv_usec - start_ts->tv_usec) / 1000));
+}
+
+static bool channel_in_batch(channel_t** batch, size_t num_frames, channel_t* channel) {
+    for (size_t i = 0; i < num_frames; i++) {
+        if (batch[i] == channel) {
+            return true;
+        }
+    }
+    return false;
+}
+
 /**
  * @brief Main function that starts a stream with different options.
  */
 int main(int argc, char** argv) {
-    img_provider_t* image_provider        = NULL;
+    channel_t* channels                   = NULL;
+    scheduler_t* scheduler                = NULL;
     model_provider_t* model_provider      = NULL;
     model_tensor_output_t* tensor_outputs = NULL;
-    g_autoptr(GError) vdo_error           = NULL;
-    bbox_t* bbox                          = NULL;
     img_info_t model_metadata             = {0};
     img_info_t image_metadata             = {0};
 
@@ -180,16 +226,17 @@ int main(int argc, char** argv) {
     args_t args;
     parse_args(argc, argv, &args);
 
-    char* device_name          = args.device_name;
-    char* model_file           = args.model_file;
-    const char* labels_file    = args.labels_file;
-    const int threshold        = args.threshold;
-    size_t number_of_classes   = 0;
-    double vdo_framerate       = 30.0;
-    uint32_t vdo_input_channel = 1;
-    bool parse_tensors         = true;
-
-    // Start by loading the model and get the model metadata
+    char* device_name        = args.device_name;
+    char* model_file         = args.model_file;
+    const char* labels_file  = args.labels_file;
+    const int threshold      = args.threshold;
+    size_t number_of_classes = 0;
+    size_t num_channels      = args.num_channels;
+    double vdo_framerate     = 30.0;
+    bool parse_tensors       = true;
+
+    // Start by loading the model and get the model metadata. The model is loaded once and
+    // shared by all channels.
     size_t number_output_tensors = 0;
     model_provider =
         model_provider_new(model_file, device_name, labels_file, &number_output_tensors);
@@ -205,101 +252,335 @@ int main(int argc, char** argv) {
     // Get the model format and model input dimension and pitches
     model_metadata = model_provider_get_model_metadata(model_provider);
 
-    image_provider = img_provider_new(vdo_input_channel, &model_metadata, 2, vdo_framerate);
-    if (!image_provider) {
-        // It is considered an error if the img provider can not supply the
-        // requested stream
-        panic("%s: Could not create image provider", __func__);
-    }
-
-    image_metadata = img_provider_get_image_metadata(image_provider);
-    model_provider_update_image_metadata(model_provider, &image_metadata);
     if (labels_file == NULL) {
         parse_tensors = false;
     }
 
+    // Analyze crops around the detections of the previous frame between full frames. The
+    // crops of a frame take one place each in the batch, so they are analyzed in one job.
+    attention_params_t attention_params = {
+        .full_frame_interval = args.full_frame_interval,
+        .padding             = (float)args.crop_padding_percent / 100.0f,
+        .max_crops           = MIN(args.max_crops, model_provider->batch_size),
+    };
+    bool use_attention = attention_params.full_frame_interval > 1;
+    if (use_attention && !parse_tensors) {
+        syslog(LOG_WARNING, "Attention crops need the detections, they are turned off");
+        use_attention = false;
+    }
+    // A larger stream gives the crops more pixels than the model input has
+    img_info_t requested_metadata = model_metadata;
+    if (use_attention) {
+        requested_metadata.width  = model_metadata.width * ATTENTION_STREAM_SCALE;
+        requested_metadata.height = model_metadata.height * ATTENTION_STREAM_SCALE;
+    }
+
     char** labels = NULL;          // This is the array of label strings. The label
                                    // entries points into the large label_file_data buffer.
     char* label_file_data = NULL;  // Buffer holding the complete collection of label strings.
 
     if (parse_tensors) {
         parse_labels(&labels, &label_file_data, labels_file, &number_of_classes);
-        bbox = setup_bbox(vdo_input_channel);
     }
 
+    channels = calloc(num_channels, sizeof(channel_t));
+    if (!channels) {
+        panic("%s: Could not allocate channels", __func__);
+    }
+
+    for (size_t i = 0; i < num_channels; i++) {
+        channel_t* ch = &channels[i];
+        ch->channel   = args.channels[i];
+
+        if (i == 0) {
+            // Scale the native aspect ratio stream that best fits the model resolution
+            ch->image_provider =
+                img_provider_new(ch->channel, &requested_metadata, 2, vdo_framerate, "scale");
+            if (!ch->image_provider) {
+                // It is considered an error if the img provider can not supply the
+                // requested stream
+                panic("%s: Could not create image provider for channel %u",
+                      __func__,
+                      ch->channel);
+            }
+            image_metadata = img_provider_get_image_metadata(ch->image_provider);
+            model_provider_update_image_metadata(model_provider, &image_metadata);
+            if (use_attention && !model_provider_update_crop(model_provider,
+                                                             0,
+                                                             0,
+                                                             image_metadata.width,
+                                                             image_metadata.height)) {
+                syslog(LOG_WARNING, "The frames can not be cropped, they are analyzed in full");
+                use_attention = false;
+            }
+        } else {
+            // The preprocessing job is set up for the first channel's stream, so the
+            // other channels must deliver frames with exactly the same format and size
+            img_info_t wanted = image_metadata;
+            ch->image_provider =
+                img_provider_new(ch->channel, &wanted, 2, vdo_framerate, "crop");
+            if (!ch->image_provider) {
+                panic("%s: Could not create image provider for channel %u",
+                      __func__,
+                      ch->channel);
+            }
+            img_info_t metadata = img_provider_get_image_metadata(ch->image_provider);
+            if (metadata.format != image_metadata.format ||
+                metadata.width != image_metadata.width ||
+                metadata.height != image_metadata.height ||
+                metadata.pitch != image_metadata.pitch) {
+                panic("%s: Channel %u gives %ux%u (pitch %u) but channel %u gives %ux%u (pitch %u)",
+                      __func__,
+                      ch->channel,
+                      metadata.width,
+                      metadata.height,
+                      metadata.pitch,
+                      channels[0].channel,
+                      image_metadata.width,
+                      image_metadata.height,
+                      image_metadata.pitch);
+            }
+        }
+
+        // Analyze the newest frame vdo has, older queued frames would make the result lag
+        img_provider_set_fetch_policy(ch->image_provider, IMG_PROVIDER_FETCH_LATEST_FRAME);
+
+        if (parse_tensors) {
+            ch->bbox = setup_bbox(ch->channel);
+        }
+        if (use_attention && !attention_init(&ch->attention,
+                                             &attention_params,
+                                             image_metadata.width,
+                                             image_metadata.height,
+                                             model_metadata.width,
+                                             model_metadata.height)) {
+            panic("%s: Could not set up attention crops for channel %u", __func__, ch->channel);
+        }
+
+        // Report the latency percentiles and dropped frames every 100 frames
+        ch->latency = frame_latency_new(100);
+        if (!ch->latency) {
+            panic("%s: Could not create frame latency", __func__);
+        }
+    }
+
+    scheduler = scheduler_new(args.policy, args.channels, args.weights, num_channels);
+
     // Get the fd here instead so it possible to select on them in main loop instead
     syslog(LOG_INFO, "Start fetching video frames from VDO for the inference");
-    if (!img_provider_start(image_provider)) {
-        panic("%s: Could not start image provider", __func__);
+    for (size_t i = 0; i < num_channels; i++) {
+        if (!img_provider_start(channels[i].image_provider)) {
+            panic("%s: Could not start image provider for channel %u",
+                  __func__,
+                  channels[i].channel);
+        }
+    }
+
+    // A model with a batch dimension analyzes one frame from each of up to batch_size
+    // channels in one job, or the crops of the frames with attention crops
+    size_t batch_size   = model_provider->batch_size;
+    channel_t** batch   = calloc(batch_size, sizeof(channel_t*));
+    size_t* batch_crops = calloc(batch_size, sizeof(size_t));
+    bool* ready         = calloc(num_channels, sizeof(bool));
+    ssize_t next_index  = -1;
+    if (!batch || !batch_crops || !ready) {
+        panic("%s: Could not allocate batch", __func__);
     }
 
     while (running) {
         struct timeval start_ts, end_ts;
-        unsigned int inference_ms     = 0;
-        unsigned int total_elapsed_ms = 0;
-
-        g_autoptr(VdoBuffer) vdo_buf = img_provider_get_frame(image_provider);
-        if (!vdo_buf) {
-            // This can only happen if it is global rotation then
-            // the stream has to be restarted because rotation has been changed.
-            panic(
-                "%s: No buffer because of changed global rotation. Application needs to be "
-                "restarted",
-                __func__);
-        }
-        gettimeofday(&start_ts, NULL);
-        if (!model_run_inference(model_provider, vdo_buf)) {
-            // No power
-            if (!vdo_stream_buffer_unref(image_provider->vdo_stream, &vdo_buf, &vdo_error)) {
-                if (!vdo_error_is_expected(&vdo_error)) {
-                    panic("%s: Unexpected error: %s", __func__, vdo_error->message);
+        unsigned int inference_ms = 0;
+        size_t num_frames         = 0;
+        int64_t deadline_us       = 0;
+        bool no_power             = false;
+
+        // Gather frames until the batch is full, a channel would come twice or the
+        // first frame has waited batch_wait_ms for the others
+        while (running && num_frames < batch_size) {
+            size_t index = (size_t)next_index;
+            if (next_index < 0) {
+                // Least recently served skips channels that would make it wait for a frame
+                if (args.policy == SCHEDULER_LEAST_RECENTLY_SERVED) {
+                    for (size_t i = 0; i < num_channels; i++) {
+                        ready[i] = img_provider_wait_frame(channels[i].image_provider, 0);
+                    }
                 }
-                g_clear_error(&vdo_error);
+                index = scheduler_next(scheduler, ready);
+            }
+            channel_t* ch = &channels[index];
+            next_index    = -1;
+
+            // Each crop of the frame takes one place in the batch, a channel that is already
+            // in the batch keeps the crops of its frame there
+            bool in_batch = channel_in_batch(batch, num_frames, ch);
+            if (!in_batch) {
+                ch->num_crops  = 1;
+                ch->full_frame = true;
+            }
+            if (!in_batch && use_attention) {
+                ch->num_crops = attention_plan(&ch->attention, ch->crops, &ch->full_frame);
+            }
+
+            if (num_frames > 0) {
+                int remaining_ms = (int)((deadline_us - g_get_monotonic_time()) / 1000);
+                if (in_batch || num_frames + ch->num_crops > batch_size || remaining_ms <= 0 ||
+                    !img_provider_wait_frame(ch->image_provider, remaining_ms)) {
+                    // The channel keeps its turn and starts the next batch
+                    next_index = (ssize_t)index;
+                    break;
+                }
+            }
+
+            g_autoptr(VdoBuffer) vdo_buf = img_provider_get_frame(ch->image_provider);
+            if (!vdo_buf) {
+                // This can only happen if it is global rotation then
+                // the stream has to be restarted because rotation has been changed.
+                panic(
+                    "%s: No buffer because of changed global rotation. Application needs to be "
+                    "restarted",
+                    __func__);
+            }
+            if (num_frames == 0) {
+                deadline_us = g_get_monotonic_time() + (int64_t)args.batch_wait_ms * 1000;
             }
+            frame_latency_frame_dequeued(ch->latency, vdo_buf);
+            img_provider_frame_info_t frame_info = img_provider_get_frame_info(ch->image_provider);
+            syslog(LOG_INFO,
+                   "Channel %u: Fetched a frame %u ms old, skipped %u older frames",
+                   ch->channel,
+                   (unsigned int)(frame_info.age_us / 1000),
+                   frame_info.skipped_frames);
+
+            // The frame is copied into the batch so it can be given back to vdo right away
+            gettimeofday(&start_ts, NULL);
+            for (size_t c = 0; c < ch->num_crops; c++) {
+                if (use_attention && !model_provider_update_crop(model_provider,
+                                                                 ch->crops[c].x,
+                                                                 ch->crops[c].y,
+                                                                 ch->crops[c].width,
+                                                                 ch->crops[c].height)) {
+                    panic("%s: Could not crop the frame of channel %u", __func__, ch->channel);
+                }
+                if (!model_batch_add(model_provider, vdo_buf)) {
+                    no_power = true;
+                    break;
+                }
+                batch[num_frames]       = ch;
+                batch_crops[num_frames] = c;
+                num_frames++;
+            }
+            gettimeofday(&end_ts, NULL);
+            inference_ms += elapsed_ms(&start_ts, &end_ts);
+            if (use_attention && !ch->full_frame) {
+                syslog(LOG_INFO,
+                       "Channel %u: Analyze %zu crops around %zu detections",
+                       ch->channel,
+                       ch->num_crops,
+                       ch->attention.num_detections);
+            }
+
+            // This will allow vdo to fill this buffer with data again
+            if (!img_provider_return_frame(ch->image_provider, &vdo_buf)) {
+                panic("%s: Failed to return frame", __func__);
+            }
+            if (no_power) {
+                break;
+            }
+        }
+
+        gettimeofday(&start_ts, NULL);
+        if (no_power || num_frames == 0 || !model_batch_run(model_provider)) {
             // All buffers in vdo should be flushed since the call to run_inference may
             // have taken a lot of time so the buffers in vdo may be old
-            img_provider_flush_all_frames(image_provider);
+            for (size_t i = 0; i < num_channels; i++) {
+                img_provider_flush_all_frames(channels[i].image_provider);
+            }
             continue;
         }
         gettimeofday(&end_ts, NULL);
 
-        inference_ms = (unsigned int)(((end_ts.tv_sec - start_ts.tv_sec) * 1000) +
-                                      ((end_ts.tv_usec - start_ts.tv_usec) / 1000));
-        syslog(LOG_INFO, "Ran inference for %u ms", inference_ms);
-
-        for (size_t i = 0; i < number_output_tensors; i++) {
-            if (!model_get_tensor_output_info(model_provider, i, &tensor_outputs[i])) {
-                panic("Failed to get output tensor info for %zu", i);
+        inference_ms += elapsed_ms(&start_ts, &end_ts);
+        syslog(LOG_INFO,
+               "Ran inference on %zu frames or crops for %u ms",
+               num_frames,
+               inference_ms);
+
+        for (size_t b = 0; b < num_frames; b++) {
+            channel_t* ch                 = batch[b];
+            size_t crop                   = batch_crops[b];
+            unsigned int total_elapsed_ms = inference_ms;
+            unsigned int served_ms        = 0;
+
+            for (size_t i = 0; i < number_output_tensors; i++) {
+                if (!model_get_batch_output_info(model_provider, i, b, &tensor_outputs[i])) {
+                    panic("Failed to get output tensor info for %zu", i);
+                }
+            }
+            // The boxes of all crops of the frame are drawn together
+            if (crop == 0) {
+                frame_latency_result_ready(ch->latency);
+                if (parse_tensors) {
+                    bbox_clear(ch->bbox);
+                }
+                if (use_attention) {
+                    attention_start_frame(&ch->attention, ch->full_frame);
+                }
             }
-        }
-        total_elapsed_ms = inference_ms;
-
-        if (parse_tensors) {
-            unsigned int post_processing_ms = 0;
-            float confidence_threshold      = (float)(threshold / 100.0);
-            parse_and_postprocess_output_tensors(bbox,
-                                                 tensor_outputs,
-                                                 confidence_threshold,
-                                                 labels,
-                                                 &post_processing_ms);
-            total_elapsed_ms += post_processing_ms;
-        }
 
-        // Check if the framerate from vdo should be changed
-        img_provider_update_framerate(image_provider, total_elapsed_ms);
+            if (parse_tensors) {
+                unsigned int post_processing_ms = 0;
+                float confidence_threshold      = (float)(threshold / 100.0);
+                parse_and_postprocess_output_tensors(ch->channel,
+                                                     ch->bbox,
+                                                     tensor_outputs,
+                                                     confidence_threshold,
+                                                     labels,
+                                                     use_attention ? &ch->crops[crop] : NULL,
+                                                     use_attention ? &ch->attention : NULL,
+                                                     &post_processing_ms);
+                total_elapsed_ms += post_processing_ms;
+            }
+            if (crop + 1 < ch->num_crops) {
+                continue;
+            }
+            if (parse_tensors && !bbox_commit(ch->bbox, 0u)) {
+                panic("Failed to commit box drawer");
+            }
+            // The detections have been drawn and committed to the overlay
+            frame_latency_committed(ch->latency);
+
+            // A channel gets a frame analyzed once per turn, so it is the time between its
+            // turns rather than the time of this analysis that decides what framerate it can
+            // keep up with
+            served_ms = scheduler_mark_served(scheduler, (size_t)(ch - channels));
+            if (served_ms > total_elapsed_ms) {
+                total_elapsed_ms = served_ms;
+            }
 
-        // This will allow vdo to fill this buffer with data again
-        if (!vdo_stream_buffer_unref(image_provider->vdo_stream, &vdo_buf, &vdo_error)) {
-            if (!vdo_error_is_expected(&vdo_error)) {
-                panic("%s: Unexpexted error: %s", __func__, vdo_error->message);
+            // Check if the framerate from vdo should be changed
+            if (!img_provider_update_framerate(ch->image_provider, total_elapsed_ms)) {
+                panic("%s: Failed to update framerate", __func__);
             }
-            g_clear_error(&vdo_error);
         }
     }
 
-    if (image_provider) {
-        img_provider_destroy(image_provider);
+    free(batch);
+    free(batch_crops);
+    free(ready);
+    if (scheduler) {
+        scheduler_log_stats(scheduler);
+        scheduler_destroy(scheduler);
     }
+    for (size_t i = 0; channels && i < num_channels; i++) {
+        frame_latency_destroy(channels[i].latency);
+        if (channels[i].image_provider) {
+            img_provider_destroy(channels[i].image_provider);
+        }
+        if (channels[i].bbox) {
+            bbox_destroy(channels[i].bbox);
+        }
+    }
+    free(channels);
     if (model_provider) {
         model_provider_destroy(model_provider);
     }
@@ -311,9 +592,6 @@ int main(int argc, char** argv) {
     if (label_file_data) {
         free(label_file_data);
     }
-    if (parse_tensors) {
-        bbox_destroy(bbox);
-    }
 
     syslog(LOG_INFO, "Exit %s", argv[0]);
     return 0;
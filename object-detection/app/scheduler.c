@@ -0,0 +1,173 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "scheduler.h"
+
+#include "panic.h"
+
+#include <errno.h>
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+
+static const char* policy_names[] = {
+    [SCHEDULER_ROUND_ROBIN]           = "round-robin",
+    [SCHEDULER_WEIGHTED]              = "weighted",
+    [SCHEDULER_LEAST_RECENTLY_SERVED] = "least-recently-served",
+};
+
+bool scheduler_policy_from_string(const char* name, scheduler_policy_t* policy) {
+    for (size_t i = 0; i < G_N_ELEMENTS(policy_names); i++) {
+        if (!g_strcmp0(name, policy_names[i])) {
+            *policy = (scheduler_policy_t)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* scheduler_policy_to_string(scheduler_policy_t policy) {
+    if ((size_t)policy >= G_N_ELEMENTS(policy_names)) {
+        return "unknown";
+    }
+    return policy_names[policy];
+}
+
+scheduler_t* scheduler_new(scheduler_policy_t policy,
+                           const uint32_t* channels,
+                           const unsigned int* weights,
+                           size_t num_channels) {
+    if (num_channels == 0) {
+        panic("%s: At least one channel is needed", __func__);
+    }
+
+    scheduler_t* scheduler = calloc(1, sizeof(scheduler_t));
+    if (!scheduler) {
+        panic("%s: Unable to allocate scheduler_t: %s", __func__, strerror(errno));
+    }
+    scheduler->channels = calloc(num_channels, sizeof(scheduler_channel_t));
+    if (!scheduler->channels) {
+        panic("%s: Unable to allocate scheduler channels: %s", __func__, strerror(errno));
+    }
+    scheduler->policy       = policy;
+    scheduler->num_channels = num_channels;
+
+    for (size_t i = 0; i < num_channels; i++) {
+        scheduler->channels[i].channel = channels[i];
+        scheduler->channels[i].weight  = weights ? weights[i] : 1;
+        if (scheduler->channels[i].weight == 0) {
+            panic("%s: Channel %u has zero weight", __func__, channels[i]);
+        }
+        scheduler->total_weight += scheduler->channels[i].weight;
+        syslog(LOG_INFO,
+               "Scheduling channel %u with weight %u using %s",
+               channels[i],
+               scheduler->channels[i].weight,
+               scheduler_policy_to_string(policy));
+    }
+
+    return scheduler;
+}
+
+void scheduler_destroy(scheduler_t* scheduler) {
+    if (!scheduler) {
+        return;
+    }
+    free(scheduler->channels);
+    free(scheduler);
+}
+
+static size_t next_weighted(scheduler_t* scheduler) {
+    // Smooth weighted round-robin: every channel earns its weight in credit, the richest one
+    // is served and pays back the total weight. This spreads the turns of a heavy channel
+    // out instead of serving it several times in a row.
+    size_t best = 0;
+    for (size_t i = 0; i < scheduler->num_channels; i++) {
+        scheduler->channels[i].credit += scheduler->channels[i].weight;
+        if (scheduler->channels[i].credit > scheduler->channels[best].credit) {
+            best = i;
+        }
+    }
+    scheduler->channels[best].credit -= scheduler->total_weight;
+    return best;
+}
+
+static size_t next_least_recently_served(scheduler_t* scheduler, const bool* ready) {
+    // Never picked channels have last_picked_us 0 and are picked first, in order. A channel
+    // that is not ready only gets the turn when no channel is ready.
+    size_t best     = 0;
+    bool best_ready = !ready || ready[0];
+    for (size_t i = 1; i < scheduler->num_channels; i++) {
+        bool is_ready = !ready || ready[i];
+        if (is_ready != best_ready) {
+            if (is_ready) {
+                best       = i;
+                best_ready = true;
+            }
+            continue;
+        }
+        if (scheduler->channels[i].last_picked_us < scheduler->channels[best].last_picked_us) {
+            best = i;
+        }
+    }
+    scheduler->channels[best].last_picked_us = g_get_monotonic_time();
+    return best;
+}
+
+size_t scheduler_next(scheduler_t* scheduler, const bool* ready) {
+    size_t index = 0;
+
+    switch (scheduler->policy) {
+        case SCHEDULER_WEIGHTED:
+            index = next_weighted(scheduler);
+            break;
+        case SCHEDULER_LEAST_RECENTLY_SERVED:
+            index = next_least_recently_served(scheduler, ready);
+            break;
+        case SCHEDULER_ROUND_ROBIN:
+        default:
+            index           = scheduler->next;
+            scheduler->next = (scheduler->next + 1) % scheduler->num_channels;
+            break;
+    }
+    return index;
+}
+
+unsigned int scheduler_mark_served(scheduler_t* scheduler, size_t index) {
+    if (index >= scheduler->num_channels) {
+        panic("%s: Invalid channel index %zu", __func__, index);
+    }
+    scheduler_channel_t* channel = &scheduler->channels[index];
+    int64_t now_us               = g_get_monotonic_time();
+    unsigned int interval_ms     = 0;
+
+    if (channel->last_served_us != 0) {
+        interval_ms = (unsigned int)((now_us - channel->last_served_us) / 1000);
+    }
+    channel->last_served_us = now_us;
+    channel->times_served++;
+    return interval_ms;
+}
+
+void scheduler_log_stats(scheduler_t* scheduler) {
+    for (size_t i = 0; i < scheduler->num_channels; i++) {
+        syslog(LOG_INFO,
+               "Channel %u was served %llu times",
+               scheduler->channels[i].channel,
+               (unsigned long long)scheduler->channels[i].times_served);
+    }
+}
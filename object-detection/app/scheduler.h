@@ -0,0 +1,97 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This header file decides which of several image channels that gets to use the
+ * single model instance next.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    // Serve the channels one after the other
+    SCHEDULER_ROUND_ROBIN,
+    // Serve each channel in proportion to its weight
+    SCHEDULER_WEIGHTED,
+    // Serve the channel that has waited the longest since its last turn, preferring
+    // channels that already have a frame ready
+    SCHEDULER_LEAST_RECENTLY_SERVED,
+} scheduler_policy_t;
+
+typedef struct scheduler_channel {
+    uint32_t channel;
+    unsigned int weight;
+    // Smooth weighted round-robin credit, only used by SCHEDULER_WEIGHTED
+    int64_t credit;
+    // Monotonic time in microseconds of the last turn and the last served frame, 0 if never
+    int64_t last_picked_us;
+    int64_t last_served_us;
+    uint64_t times_served;
+} scheduler_channel_t;
+
+typedef struct scheduler {
+    scheduler_policy_t policy;
+    scheduler_channel_t* channels;
+    size_t num_channels;
+    size_t next;
+    unsigned int total_weight;
+} scheduler_t;
+
+/**
+ * @brief Parses a scheduling policy name.
+ *
+ * @param name One of "round-robin", "weighted" or "least-recently-served".
+ * @param policy Set to the parsed policy on success.
+ * @return False if the name is unknown.
+ */
+bool scheduler_policy_from_string(const char* name, scheduler_policy_t* policy);
+
+const char* scheduler_policy_to_string(scheduler_policy_t policy);
+
+scheduler_t* scheduler_new(scheduler_policy_t policy,
+                           const uint32_t* channels,
+                           const unsigned int* weights,
+                           size_t num_channels);
+
+void scheduler_destroy(scheduler_t* scheduler);
+
+/**
+ * @brief Picks the channel that should get the next inference.
+ *
+ * @param scheduler The scheduler.
+ * @param ready Which channels have a frame ready, or NULL if not known. Only used by
+ *              SCHEDULER_LEAST_RECENTLY_SERVED, the other policies keep their order.
+ * @return Index of the channel in the array given to scheduler_new().
+ */
+size_t scheduler_next(scheduler_t* scheduler, const bool* ready);
+
+/**
+ * @brief Marks a channel as served now.
+ *
+ * @param scheduler The scheduler.
+ * @param index Index returned by scheduler_next().
+ * @return Milliseconds since the channel was previously served, 0 the first time.
+ */
+unsigned int scheduler_mark_served(scheduler_t* scheduler, size_t index);
+
+/**
+ * @brief Logs how many times each channel has been served.
+ */
+void scheduler_log_stats(scheduler_t* scheduler);
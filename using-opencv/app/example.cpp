@@ -31,38 +31,31 @@ using namespace cv;
 int main(void) {
     syslog(LOG_INFO, "Running OpenCV example with VDO as video source");
     img_provider_t* image_provider = nullptr;
-    g_autoptr(GError) vdo_error    = nullptr;
 
     // The desired width and height of the BGR frame
     unsigned int width  = 1024;
     unsigned int height = 576;
 
-    VdoFormat vdo_format = VDO_FORMAT_YUV;
-    double vdo_framerate = 30.0;
-
-    // Choose a valid stream resolution
-    unsigned int stream_width  = 0;
-    unsigned int stream_height = 0;
-    if (!choose_stream_resolution(width,
-                                  height,
-                                  vdo_format,
-                                  nullptr,
-                                  "all",
-                                  &stream_width,
-                                  &stream_height)) {
-        panic("%s: Failed choosing stream resolution", __func__);
-    }
-
-    syslog(LOG_INFO,
-           "Creating VDO image provider and creating stream %u x %u",
-           stream_width,
-           stream_height);
+    double vdo_framerate           = 30.0;
+    unsigned int vdo_input_channel = 1;
 
-    image_provider = create_img_provider(stream_width, stream_height, 2, vdo_format, vdo_framerate);
+    // Ask for the smallest stream resolution in any aspect ratio that fits the desired size
+    img_info_t requested_metadata = {};
+    requested_metadata.format     = VDO_FORMAT_YUV;
+    requested_metadata.width      = width;
+    requested_metadata.height     = height;
+    image_provider =
+        img_provider_new(vdo_input_channel, &requested_metadata, 2, vdo_framerate, "any");
     if (!image_provider) {
         panic("%s: Could not create image provider", __func__);
     }
 
+    // The stream may differ from the desired size if it is outside the limits of vdo
+    img_info_t image_metadata = img_provider_get_image_metadata(image_provider);
+    width                     = image_metadata.width;
+    height                    = image_metadata.height;
+    syslog(LOG_INFO, "Created VDO image provider with stream %u x %u", width, height);
+
     syslog(LOG_INFO, "Start fetching video frames from VDO");
     if (!img_provider_start(image_provider)) {
         panic("%s: Could not start image provider", __func__);
@@ -122,19 +115,18 @@ int main(void) {
                                               ((end_ts.tv_usec - start_ts.tv_usec) / 1000));
         syslog(LOG_INFO, "Ran opencv for %u ms", opencv_ms);
         // Check if the framerate from vdo should be changed
-        img_provider_update_framerate(image_provider, opencv_ms);
+        if (!img_provider_update_framerate(image_provider, opencv_ms)) {
+            panic("%s: Failed to update framerate", __func__);
+        }
 
         // This will allow vdo to fill this buffer with data again
-        if (!vdo_stream_buffer_unref(image_provider->vdo_stream, &vdo_buf, &vdo_error)) {
-            if (!vdo_error_is_expected(&vdo_error)) {
-                panic("%s: Unexpexted error: %s", __func__, vdo_error->message);
-            }
-            g_clear_error(&vdo_error);
+        if (!img_provider_return_frame(image_provider, &vdo_buf)) {
+            panic("%s: Failed to return frame", __func__);
         }
     }
 end:
     if (image_provider) {
-        destroy_img_provider(image_provider);
+        img_provider_destroy(image_provider);
     }
     syslog(LOG_INFO, "Exit opencv_app");
     return EXIT_SUCCESS;
@@ -0,0 +1,204 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This file measures the latency of frames and counts dropped frames.
+ */
+
+#include "framelatency.h"
+
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+
+#include "vdo-frame.h"
+
+/// Latencies below this are counted in linear buckets of 64 us
+#define LINEAR_LIMIT_US     (1024)
+#define LINEAR_SHIFT        (6)
+#define SUB_BUCKET_BITS     (4)
+#define SUB_BUCKETS         (1 << SUB_BUCKET_BITS)
+#define FIRST_LOG_MAGNITUDE (10)
+
+static const char* stage_names[FRAME_LATENCY_NUM_STAGES] = {
+    "capture-to-dequeue",
+    "dequeue-to-result",
+    "result-to-commit",
+    "capture-to-commit",
+};
+
+/**
+ * @brief Get the histogram bucket of a latency
+ *
+ * @param value_us The latency in us
+ * @return The bucket index
+ */
+static unsigned int bucket_index(int64_t value_us) {
+    if (value_us < 0) {
+        value_us = 0;
+    }
+    uint64_t value = (uint64_t)value_us;
+    if (value < LINEAR_LIMIT_US) {
+        return (unsigned int)(value >> LINEAR_SHIFT);
+    }
+    unsigned int magnitude = 63 - (unsigned int)__builtin_clzll(value);
+    unsigned int sub   = (unsigned int)(value >> (magnitude - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+    unsigned int index = SUB_BUCKETS + (magnitude - FIRST_LOG_MAGNITUDE) * SUB_BUCKETS + sub;
+    if (index >= FRAME_LATENCY_NUM_BUCKETS) {
+        index = FRAME_LATENCY_NUM_BUCKETS - 1;
+    }
+    return index;
+}
+
+/**
+ * @brief Get the largest latency that falls in a histogram bucket
+ *
+ * @param index The bucket index
+ * @return The latency in us
+ */
+static int64_t bucket_upper_bound(unsigned int index) {
+    if (index < SUB_BUCKETS) {
+        return ((int64_t)(index + 1) << LINEAR_SHIFT) - 1;
+    }
+    unsigned int magnitude = FIRST_LOG_MAGNITUDE + (index - SUB_BUCKETS) / SUB_BUCKETS;
+    unsigned int sub       = (index - SUB_BUCKETS) % SUB_BUCKETS;
+    return ((int64_t)(SUB_BUCKETS + sub + 1) << (magnitude - SUB_BUCKET_BITS)) - 1;
+}
+
+static void histogram_add(latency_histogram_t* histogram, int64_t value_us) {
+    histogram->counts[bucket_index(value_us)]++;
+    histogram->count++;
+    if (value_us > histogram->max_us) {
+        histogram->max_us = value_us;
+    }
+}
+
+frame_latency_t* frame_latency_new(unsigned int report_interval) {
+    frame_latency_t* latency = (frame_latency_t*)calloc(1, sizeof(frame_latency_t));
+    if (!latency) {
+        syslog(LOG_ERR, "%s: Unable to allocate frame latency", __func__);
+        return NULL;
+    }
+    latency->report_interval = report_interval;
+    return latency;
+}
+
+void frame_latency_destroy(frame_latency_t* latency) {
+    if (!latency) {
+        return;
+    }
+    if (latency->histograms[FRAME_LATENCY_CAPTURE_TO_COMMIT].count > 0) {
+        frame_latency_report(latency);
+    }
+    free(latency);
+}
+
+void frame_latency_frame_dequeued(frame_latency_t* latency, VdoBuffer* buffer) {
+    VdoFrame* frame = vdo_buffer_get_frame(buffer);
+
+    latency->current.dequeue_us = g_get_monotonic_time();
+    latency->current.capture_us = (int64_t)vdo_frame_get_timestamp(frame);
+    latency->current.result_us  = latency->current.dequeue_us;
+
+    unsigned int sequence = vdo_frame_get_sequence_nbr(frame);
+    // A sequence number that goes backwards means that the stream was restarted
+    if (latency->has_sequence && sequence > latency->last_sequence) {
+        unsigned int dropped = sequence - latency->last_sequence - 1;
+        latency->dropped_frames += dropped;
+        latency->dropped_since_report += dropped;
+    }
+    latency->last_sequence = sequence;
+    latency->has_sequence  = true;
+}
+
+frame_latency_frame_t frame_latency_get_frame(frame_latency_t* latency) {
+    return latency->current;
+}
+
+void frame_latency_set_frame(frame_latency_t* latency, const frame_latency_frame_t* frame) {
+    latency->current = *frame;
+}
+
+void frame_latency_result_ready(frame_latency_t* latency) {
+    latency->current.result_us = g_get_monotonic_time();
+}
+
+void frame_latency_committed(frame_latency_t* latency) {
+    int64_t commit_us            = g_get_monotonic_time();
+    frame_latency_frame_t* frame = &latency->current;
+
+    histogram_add(&latency->histograms[FRAME_LATENCY_CAPTURE_TO_DEQUEUE],
+                  frame->dequeue_us - frame->capture_us);
+    histogram_add(&latency->histograms[FRAME_LATENCY_DEQUEUE_TO_RESULT],
+                  frame->result_us - frame->dequeue_us);
+    histogram_add(&latency->histograms[FRAME_LATENCY_RESULT_TO_COMMIT],
+                  commit_us - frame->result_us);
+    histogram_add(&latency->histograms[FRAME_LATENCY_CAPTURE_TO_COMMIT],
+                  commit_us - frame->capture_us);
+    latency->frames++;
+
+    if (latency->report_interval > 0 &&
+        latency->histograms[FRAME_LATENCY_CAPTURE_TO_COMMIT].count >= latency->report_interval) {
+        frame_latency_report(latency);
+    }
+}
+
+int64_t frame_latency_percentile(frame_latency_t* latency,
+                                 frame_latency_stage_t stage,
+                                 double percentile) {
+    latency_histogram_t* histogram = &latency->histograms[stage];
+    if (histogram->count == 0) {
+        return 0;
+    }
+
+    // The rank of the frame that is at the percentile, counted from 1
+    uint64_t rank = (uint64_t)(percentile / 100.0 * histogram->count + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (unsigned int i = 0; i < FRAME_LATENCY_NUM_BUCKETS; i++) {
+        seen += histogram->counts[i];
+        if (seen >= rank) {
+            int64_t bound = bucket_upper_bound(i);
+            return bound < histogram->max_us ? bound : histogram->max_us;
+        }
+    }
+    return histogram->max_us;
+}
+
+void frame_latency_report(frame_latency_t* latency) {
+    uint64_t frames = latency->histograms[FRAME_LATENCY_CAPTURE_TO_COMMIT].count;
+
+    syslog(LOG_INFO,
+           "Latency of %llu frames, %lu frames dropped (%lu in total):",
+           (unsigned long long)frames,
+           latency->dropped_since_report,
+           latency->dropped_frames);
+    for (int stage = 0; stage < FRAME_LATENCY_NUM_STAGES; stage++) {
+        syslog(LOG_INFO,
+               "  %-18s p50 %5.1f ms  p90 %5.1f ms  p99 %5.1f ms  max %5.1f ms",
+               stage_names[stage],
+               frame_latency_percentile(latency, stage, 50.0) / 1000.0,
+               frame_latency_percentile(latency, stage, 90.0) / 1000.0,
+               frame_latency_percentile(latency, stage, 99.0) / 1000.0,
+               latency->histograms[stage].max_us / 1000.0);
+    }
+
+    memset(latency->histograms, 0, sizeof(latency->histograms));
+    latency->dropped_since_report = 0;
+}
@@ -0,0 +1,180 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * - frame_latency -
+ *
+ * Measures how long the frames from an image provider take from capture until
+ * the result of their analysis is shown, and counts the frames that never
+ * reached the application. All times are taken on the monotonic clock that
+ * vdo stamps the frames with.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "vdo-buffer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Buckets 0-15 are 64 us wide, above 1024 us every power of two is split in 16 buckets
+#define FRAME_LATENCY_NUM_BUCKETS (16 + 22 * 16)
+
+/**
+ * @brief The parts of the time from capture until the result is shown.
+ */
+typedef enum frame_latency_stage {
+    /// From capture until the application got the frame from vdo
+    FRAME_LATENCY_CAPTURE_TO_DEQUEUE,
+    /// From the application got the frame until the analysis was done
+    FRAME_LATENCY_DEQUEUE_TO_RESULT,
+    /// From the analysis was done until the result was committed, e.g. to an overlay
+    FRAME_LATENCY_RESULT_TO_COMMIT,
+    /// The whole time from capture until the result was committed
+    FRAME_LATENCY_CAPTURE_TO_COMMIT,
+    FRAME_LATENCY_NUM_STAGES,
+} frame_latency_stage_t;
+
+/**
+ * @brief Histogram of latencies in us with a relative resolution of 1/16.
+ */
+typedef struct latency_histogram {
+    uint64_t counts[FRAME_LATENCY_NUM_BUCKETS];
+    uint64_t count;
+    int64_t max_us;
+} latency_histogram_t;
+
+/**
+ * @brief Monotonic time in us of each step of one frame.
+ */
+typedef struct frame_latency_frame {
+    int64_t capture_us;
+    int64_t dequeue_us;
+    int64_t result_us;
+} frame_latency_frame_t;
+
+/**
+ * @brief Latency histograms and dropped frame count of one stream.
+ *
+ * The histograms cover the frames since the last report, the frame and drop
+ * counters cover the whole lifetime.
+ */
+typedef struct frame_latency {
+    latency_histogram_t histograms[FRAME_LATENCY_NUM_STAGES];
+    unsigned int report_interval;
+
+    /// Frames committed and frames vdo skipped according to the sequence numbers
+    unsigned long frames;
+    unsigned long dropped_frames;
+    unsigned long dropped_since_report;
+    unsigned int last_sequence;
+    bool has_sequence;
+
+    /// The frame that frame_latency_result_ready and frame_latency_committed apply to
+    frame_latency_frame_t current;
+} frame_latency_t;
+
+/**
+ * @brief Create a frame latency tracker.
+ *
+ * @param report_interval Number of frames between each report to the syslog, 0 for no reports.
+ * @return Pointer to new frame latency tracker, or NULL if failed.
+ */
+frame_latency_t* frame_latency_new(unsigned int report_interval);
+
+/**
+ * @brief Log a last report and free the tracker.
+ *
+ * @param latency The tracker to destroy, can be NULL.
+ */
+void frame_latency_destroy(frame_latency_t* latency);
+
+/**
+ * @brief Record that the application got a frame from vdo.
+ *
+ * Takes the capture time and the sequence number of the frame. A gap in the
+ * sequence numbers is counted as dropped frames, whether vdo or the latest
+ * frame policy of the image provider skipped them.
+ *
+ * @param latency The tracker to be used.
+ * @param buffer  The frame from img_provider_get_frame.
+ */
+void frame_latency_frame_dequeued(frame_latency_t* latency, VdoBuffer* buffer);
+
+/**
+ * @brief Get the times of the current frame.
+ *
+ * An application that fetches the next frame before the result of the current one is
+ * committed saves the times of each frame in flight after frame_latency_frame_dequeued,
+ * and makes them current again with frame_latency_set_frame when its analysis is done.
+ *
+ * @param latency The tracker to be used.
+ * @return The times of the current frame.
+ */
+frame_latency_frame_t frame_latency_get_frame(frame_latency_t* latency);
+
+/**
+ * @brief Make a frame from frame_latency_get_frame the current frame again.
+ *
+ * @param latency The tracker to be used.
+ * @param frame   The times of the frame.
+ */
+void frame_latency_set_frame(frame_latency_t* latency, const frame_latency_frame_t* frame);
+
+/**
+ * @brief Record that the analysis of the current frame is done.
+ *
+ * @param latency The tracker to be used.
+ */
+void frame_latency_result_ready(frame_latency_t* latency);
+
+/**
+ * @brief Record that the result of the current frame was committed.
+ *
+ * Adds the latencies of the frame to the histograms and logs a report every
+ * report_interval frames.
+ *
+ * @param latency The tracker to be used.
+ */
+void frame_latency_committed(frame_latency_t* latency);
+
+/**
+ * @brief Get a percentile of one stage since the last report.
+ *
+ * @param latency    The tracker to be used.
+ * @param stage      The stage to get the percentile of.
+ * @param percentile Between 0 and 100.
+ * @return The latency in us that this share of the frames were faster than, 0 if no frames.
+ */
+int64_t frame_latency_percentile(frame_latency_t* latency,
+                                 frame_latency_stage_t stage,
+                                 double percentile);
+
+/**
+ * @brief Log p50, p90, p99 and max of every stage and the dropped frames, then
+ * start over the histograms.
+ *
+ * @param latency The tracker to be used.
+ */
+void frame_latency_report(frame_latency_t* latency);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,765 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This file handles the vdo part of the vision applications.
+ */
+
+#include "imgprovider.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <glib-object.h>
+#include <gmodule.h>
+#include <limits.h>
+#include <math.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+
+#include "vdo-frame.h"
+#include "vdo-map.h"
+#include <vdo-channel.h>
+#include <vdo-error.h>
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(VdoResolutionSet, g_free);
+
+#define IMG_PROVIDER_ANALYSIS_MAX (10)
+#define IMG_PROVIDER_UTILIZATION (0.9)
+/// Queued frames are flushed when the framerate changes more than this share
+#define IMG_PROVIDER_FLUSH_CHANGE (0.25)
+
+#define MIN_SIZE 64
+
+#define STR(x)  #x
+#define XSTR(x) STR(x)
+
+/**
+ * @brief A type representing a provider of frames from VDO.
+ *
+ * Keep track of what kind of images the user wants, all the necessary
+ * VDO types to setup and maintain a stream.
+ */
+struct img_provider {
+    /// Vdo stream object.
+    VdoStream* vdo_stream;
+
+    /// Number of frames to cache in vdo, default is 3.
+    unsigned int buffer_count;
+
+    // These values are updated from the info map for the stream
+    // This means that they will follow rotation and may then differ from the
+    // values the stream was created with
+    unsigned int channel;
+    img_info_t* img_info;
+
+    img_provider_fetch_policy_t fetch_policy;
+    img_provider_stats_t stats;
+    img_provider_frame_info_t frame_info;
+
+    // Used for chaging framerate if needed
+    img_provider_framerate_controller_t framerate_controller;
+    void* framerate_controller_data;
+    img_provider_ewma_controller_t ewma_controller;
+    unsigned int frametime;
+    unsigned int mean_analysis_time;
+    unsigned int analysis_frame_count;
+    unsigned int tot_analysis_time;
+
+    int fd;
+    double wanted_framerate;
+};
+
+/**
+ * @brief Get the time in ms between two frames at a framerate
+ *
+ * Rounded up so an analysis that takes exactly the frame time is too slow.
+ *
+ * @param framerate  The framerate, larger than 0
+ *
+ * @return The frame time in ms
+ */
+static unsigned int frametime_from_framerate(double framerate) {
+    return (unsigned int)(1000.0 / framerate) + 1;
+}
+
+/**
+ * @brief Get the highest framerate of the ladder that an analysis time can keep up with
+ *
+ * @param analysis_time   Time in ms for the analysis
+ *
+ * @return The framerate
+ */
+static double ladder_step_framerate(unsigned int analysis_time) {
+    if (analysis_time < 34) {
+        return 30.0;
+    } else if (analysis_time < 41) {
+        return 25.0;
+    } else if (analysis_time < 51) {
+        return 20.0;
+    } else if (analysis_time < 67) {
+        return 15.0;
+    } else if (analysis_time < 101) {
+        return 10.0;
+    } else if (analysis_time < 201) {
+        return 5.0;
+    }
+    return 1.0;
+}
+
+static bool choose_stream_resolution(unsigned int input_channel,
+                                     img_info_t* img_info,
+                                     const char* image_fit,
+                                     unsigned int* chosen_width,
+                                     unsigned int* chosen_height,
+                                     VdoFormat* format) {
+    g_autoptr(VdoResolutionSet) set     = NULL;
+    g_autoptr(VdoChannel) channel       = NULL;
+    g_autoptr(GError) error             = NULL;
+    g_autoptr(VdoMap) resolution_filter = vdo_map_new();
+    const char* select                  = "all";
+    const char* aspect_ratio            = "native";
+    bool ambarella_workaround           = false;
+
+    *format = img_info->format;
+
+    assert(chosen_width);
+    assert(chosen_height);
+
+    g_autoptr(VdoMap) ch_desc = vdo_map_new();
+    vdo_map_set_uint32(ch_desc, "input", input_channel);
+    channel = vdo_channel_get_ex(ch_desc, &error);
+    if (!channel) {
+        syslog(LOG_ERR, "%s: Failed vdo_channel_get(): %s", __func__, error->message);
+        return false;
+    }
+
+    // Only ambarella based cameras have PLANAR RGB as model input
+    if (*format == VDO_FORMAT_PLANAR_RGB) {
+        vdo_map_set_uint32(resolution_filter, "format", VDO_FORMAT_YUV);
+        vdo_map_set_string(resolution_filter, "select", "minmax");
+        set = vdo_channel_get_resolutions(channel, resolution_filter, &error);
+        if (!set || set->count == 0) {
+            syslog(LOG_ERR,
+                   "%s: Not possible to get any resolution from vdo for %u",
+                   __func__,
+                   *format);
+            return false;
+        }
+        // The minimum width will be 64 on 12.6 and later
+        if (set->resolutions[0].width > MIN_SIZE) {
+            ambarella_workaround = true;
+            *format              = VDO_FORMAT_YUV;
+        }
+        g_clear_pointer(&set, g_free);
+    }
+
+    // Start to see if the supplied image format is available on this
+    // product. If not default to yuv
+    vdo_map_set_uint32(resolution_filter, "format", *format);
+    if (!g_strcmp0(image_fit, "crop")) {
+        aspect_ratio = NULL;
+        if (!ambarella_workaround) {
+            // Try to get the choosen resolution from vdo
+            // The only limits is the min and max resolution
+            select = "minmax";
+        } else {
+            select = "all";
+        }
+    } else if (!g_strcmp0(image_fit, "any")) {
+        // The smallest listed resolution that fits, in any aspect ratio
+        aspect_ratio = NULL;
+    }
+    vdo_map_set_string(resolution_filter, "select", select);
+    if (aspect_ratio) {
+        vdo_map_set_string(resolution_filter, "aspect_ratio", aspect_ratio);
+    }
+    set = vdo_channel_get_resolutions(channel, resolution_filter, &error);
+    if (!set || set->count == 0) {
+        // The supplied format is not supported, default to YUV
+        g_clear_pointer(&set, g_free);
+        g_clear_error(&error);
+        if (*format == VDO_FORMAT_YUV) {
+            syslog(LOG_ERR,
+                   "%s: Not possible to get any resolution from vdo for %u",
+                   __func__,
+                   *format);
+            return false;
+        }
+        *format = VDO_FORMAT_YUV;
+        vdo_map_set_uint32(resolution_filter, "format", *format);
+        set = vdo_channel_get_resolutions(channel, resolution_filter, &error);
+        if (!set || set->count == 0) {
+            syslog(LOG_ERR,
+                   "%s: Not possible to get any resolution from vdo for %u",
+                   __func__,
+                   *format);
+            return false;
+        }
+    }
+
+    // For all try to find the closest match or an exact match
+    if (!g_strcmp0(select, "all")) {
+        // Find smallest VDO stream resolution that fits the requested size.
+        ssize_t best_resolution_idx       = -1;
+        unsigned int best_resolution_area = UINT_MAX;
+        for (ssize_t i = 0; i < (ssize_t)set->count; ++i) {
+            VdoResolution* res = &set->resolutions[i];
+            if ((res->width >= img_info->width) && (res->height >= img_info->height)) {
+                unsigned int area = res->width * res->height;
+                if (area < best_resolution_area) {
+                    best_resolution_idx  = i;
+                    best_resolution_area = area;
+                }
+            }
+        }
+
+        // If we got a reasonable w/h from the VDO channel info we use that
+        // for creating the stream. If that info for some reason was empty we
+        // fall back to trying to create a stream with client-supplied w/h.
+        *chosen_width  = img_info->width;
+        *chosen_height = img_info->height;
+        if (best_resolution_idx >= 0) {
+            *chosen_width  = set->resolutions[best_resolution_idx].width;
+            *chosen_height = set->resolutions[best_resolution_idx].height;
+        } else {
+            syslog(LOG_WARNING,
+                   "%s: VDO channel info contains no reslution info. Fallback "
+                   "to client-requested stream resolution.",
+                   __func__);
+        }
+    } else {
+        // Check towards min and max.
+        *chosen_width  = img_info->width;
+        *chosen_height = img_info->height;
+
+        // Check the requested width and height towards max resolution
+        if (img_info->width > set->resolutions[1].width ||
+            img_info->height > set->resolutions[1].height) {
+            *chosen_width  = set->resolutions[1].width;
+            *chosen_height = set->resolutions[1].height;
+            syslog(LOG_WARNING,
+                   "%s: Requested width or height larger than max resolution."
+                   "Limit the requested resolution to max %ux%u.",
+                   __func__,
+                   set->resolutions[1].width,
+                   set->resolutions[1].height);
+        }
+        // Check the requested width and height towards min resolution
+        if (img_info->width < set->resolutions[0].width ||
+            img_info->height < set->resolutions[0].height) {
+            *chosen_width  = set->resolutions[0].width;
+            *chosen_height = set->resolutions[0].height;
+            syslog(LOG_WARNING,
+                   "%s: Requested width or height smaller than min resolution."
+                   "Limit the requested resolution to min %u x %u.",
+                   __func__,
+                   set->resolutions[0].width,
+                   set->resolutions[0].height);
+        }
+    }
+    const char* format_str = "rgb interleaved";
+    if (*format == VDO_FORMAT_YUV) {
+        format_str = "yuv";
+    } else if (*format == VDO_FORMAT_PLANAR_RGB) {
+        format_str = "planar rgb";
+    }
+    syslog(LOG_INFO,
+           "%s: We select stream w/h=%u x %u with format %s based on VDO channel info.\n",
+           __func__,
+           *chosen_width,
+           *chosen_height,
+           format_str);
+
+    return true;
+}
+
+const char* img_provider_version(void) {
+    return XSTR(IMG_PROVIDER_VERSION_MAJOR) "." XSTR(IMG_PROVIDER_VERSION_MINOR) "." XSTR(
+        IMG_PROVIDER_VERSION_PATCH);
+}
+
+img_info_t img_provider_get_image_metadata(img_provider_t* provider) {
+    return *provider->img_info;
+}
+
+double img_provider_get_framerate(img_provider_t* provider) {
+    return provider->img_info->framerate;
+}
+
+img_provider_stats_t img_provider_get_stats(img_provider_t* provider) {
+    return provider->stats;
+}
+
+img_provider_ewma_controller_t* img_provider_get_ewma_controller(img_provider_t* provider) {
+    return &provider->ewma_controller;
+}
+
+img_provider_frame_info_t img_provider_get_frame_info(img_provider_t* provider) {
+    return provider->frame_info;
+}
+
+int img_provider_get_fd(img_provider_t* provider) {
+    return provider->fd;
+}
+
+img_provider_t* img_provider_new(unsigned int input_channel,
+                                 img_info_t* img_info,
+                                 unsigned int num_buffers,
+                                 double framerate,
+                                 const char* image_fit) {
+    g_autoptr(VdoMap) vdo_settings  = vdo_map_new();
+    g_autoptr(VdoMap) vdo_info      = NULL;
+    g_autoptr(VdoStream) vdo_stream = NULL;
+    g_autoptr(GError) error         = NULL;
+    unsigned int chosen_width       = 0;
+    unsigned int chosen_height      = 0;
+
+    if (!vdo_settings) {
+        syslog(LOG_ERR, "%s: Failed to create vdo_map", __func__);
+        return NULL;
+    }
+    if (framerate <= 0.0) {
+        syslog(LOG_ERR, "%s: Invalid framerate %f", __func__, framerate);
+        return NULL;
+    }
+
+    // Start to get the best match for the provided img_info
+    if (!choose_stream_resolution(input_channel,
+                                  img_info,
+                                  image_fit,
+                                  &chosen_width,
+                                  &chosen_height,
+                                  &img_info->format)) {
+        syslog(LOG_ERR, "%s: Failed to choose stream resolution", __func__);
+        return NULL;
+    }
+
+    vdo_map_set_uint32(vdo_settings, "input", input_channel);
+
+    // format is the image format that is supplied from vdo
+    vdo_map_set_uint32(vdo_settings, "format", img_info->format);
+    // Set initial framerate
+    vdo_map_set_double(vdo_settings, "framerate", framerate);
+    vdo_map_set_uint32(vdo_settings, "width", chosen_width);
+    vdo_map_set_uint32(vdo_settings, "height", chosen_height);
+    // Make it possible to change the framerate for the stream after it is started
+    vdo_map_set_boolean(vdo_settings, "dynamic.framerate", true);
+    // It is not needed to set buffer.strategy since VDO_BUFFER_STRATEGY_INFINITE is default
+    // vdo_map_set_uint32(vdo_settings, "buffer.strategy", VDO_BUFFER_STRATEGY_INFINITE);
+
+    // The number of buffers that vdo will allocate for this stream
+    // Normally two buffers are enough and using too many buffers will use
+    // more memory in the product.
+    vdo_map_set_uint32(vdo_settings, "buffer.count", num_buffers);
+
+    // The vdo_stream_get_buffer is non blocking and will return immediately
+    // Then we need to poll instead when it is ok to get a buffer
+    vdo_map_set_boolean(vdo_settings, "socket.blocking", false);
+
+    syslog(LOG_INFO, "Dump of vdo stream settings map =====");
+    vdo_map_dump(vdo_settings);
+
+    // Create a vdo stream using the vdoMap filled in above
+    vdo_stream = vdo_stream_new(vdo_settings, NULL, &error);
+    if (!vdo_stream) {
+        syslog(LOG_ERR, "%s: Failed creating vdo stream: %s", __func__, error->message);
+        return NULL;
+    }
+
+    // Get the info map from the vdo stream.
+    // This will contain values how the stream was actually created and may
+    // differ from the settings map used above
+    // The most useful is width/height and pitch since these values will follow rotation
+    // and will be the resolution that the buffers from vdo have.
+    vdo_info = vdo_stream_get_info(vdo_stream, &error);
+    if (!vdo_info) {
+        syslog(LOG_ERR, "%s: Failed to get info map for stream: %s", __func__, error->message);
+        return NULL;
+    }
+
+    img_provider_t* provider = (img_provider_t*)calloc(1, sizeof(img_provider_t));
+    if (!provider) {
+        syslog(LOG_ERR, "%s: Unable to allocate ImgProvider: %s", __func__, strerror(errno));
+        return NULL;
+    }
+    provider->img_info = (img_info_t*)calloc(1, sizeof(img_info_t));
+    if (!provider->img_info) {
+        syslog(LOG_ERR, "%s: Unable to allocate img info: %s", __func__, strerror(errno));
+        free(provider);
+        return NULL;
+    }
+
+    provider->buffer_count     = num_buffers;
+    provider->fd               = -1;
+    provider->fetch_policy     = IMG_PROVIDER_FETCH_EVERY_FRAME;
+    provider->img_info->height = vdo_map_get_uint32(vdo_info, "height", chosen_height);
+    provider->img_info->width  = vdo_map_get_uint32(vdo_info, "width", chosen_width);
+    provider->img_info->pitch  = vdo_map_get_uint32(vdo_info, "pitch", provider->img_info->width);
+    provider->img_info->format = vdo_map_get_uint32(vdo_info, "format", img_info->format);
+    provider->img_info->framerate = vdo_map_get_double(vdo_info, "framerate", framerate);
+    provider->img_info->rotation  = vdo_map_get_uint32(vdo_info, "rotation", 0);
+    provider->channel             = vdo_map_get_uint32(vdo_info, "channel", 0);
+    provider->wanted_framerate    = framerate;
+
+    // Calculate the time between the images from vdo
+    provider->frametime            = frametime_from_framerate(provider->img_info->framerate);
+    provider->mean_analysis_time   = 0;
+    provider->analysis_frame_count = 0;
+    provider->tot_analysis_time    = 0;
+    img_provider_ewma_controller_init(&provider->ewma_controller, IMG_PROVIDER_UTILIZATION);
+    provider->framerate_controller      = img_provider_ewma_framerate;
+    provider->framerate_controller_data = &provider->ewma_controller;
+
+    provider->vdo_stream = g_steal_pointer(&vdo_stream);
+
+    syslog(LOG_INFO, "Image provider %s created", img_provider_version());
+
+    return provider;
+}
+
+void img_provider_destroy(img_provider_t* provider) {
+    if (!provider) {
+        return;
+    }
+
+    syslog(LOG_INFO,
+           "Image provider: %lu frames fetched, %lu skipped, %lu flushed, %u still leased, %lu "
+           "framerate changes",
+           provider->stats.frames_fetched,
+           provider->stats.frames_skipped,
+           provider->stats.frames_flushed,
+           provider->stats.frames_leased,
+           provider->stats.framerate_changes);
+
+    g_clear_object(&provider->vdo_stream);
+
+    free(provider->img_info);
+    free(provider);
+}
+
+void img_provider_set_fetch_policy(img_provider_t* provider, img_provider_fetch_policy_t policy) {
+    assert(provider);
+
+    provider->fetch_policy = policy;
+}
+
+void img_provider_set_framerate_controller(img_provider_t* provider,
+                                           img_provider_framerate_controller_t controller,
+                                           void* user_data) {
+    assert(provider);
+    assert(controller);
+
+    provider->framerate_controller      = controller;
+    provider->framerate_controller_data = user_data;
+    provider->mean_analysis_time        = 0;
+    provider->analysis_frame_count      = 0;
+    provider->tot_analysis_time         = 0;
+}
+
+void img_provider_ewma_controller_init(img_provider_ewma_controller_t* controller,
+                                       double target_utilization) {
+    assert(controller);
+
+    controller->target_utilization = target_utilization;
+    controller->smoothing          = 0.2;
+    controller->hysteresis         = 0.1;
+    controller->min_dwell_ms       = 2000;
+    controller->min_framerate      = 1.0;
+    controller->mean_analysis_time = 0.0;
+    controller->has_mean           = false;
+    controller->last_change_us     = 0;
+}
+
+double img_provider_ewma_framerate(img_provider_t* provider,
+                                   unsigned int analysis_time,
+                                   void* user_data) {
+    img_provider_ewma_controller_t* controller = (img_provider_ewma_controller_t*)user_data;
+    double framerate                           = provider->img_info->framerate;
+    int64_t now_us                             = g_get_monotonic_time();
+
+    if (!controller->has_mean) {
+        // The dwell time also applies to the first change, so a slow first
+        // analysis does not decide the framerate on its own
+        controller->mean_analysis_time = analysis_time;
+        controller->has_mean           = true;
+        controller->last_change_us     = now_us;
+    } else {
+        double weight                  = controller->smoothing;
+        controller->mean_analysis_time = weight * analysis_time +
+                                         (1.0 - weight) * controller->mean_analysis_time;
+    }
+
+    // An analysis time of 0 ms is faster than can be measured
+    double new_framerate = provider->wanted_framerate;
+    if (controller->mean_analysis_time > 0.0) {
+        new_framerate = controller->target_utilization * 1000.0 / controller->mean_analysis_time;
+    }
+    bool at_limit = false;
+    if (new_framerate >= provider->wanted_framerate) {
+        new_framerate = provider->wanted_framerate;
+        at_limit      = true;
+    } else if (new_framerate <= controller->min_framerate) {
+        new_framerate = controller->min_framerate;
+        at_limit      = true;
+    }
+
+    // Small changes are ignored, except to reach a limit that would otherwise
+    // never be reached from inside the hysteresis band
+    double change = fabs(new_framerate - framerate);
+    if (change < 0.01 || (!at_limit && change < controller->hysteresis * framerate)) {
+        return framerate;
+    }
+    if (now_us - controller->last_change_us < (int64_t)controller->min_dwell_ms * 1000) {
+        return framerate;
+    }
+    controller->last_change_us = now_us;
+    return new_framerate;
+}
+
+double img_provider_ladder_framerate(img_provider_t* provider,
+                                     unsigned int analysis_time,
+                                     void* user_data) {
+    (void)user_data;
+    double framerate = provider->img_info->framerate;
+
+    provider->analysis_frame_count++;
+    provider->tot_analysis_time += analysis_time;
+    if (provider->analysis_frame_count < IMG_PROVIDER_ANALYSIS_MAX) {
+        return framerate;
+    }
+    provider->mean_analysis_time   = provider->tot_analysis_time / provider->analysis_frame_count;
+    provider->analysis_frame_count = 0;
+    provider->tot_analysis_time    = 0;
+
+    // If the analysis time is higher or lower than the time between frames from
+    // vdo change the framerate so the latest frame will be fetched from vdo
+    if ((provider->frametime < provider->mean_analysis_time && provider->frametime < 201) ||
+        provider->frametime > provider->mean_analysis_time) {
+        framerate = ladder_step_framerate(provider->mean_analysis_time);
+        if (framerate > provider->wanted_framerate) {
+            framerate = provider->wanted_framerate;
+        }
+    }
+    return framerate;
+}
+
+bool img_provider_update_framerate(img_provider_t* provider, unsigned int analysis_time) {
+    g_autoptr(GError) error = NULL;
+    assert(provider);
+
+    double framerate = provider->framerate_controller(provider,
+                                                      analysis_time,
+                                                      provider->framerate_controller_data);
+    // The controllers change the framerate in steps far larger than this
+    if (framerate <= 0.0 || fabs(framerate - provider->img_info->framerate) < 0.01) {
+        return true;
+    }
+
+    if (!vdo_stream_set_framerate(provider->vdo_stream, framerate, &error)) {
+        syslog(LOG_ERR, "%s: Failed to change framerate: %s", __func__, error->message);
+        return false;
+    }
+    syslog(LOG_INFO,
+           "Change VDO stream framerate from %f to %f after an analysis time of %u ms",
+           provider->img_info->framerate,
+           framerate,
+           analysis_time);
+    double old_framerate          = provider->img_info->framerate;
+    provider->img_info->framerate = framerate;
+    provider->frametime           = frametime_from_framerate(framerate);
+    provider->stats.framerate_changes++;
+
+    // Flush all frames in vdo so the latest is used. After a small change the
+    // queued frames are about as fresh as the next one, and with the latest
+    // frame policy they are skipped anyway.
+    if (provider->fetch_policy == IMG_PROVIDER_FETCH_EVERY_FRAME &&
+        fabs(framerate - old_framerate) > IMG_PROVIDER_FLUSH_CHANGE * old_framerate) {
+        img_provider_flush_all_frames(provider);
+    }
+
+    return true;
+}
+
+bool img_provider_start(img_provider_t* provider) {
+    g_autoptr(GError) error = NULL;
+    assert(provider);
+
+    // Start the actual VDO streaming.
+    // The internal buffers will then be filled at the framerate set to vdo
+    // or if default the capture frequency
+    if (!vdo_stream_start(provider->vdo_stream, &error)) {
+        syslog(LOG_ERR, "%s: Failed to start stream: %s", __func__, error->message);
+        return false;
+    }
+
+    // Get the stream fd from vdo to be used for polling
+    int fd = vdo_stream_get_fd(provider->vdo_stream, &error);
+    if (fd < 0) {
+        syslog(LOG_ERR, "%s: Failed to get fd for stream: %s", __func__, error->message);
+        return false;
+    }
+    provider->fd = fd;
+    return true;
+}
+
+/**
+ * @brief Give the queued frames older than a frame back to vdo
+ *
+ * The stream is non blocking, so this only reads the frames vdo already has.
+ *
+ * @param provider  The imageprovider to be used
+ * @param vdo_buf   The oldest frame, replaced by the newest frame
+ *
+ * @return The number of frames given back
+ */
+static unsigned int skip_to_latest_frame(img_provider_t* provider, VdoBuffer** vdo_buf) {
+    g_autoptr(GError) error = NULL;
+    unsigned int skipped    = 0;
+
+    while (true) {
+        VdoBuffer* newer_buf = vdo_stream_get_buffer(provider->vdo_stream, NULL);
+        // if newer_buf is NULL it means that all buffers have been fetched from vdo
+        if (!newer_buf) {
+            return skipped;
+        }
+        if (!vdo_stream_buffer_unref(provider->vdo_stream, vdo_buf, &error)) {
+            if (!vdo_error_is_expected(&error)) {
+                syslog(LOG_ERR, "%s: Unexpected error: %s", __func__, error->message);
+            }
+            g_clear_error(&error);
+            g_clear_object(vdo_buf);
+        }
+        *vdo_buf = newer_buf;
+        skipped++;
+    }
+}
+
+bool img_provider_wait_frame(img_provider_t* provider, int timeout_ms) {
+    assert(provider);
+
+    struct pollfd fds = {
+        .fd     = provider->fd,
+        .events = POLLIN,
+    };
+    int status = 0;
+    do {
+        status = poll(&fds, 1, timeout_ms);
+    } while (status == -1 && errno == EINTR);
+
+    if (status < 0) {
+        syslog(LOG_ERR, "%s: Failed to poll fd: %s", __func__, strerror(errno));
+        return false;
+    }
+    return status > 0;
+}
+
+VdoBuffer* img_provider_get_frame(img_provider_t* provider) {
+    g_autoptr(GError) error = NULL;
+    assert(provider);
+
+    struct pollfd fds = {
+        .fd     = provider->fd,
+        .events = POLL_IN,
+    };
+    while (true) {
+        int status = 0;
+        do {
+            // If poll returns -1 then errno is set
+            // if the errno is set to EINTR then just
+            // continue this loop
+            status = poll(&fds, 1, -1);
+        } while (status == -1 && errno == EINTR);
+
+        if (status < 0) {
+            syslog(LOG_ERR, "%s: Failed to poll fd: %s", __func__, strerror(errno));
+            return NULL;
+        }
+
+        // Get video frame from the imaging pipeline
+        // If the inference time is too long this may not be the latest buffer since
+        // vdo will fill up its internal buffers and give out the oldest one
+        VdoBuffer* vdo_buf = vdo_stream_get_buffer(provider->vdo_stream, &error);
+        if (!vdo_buf) {
+            if (g_error_matches(error, VDO_ERROR, VDO_ERROR_NO_DATA)) {
+                g_clear_error(&error);
+                continue;  // Transient Error -> Retry
+            }
+            // Maintenance/Installation in progress (e.g Global Rotation)
+            if (vdo_error_is_expected(&error)) {
+                syslog(LOG_INFO, "Likely global rotation: %s", error->message);
+            } else {
+                syslog(LOG_ERR, "%s: Unexpected error: %s", __func__, error->message);
+            }
+            return NULL;
+        }
+        provider->frame_info.skipped_frames = 0;
+        if (provider->fetch_policy == IMG_PROVIDER_FETCH_LATEST_FRAME) {
+            provider->frame_info.skipped_frames = skip_to_latest_frame(provider, &vdo_buf);
+        }
+        // vdo stamps the frames in us on the monotonic clock
+        VdoFrame* frame = vdo_buffer_get_frame(vdo_buf);
+        provider->frame_info.age_us =
+            g_get_monotonic_time() - (int64_t)vdo_frame_get_timestamp(frame);
+        provider->stats.frames_fetched++;
+        provider->stats.frames_skipped += provider->frame_info.skipped_frames;
+        provider->stats.frames_leased++;
+        return vdo_buf;
+    }
+}
+
+bool img_provider_return_frame(img_provider_t* provider, VdoBuffer** buffer) {
+    g_autoptr(GError) error = NULL;
+    assert(provider);
+
+    if (!buffer || !*buffer) {
+        return true;
+    }
+    provider->stats.frames_leased--;
+    // This will allow vdo to fill this buffer with data again
+    if (!vdo_stream_buffer_unref(provider->vdo_stream, buffer, &error)) {
+        if (!vdo_error_is_expected(&error)) {
+            syslog(LOG_ERR, "%s: Unexpected error: %s", __func__, error->message);
+            g_clear_object(buffer);
+            return false;
+        }
+        g_clear_object(buffer);
+    }
+    return true;
+}
+
+void img_provider_flush_all_frames(img_provider_t* provider) {
+    g_autoptr(GError) error = NULL;
+    assert(provider);
+    // Read out all buffers from vdo
+    while (true) {
+        // Since this call will be non blocking it will return immediately
+        g_autoptr(VdoBuffer) read_vdo_buf = vdo_stream_get_buffer(provider->vdo_stream, NULL);
+        // if readVdoBuf is NULL it means that all buffers have been fetched from vdo
+        if (!read_vdo_buf) {
+            break;
+        }
+        provider->stats.frames_flushed++;
+        if (!vdo_stream_buffer_unref(provider->vdo_stream, &read_vdo_buf, &error)) {
+            if (!vdo_error_is_expected(&error)) {
+                syslog(LOG_ERR, "%s: Unexpected error: %s", __func__, error->message);
+            }
+            g_clear_error(&error);
+        }
+    }
+}
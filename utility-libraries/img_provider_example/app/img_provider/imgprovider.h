@@ -0,0 +1,392 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * - img_provider -
+ *
+ * A shared library that provides frames from a VDO stream to vision
+ * applications. The frames are leased to the application without copying,
+ * and the framerate of the stream can follow the analysis time of the
+ * application.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "vdo-error.h"
+#include "vdo-stream.h"
+#include "vdo-types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IMG_PROVIDER_VERSION_MAJOR 1
+#define IMG_PROVIDER_VERSION_MINOR 7
+#define IMG_PROVIDER_VERSION_PATCH 0
+
+// This is a limitation from vdo
+#define MAX_NBR_IMG_PROVIDER_BUFFERS 5
+
+/**
+ * @brief A type representing the buffers from vdo
+ *
+ * Contains information needed by larod to be able to set correct
+ * properties on the imgInputTensors.
+ */
+typedef struct img_info {
+    VdoFormat format;
+    unsigned int width;
+    unsigned int height;
+    unsigned int pitch;
+    double framerate;
+    unsigned int rotation;
+} img_info_t;
+
+/**
+ * @brief Which frame img_provider_get_frame hands out.
+ */
+typedef enum img_provider_fetch_policy {
+    /// Every frame in the order vdo delivers them, the oldest queued frame first
+    IMG_PROVIDER_FETCH_EVERY_FRAME,
+    /// Only the newest queued frame, older queued frames are given back to vdo
+    /// without blocking, so a slow analysis always gets the freshest frame
+    IMG_PROVIDER_FETCH_LATEST_FRAME,
+} img_provider_fetch_policy_t;
+
+/**
+ * @brief Counters of one stream, see img_provider_get_stats.
+ */
+typedef struct img_provider_stats {
+    /// Frames handed out by img_provider_get_frame
+    unsigned long frames_fetched;
+    /// Frames given back to vdo unseen by IMG_PROVIDER_FETCH_LATEST_FRAME
+    unsigned long frames_skipped;
+    /// Frames thrown away by img_provider_flush_all_frames
+    unsigned long frames_flushed;
+    /// Frames handed out and not yet given back with img_provider_return_frame
+    unsigned int frames_leased;
+    /// Number of times the framerate of the stream was changed
+    unsigned long framerate_changes;
+} img_provider_stats_t;
+
+/**
+ * @brief How fresh the frame most recently handed out is, see img_provider_get_frame_info.
+ */
+typedef struct img_provider_frame_info {
+    /// Queued frames given back to vdo unseen to get to this frame
+    unsigned int skipped_frames;
+    /// Time in us from the capture of the frame until it was handed out
+    int64_t age_us;
+} img_provider_frame_info_t;
+
+/**
+ * @brief A provider of frames from VDO.
+ *
+ * The type is opaque so that fields can be added without breaking applications
+ * built against an older version, use the functions below to access it.
+ */
+typedef struct img_provider img_provider_t;
+
+/**
+ * @brief Settings and state of the continuous framerate controller
+ *
+ * The controller keeps an exponentially weighted moving average (EWMA) of the
+ * analysis time and sets the framerate so the analysis takes target_utilization
+ * of the time between two frames. A new framerate is only used if it differs
+ * more than hysteresis from the current one and min_dwell_ms has passed since
+ * the last change, so the stream does not oscillate around a limit.
+ * Set it up with img_provider_ewma_controller_init.
+ */
+typedef struct img_provider_ewma_controller {
+    /// Share of the frame time the analysis may use, 0.9 leaves 10% headroom
+    double target_utilization;
+    /// Weight of a new analysis time in the moving average, between 0 and 1
+    double smoothing;
+    /// Relative change of the framerate needed before it is changed
+    double hysteresis;
+    /// Shortest time in ms between two changes of the framerate
+    unsigned int min_dwell_ms;
+    /// The framerate is never set lower than this
+    double min_framerate;
+
+    double mean_analysis_time;
+    bool has_mean;
+    int64_t last_change_us;
+} img_provider_ewma_controller_t;
+
+/**
+ * @brief Decides the framerate of a stream from the analysis time of a frame.
+ *
+ * Called by img_provider_update_framerate for every analyzed frame.
+ *
+ * @param provider       The imageprovider whose framerate is decided
+ * @param analysis_time  Time in ms the application spent on the frame
+ * @param user_data      The user_data given to img_provider_set_framerate_controller
+ *
+ * @return The framerate to use, return img_provider_get_framerate(provider) to keep it
+ */
+typedef double (*img_provider_framerate_controller_t)(img_provider_t* provider,
+                                                      unsigned int analysis_time,
+                                                      void* user_data);
+
+/**
+ * @brief Get the version of the loaded library
+ *
+ * @return Version string on the form major.minor.patch
+ */
+const char* img_provider_version(void);
+
+/**
+ * @brief Initializes an ImgProvider.
+ *
+ * Make sure to check the metadata from img_provider_get_image_metadata to
+ * find resolution of the created stream. These numbers might not match the
+ * requested resolution depending on platform properties.
+ *
+ * @param input_channel   Video input channel to be used
+ * @param img_info        Requested stream properties, the format is updated if
+ *                        it is not supported
+ * @param num_buffers     Number of buffers the vdo will allocate for the stream
+ * @param framerate       Initial framerate of the stream
+ * @param image_fit       "crop" to get a resolution as close as possible to the requested
+ *                        one in any aspect ratio, "any" to get the smallest listed resolution
+ *                        in any aspect ratio that fits the requested one, otherwise the
+ *                        smallest resolution with the native aspect ratio that fits the
+ *                        requested one is used. Can be NULL.
+ *
+ * @return Pointer to new ImgProvider, or NULL if failed.
+ */
+img_provider_t* img_provider_new(unsigned int input_channel,
+                                 img_info_t* img_info,
+                                 unsigned int num_buffers,
+                                 double framerate,
+                                 const char* image_fit);
+
+/**
+ * @brief Release VDO Stream object and deallocate provider.
+ *
+ * @param provider Pointer to ImgProvider to be destroyed.
+ */
+void img_provider_destroy(img_provider_t* provider);
+
+/**
+ * @brief Start the imgProvider and get fd for this imgprovider
+ *
+ * @param provider  The imageprovider to be used
+ *
+ * @return true if the imgprovider was started and a fd was get.
+ */
+bool img_provider_start(img_provider_t* provider);
+
+/**
+ * @brief Choose which frame img_provider_get_frame hands out
+ *
+ * The default is IMG_PROVIDER_FETCH_EVERY_FRAME.
+ *
+ * @param provider  The imageprovider to be used
+ * @param policy    The fetch policy
+ */
+void img_provider_set_fetch_policy(img_provider_t* provider, img_provider_fetch_policy_t policy);
+
+/**
+ * @brief Get a frame from the imgProvider
+ *
+ * Blocks until vdo has a frame. The frame data is not copied, the buffer is
+ * leased to the application until it is given back with img_provider_return_frame.
+ *
+ * @param provider  The imageprovider to be used
+ *
+ * @return NULL if expected error otherwise a VdoBuffer
+ */
+VdoBuffer* img_provider_get_frame(img_provider_t* provider);
+
+/**
+ * @brief Wait until vdo has a frame or the timeout expires
+ *
+ * Use this before img_provider_get_frame when the application can not block
+ * for a whole frame time, e.g. when it gathers frames from several streams.
+ *
+ * @param provider    The imageprovider to be used
+ * @param timeout_ms  Max time to wait, 0 to only check and -1 to wait forever
+ *
+ * @return true if img_provider_get_frame would not block, false on timeout or error
+ */
+bool img_provider_wait_frame(img_provider_t* provider, int timeout_ms);
+
+/**
+ * @brief Get the fd of the vdo stream
+ *
+ * The fd is readable when vdo has a frame. Poll it together with the other fds
+ * of the application, e.g. the completion fd of asynchronous analysis jobs.
+ *
+ * @param provider  The imageprovider to be used, started with img_provider_start
+ *
+ * @return The fd, or -1 if the provider has not been started
+ */
+int img_provider_get_fd(img_provider_t* provider);
+
+/**
+ * @brief Get how fresh the frame most recently handed out by img_provider_get_frame is
+ *
+ * The age is measured on the monotonic clock that vdo stamps the frames with.
+ * A frame that is older than the frame time of the stream has been waiting in
+ * vdo, use IMG_PROVIDER_FETCH_LATEST_FRAME to skip such frames.
+ *
+ * @param provider  The imageprovider to be used
+ *
+ * @return img_provider_frame_info_t struct
+ */
+img_provider_frame_info_t img_provider_get_frame_info(img_provider_t* provider);
+
+/**
+ * @brief Give a frame from img_provider_get_frame back to vdo
+ *
+ * @param provider  The imageprovider to be used
+ * @param buffer    The buffer to give back, set to NULL
+ *
+ * @return false if vdo failed with an unexpected error, otherwise true
+ */
+bool img_provider_return_frame(img_provider_t* provider, VdoBuffer** buffer);
+
+/**
+ * @brief Flush all frames in vdo
+ *
+ * @param provider  The imageprovider to be used
+ *
+ */
+void img_provider_flush_all_frames(img_provider_t* provider);
+
+/**
+ * @brief Get metadata about the image
+ *
+ * @param provider  The imageprovider to be used
+ *
+ * @return img_info_t struct
+ */
+img_info_t img_provider_get_image_metadata(img_provider_t* provider);
+
+/**
+ * @brief Get the current framerate of the stream
+ *
+ * @param provider  The imageprovider to be used
+ *
+ * @return The framerate in fps
+ */
+double img_provider_get_framerate(img_provider_t* provider);
+
+/**
+ * @brief Get the counters of the stream
+ *
+ * @param provider  The imageprovider to be used
+ *
+ * @return img_provider_stats_t struct
+ */
+img_provider_stats_t img_provider_get_stats(img_provider_t* provider);
+
+/**
+ * @brief Replace the controller that decides the framerate of the stream
+ *
+ * The default controller is img_provider_ewma_framerate with the settings
+ * from img_provider_ewma_controller_init with a target utilization of 0.9,
+ * see img_provider_get_ewma_controller.
+ *
+ * @param provider    The imageprovider to be used
+ * @param controller  The new controller
+ * @param user_data   Passed to every call of the controller
+ */
+void img_provider_set_framerate_controller(img_provider_t* provider,
+                                           img_provider_framerate_controller_t controller,
+                                           void* user_data);
+
+/**
+ * @brief Get the settings of the default framerate controller of a provider
+ *
+ * Change the fields, or call img_provider_ewma_controller_init on it, to tune
+ * the default controller.
+ *
+ * @param provider  The imageprovider to be used
+ *
+ * @return The controller, owned by the provider
+ */
+img_provider_ewma_controller_t* img_provider_get_ewma_controller(img_provider_t* provider);
+
+/**
+ * @brief Set up a continuous framerate controller
+ *
+ * Uses a smoothing of 0.2, a hysteresis of 0.1, a dwell time of 2000 ms and
+ * a minimum framerate of 1 fps. Change the fields afterwards to tune it.
+ *
+ * @param controller          The controller to set up
+ * @param target_utilization  Share of the frame time the analysis may use, between 0 and 1
+ */
+void img_provider_ewma_controller_init(img_provider_ewma_controller_t* controller,
+                                       double target_utilization);
+
+/**
+ * @brief The continuous framerate controller
+ *
+ * Sets the framerate to target_utilization / mean analysis time, limited to
+ * min_framerate and the framerate the provider was created with.
+ *
+ * @param provider       The imageprovider to be used
+ * @param analysis_time  Time in ms for the analysis
+ * @param user_data      An img_provider_ewma_controller_t
+ *
+ * @return The framerate to use
+ */
+double img_provider_ewma_framerate(img_provider_t* provider,
+                                   unsigned int analysis_time,
+                                   void* user_data);
+
+/**
+ * @brief A framerate controller with fixed steps
+ *
+ * Averages the analysis time over 10 frames and picks the highest framerate
+ * of 30, 25, 20, 15, 10, 5 and 1 fps whose frame time is longer than the
+ * mean, but never more than the framerate the provider was created with.
+ *
+ * @param provider       The imageprovider to be used
+ * @param analysis_time  Time in ms for the analysis
+ * @param user_data      Not used
+ *
+ * @return The framerate to use
+ */
+double img_provider_ladder_framerate(img_provider_t* provider,
+                                     unsigned int analysis_time,
+                                     void* user_data);
+
+/**
+ * @brief Update framerate for the imgProvider
+ *
+ * Asks the framerate controller for a framerate and changes the framerate of
+ * the stream if it differs from the current one. The frames vdo has queued are
+ * flushed only if the framerate changes more than 25%, since they are not much
+ * older than new frames after a small adjustment.
+ *
+ * @param provider       The imageprovider to be used
+ * @param analysis_time  The analysis time to be used for
+ * framerate calculation
+ *
+ * @return false if the framerate could not be changed, otherwise true
+ */
+bool img_provider_update_framerate(img_provider_t* provider, unsigned int analysis_time);
+
+#ifdef __cplusplus
+}
+#endif
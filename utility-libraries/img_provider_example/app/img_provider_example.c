@@ -0,0 +1,88 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * - img_provider_example -
+ *
+ * This application fetches frames from the image provider library and writes
+ * their size and the counters of the stream to the syslog.
+ */
+
+#include <stdlib.h>
+#include <syslog.h>
+
+#include "imgprovider.h"
+
+#define NUM_FRAMES 100
+
+int main(void) {
+    img_provider_t* image_provider = NULL;
+    img_info_t requested           = {.format = VDO_FORMAT_YUV, .width = 640, .height = 360};
+    int ret                        = EXIT_FAILURE;
+
+    openlog(NULL, LOG_PID, LOG_USER);
+    syslog(LOG_INFO, "Using image provider library %s", img_provider_version());
+
+    image_provider = img_provider_new(1, &requested, 2, 30.0, NULL);
+    if (!image_provider) {
+        syslog(LOG_ERR, "Could not create image provider");
+        goto end;
+    }
+    img_info_t image_metadata = img_provider_get_image_metadata(image_provider);
+    syslog(LOG_INFO,
+           "Stream resolution %u x %u at %.1f fps",
+           image_metadata.width,
+           image_metadata.height,
+           image_metadata.framerate);
+
+    // Only analyze the newest frame, older frames are given back to vdo unseen
+    img_provider_set_fetch_policy(image_provider, IMG_PROVIDER_FETCH_LATEST_FRAME);
+    if (!img_provider_start(image_provider)) {
+        syslog(LOG_ERR, "Could not start image provider");
+        goto end;
+    }
+
+    for (unsigned int i = 0; i < NUM_FRAMES; i++) {
+        VdoBuffer* vdo_buf = img_provider_get_frame(image_provider);
+        if (!vdo_buf) {
+            syslog(LOG_ERR, "No buffer from image provider");
+            goto end;
+        }
+        VdoFrame* frame                      = vdo_buffer_get_frame(vdo_buf);
+        img_provider_frame_info_t frame_info = img_provider_get_frame_info(image_provider);
+        syslog(LOG_INFO,
+               "Frame %u of %zu bytes, %u ms old, skipped %u older frames",
+               i,
+               vdo_frame_get_size(frame),
+               (unsigned int)(frame_info.age_us / 1000),
+               frame_info.skipped_frames);
+        if (!img_provider_return_frame(image_provider, &vdo_buf)) {
+            goto end;
+        }
+    }
+
+    img_provider_stats_t stats = img_provider_get_stats(image_provider);
+    syslog(LOG_INFO,
+           "Fetched %lu frames and skipped %lu older frames",
+           stats.frames_fetched,
+           stats.frames_skipped);
+    ret = EXIT_SUCCESS;
+
+end:
+    img_provider_destroy(image_provider);
+    syslog(LOG_INFO, "Exit application");
+    return ret;
+}
@@ -30,6 +30,70 @@ typedef struct model_tensor_output {
     larodTensorDataType datatype;
 } model_tensor_output_t;
 
+// Max number of vdo buffers whose memory is used directly as larod input, each
+// buffer is imported once for every slot it is analyzed in
+#define MODEL_MAX_IMPORTED_BUFFERS 16
+
+/**
+ * A vdo buffer imported as larod input tensor, with the job request that reads
+ * the frame straight from it. VDO recycles a few buffers so each is imported once.
+ */
+typedef struct model_imported_buffer {
+    uint32_t id;
+    size_t slot;
+    larodTensor** tensors;
+    size_t num_tensors;
+    larodJobRequest* req;
+    // The crop of the provider that the job request was last given
+    unsigned int crop_version;
+} model_imported_buffer_t;
+
+// Max number of frames analyzed at the same time in async mode. Each frame in flight
+// holds a vdo buffer until its jobs are done, so vdo needs more buffers than this.
+#define MODEL_MAX_SLOTS 3
+
+/**
+ * One frame in flight in async mode. Every slot has its own model input and output
+ * tensors, so the jobs of one frame never overwrite the data of another. Slot 0 uses
+ * the tensors and job requests of the synchronous calls.
+ */
+typedef struct model_slot {
+    size_t index;
+    int completion_fd;
+    larodTensor** pp_input_tensors;
+    larodTensor** pp_output_tensors;
+    larodTensor** input_tensors;
+    larodTensor** output_tensors;
+    larodJobRequest* pp_req;
+    larodJobRequest* inf_req;
+    // The crop of the provider that pp_req was last given
+    unsigned int crop_version;
+    void* image_input_addr;
+    model_tensor_output_t* outputs;
+    // The frame analyzed in the slot, NULL if the slot is free
+    VdoBuffer* vdo_buf;
+    // The running job reads the frame straight from the vdo buffer
+    bool imported;
+    // The inference job is running, otherwise the preprocessing job
+    bool inferring;
+    int64_t submit_us;
+    // Time in ms the jobs of the frame kept larod busy, not counting the time the
+    // frame waited for the frames before it
+    unsigned int busy_ms;
+} model_slot_t;
+
+/**
+ * What model_handle_completion found out about a frame in flight.
+ */
+typedef enum model_job_status {
+    /// More jobs of the frame are running
+    MODEL_JOB_PENDING,
+    /// The outputs of the slot are ready
+    MODEL_JOB_DONE,
+    /// A job could not run since there was no power, the frame was not analyzed
+    MODEL_JOB_NO_POWER,
+} model_job_status_t;
+
 typedef struct model_provider {
     larodConnection* conn;
     larodJobRequest* pp_req;
@@ -56,7 +120,24 @@ typedef struct model_provider {
     model_tensor_output_t* model_output_tensors;
     const char* device_name;
     larodModel* model;
+    larodModel* pp_model;
+    // The crop of the preprocessing jobs, changed in place by model_provider_update_crop
     larodMap* crop_map;
+    // Bumped on every crop change, a job request gets the new crop before its next job
+    unsigned int crop_version;
+    unsigned int stream_width;
+    unsigned int stream_height;
+    // Read the frames straight from the vdo buffers instead of copying them, turned
+    // off if larod can not import the vdo buffers
+    bool zero_copy;
+    model_imported_buffer_t imported_buffers[MODEL_MAX_IMPORTED_BUFFERS];
+    size_t num_imported_buffers;
+    // Frames in flight in async mode, see model_enable_async
+    model_slot_t slots[MODEL_MAX_SLOTS];
+    size_t num_slots;
+    // The larod callbacks write a completion to [1] that the main loop reads from [0]
+    int completion_fds[2];
+    int64_t last_completion_us;
 } model_provider_t;
 
 bool model_run_inference(model_provider_t* provider, VdoBuffer* vdo_buf);
@@ -69,7 +150,18 @@ img_info_t model_provider_get_model_metadata(model_provider_t* provider);
 
 bool model_provider_update_image_metadata(model_provider_t* provider, img_info_t* img_info);
 
-void model_provider_update_crop(model_provider_t* provider,
+/**
+ * @brief Set the area of the frame that is scaled into the model input.
+ *
+ * Can be called before model_provider_update_image_metadata and then for every
+ * frame. The crop map and the job requests are reused, a job request is given the
+ * new crop right before it runs its next job, so changing the crop allocates nothing.
+ * Frames already in flight keep the crop they were submitted with.
+ *
+ * @return False if the area is outside the frame, or if the frames are not
+ *         preprocessed since the stream already has the size of the model input.
+ */
+bool model_provider_update_crop(model_provider_t* provider,
                                 uint32_t clip_x,
                                 uint32_t clip_y,
                                 uint32_t clip_w,
@@ -79,3 +171,80 @@ model_provider_t*
 model_provider_new(char* model_file, char* device_name, size_t* num_output_tensors);
 
 void model_provider_destroy(model_provider_t* provider);
+
+/**
+ * @brief Let up to num_slots frames be analyzed at the same time.
+ *
+ * Every slot but the first gets its own input and output tensors and job requests.
+ * The jobs of a frame are started with model_submit_frame and run while the
+ * application does other work, e.g. parses the outputs of the previous frame.
+ * A completion is signaled on the fd from model_get_completion_fd for every job.
+ *
+ * @param provider   The model provider to be used
+ * @param num_slots  Max number of frames in flight, at most MODEL_MAX_SLOTS
+ */
+void model_enable_async(model_provider_t* provider, size_t num_slots);
+
+/**
+ * @brief Get the fd that is readable when a job has completed.
+ *
+ * Poll it together with the fd of the vdo stream and call model_handle_completion
+ * when it is readable.
+ */
+int model_get_completion_fd(model_provider_t* provider);
+
+/**
+ * @brief Find a slot that has no frame in flight.
+ *
+ * @return False if every slot has a frame in flight.
+ */
+bool model_get_free_slot(model_provider_t* provider, size_t* slot);
+
+/**
+ * @brief Get the number of frames in flight.
+ */
+size_t model_get_busy_slots(model_provider_t* provider);
+
+/**
+ * @brief Start the jobs of a frame in a free slot.
+ *
+ * The frame is kept by the slot until it is given back by model_release_slot.
+ *
+ * @return False if the job could not be started since there was no power, the
+ *         slot is then still free and the frame has to be given back to vdo.
+ */
+bool model_submit_frame(model_provider_t* provider, size_t slot, VdoBuffer* vdo_buf);
+
+/**
+ * @brief Handle a job completion signaled on the completion fd.
+ *
+ * Blocks until a job has completed. The inference job of a frame is started when
+ * its preprocessing job is done.
+ *
+ * @param provider  The model provider to be used
+ * @param slot      Set to the slot of the completed job
+ *
+ * @return MODEL_JOB_DONE when the outputs of the slot can be read, the slot must then
+ *         be released with model_release_slot, also after MODEL_JOB_NO_POWER.
+ */
+model_job_status_t model_handle_completion(model_provider_t* provider, size_t* slot);
+
+bool model_get_slot_output_info(model_provider_t* provider,
+                                size_t slot,
+                                unsigned int tensor_output_index,
+                                model_tensor_output_t* tensor_output);
+
+/**
+ * @brief Get the time in ms the jobs of the frame in a slot kept larod busy.
+ *
+ * Frames in flight wait for each other, so this is the share of the analysis time
+ * that limits the framerate and not the time from submit to completion.
+ */
+unsigned int model_get_slot_busy_ms(model_provider_t* provider, size_t slot);
+
+/**
+ * @brief Free a slot whose frame is done.
+ *
+ * @return The frame of the slot, to be given back to vdo.
+ */
+VdoBuffer* model_release_slot(model_provider_t* provider, size_t slot);
@@ -21,12 +21,15 @@
  * outputs values corresponding to either person or car.
  *
  * The application expects four arguments on the command line in the
- * following order: DEVICENAME MODEL.
+ * following order: DEVICENAME MODEL [SLOTS].
  *
  * First argument, DEVICENAME, is a string that is the larod device name
  *
  * Second argument, MODEL, is a string describing path to the model.
  *
+ * Third argument, SLOTS, is optional and is the number of frames analyzed at
+ * the same time. The default 1 analyzes one frame at a time synchronously.
+ *
  */
 
 #include <errno.h>
@@ -34,6 +37,7 @@
 #include <glib-object.h>
 #include <gmodule.h>
 #include <math.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -44,6 +48,7 @@
 #include <syslog.h>
 #include <unistd.h>
 
+#include "framelatency.h"
 #include "imgprovider.h"
 #include "larod.h"
 #include "model.h"
@@ -59,14 +64,78 @@ static void shutdown(int status) {
     running = 0;
 }
 
+static void log_scores(const char* device_name, model_tensor_output_t* tensor_outputs) {
+    if (strcmp(device_name, "ambarella-cvflow") != 0) {
+        uint8_t* person_pred = (uint8_t*)tensor_outputs[0].data;
+        uint8_t* car_pred    = (uint8_t*)tensor_outputs[1].data;
+        syslog(LOG_INFO,
+               "Person detected: %.2f%% - Car detected: %.2f%%",
+               (float)*person_pred / 2.55f,
+               (float)*car_pred / 2.55f);
+    } else {
+        uint8_t* car_pred    = (uint8_t*)tensor_outputs[0].data;
+        uint8_t* person_pred = (uint8_t*)tensor_outputs[1].data;
+
+        float float_score_car    = *((float*)car_pred);
+        float float_score_person = *((float*)person_pred);
+        syslog(LOG_INFO,
+               "Person detected: %.2f%% - Car detected: %.2f%%",
+               float_score_person * 100,
+               float_score_car * 100);
+    }
+}
+
+/**
+ * @brief Log the result of a frame whose jobs are done and give the frame back to vdo.
+ */
+static void finish_slot(model_provider_t* model_provider,
+                        img_provider_t* image_provider,
+                        frame_latency_t* latency,
+                        frame_latency_frame_t* slot_frames,
+                        const char* device_name,
+                        model_tensor_output_t* tensor_outputs,
+                        size_t number_output_tensors,
+                        size_t slot,
+                        model_job_status_t status) {
+    VdoBuffer* vdo_buf = NULL;
+
+    if (status == MODEL_JOB_DONE) {
+        frame_latency_set_frame(latency, &slot_frames[slot]);
+        unsigned int busy_ms = model_get_slot_busy_ms(model_provider, slot);
+        syslog(LOG_INFO, "Ran inference for %u ms in slot %zu", busy_ms, slot);
+
+        // The framerate follows the time larod is busy with each frame, the frames in
+        // flight only wait for each other
+        if (!img_provider_update_framerate(image_provider, busy_ms)) {
+            panic("%s: Failed to update framerate", __func__);
+        }
+        for (size_t i = 0; i < number_output_tensors; i++) {
+            if (!model_get_slot_output_info(model_provider, slot, i, &tensor_outputs[i])) {
+                panic("Failed to get output tensor info for %zu", i);
+            }
+        }
+        frame_latency_result_ready(latency);
+        log_scores(device_name, tensor_outputs);
+        frame_latency_committed(latency);
+    }
+
+    vdo_buf = model_release_slot(model_provider, slot);
+    if (!img_provider_return_frame(image_provider, &vdo_buf)) {
+        panic("%s: Failed to return frame", __func__);
+    }
+    if (status == MODEL_JOB_NO_POWER) {
+        img_provider_flush_all_frames(image_provider);
+    }
+}
+
 /**
  * @brief Main function that starts a stream with different options.
  */
 int main(int argc, char** argv) {
     char* device_name                     = argv[1];
     char* model_file                      = argv[2];
-    g_autoptr(GError) vdo_error           = NULL;
     img_provider_t* image_provider        = NULL;
+    frame_latency_t* latency              = NULL;
     model_provider_t* model_provider      = NULL;
     model_tensor_output_t* tensor_outputs = NULL;
     img_info_t model_metadata             = {0};
@@ -78,10 +147,15 @@ int main(int argc, char** argv) {
 
     syslog(LOG_INFO, "Starting %s", argv[0]);
 
-    if (argc != 3) {
+    if (argc != 3 && argc != 4) {
         syslog(LOG_ERR,
                "Invalid number of arguments. Required arguments are: "
-               "DEVICENAME MODEL_PATH");
+               "DEVICENAME MODEL_PATH [SLOTS]");
+        goto end;
+    }
+    size_t num_slots = argc == 4 ? strtoul(argv[3], NULL, 10) : 1;
+    if (num_slots < 1 || num_slots > MODEL_MAX_SLOTS) {
+        syslog(LOG_ERR, "Invalid number of slots %s, max is %d", argv[3], MODEL_MAX_SLOTS);
         goto end;
     }
 
@@ -105,7 +179,12 @@ int main(int argc, char** argv) {
 
     // Set crop as scale method meaning that if possible use vdo to get a center cropped
     // image if the native aspect ratio does not match the model resolution aspect ratio.
-    image_provider = img_provider_new(vdo_input_channel, &model_metadata, 2, vdo_framerate, "crop");
+    // Every frame in flight holds a vdo buffer, and vdo needs one more to fill
+    image_provider = img_provider_new(vdo_input_channel,
+                                      &model_metadata,
+                                      num_slots + 1,
+                                      vdo_framerate,
+                                      "crop");
     if (!image_provider) {
         // It is considered an error if the img provider can not supply the
         // requested stream
@@ -113,7 +192,6 @@ int main(int argc, char** argv) {
     }
 
     image_metadata = img_provider_get_image_metadata(image_provider);
-    model_provider_update_image_metadata(model_provider, &image_metadata);
 
     // An cropped image is required
     // If VDO couldn't supply the correct resolution
@@ -142,7 +220,24 @@ int main(int argc, char** argv) {
         unsigned int clip_x = (stream_width - clip_w) / 2;
         unsigned int clip_y = (stream_height - clip_h) / 2;
         syslog(LOG_INFO, "Crop input image X=%d Y=%d (%d x %d)", clip_x, clip_y, clip_w, clip_h);
-        model_provider_update_crop(model_provider, clip_x, clip_y, clip_w, clip_h);
+        if (!model_provider_update_crop(model_provider, clip_x, clip_y, clip_w, clip_h)) {
+            panic("%s: Could not crop the input image", __func__);
+        }
+    }
+    // The job requests are created with the crop, model_provider_update_crop can still
+    // move it for any later frame without creating them again
+    model_provider_update_image_metadata(model_provider, &image_metadata);
+    if (num_slots > 1) {
+        model_enable_async(model_provider, num_slots);
+    }
+
+    // Analyze the newest frame vdo has, older queued frames would make the result lag
+    img_provider_set_fetch_policy(image_provider, IMG_PROVIDER_FETCH_LATEST_FRAME);
+
+    // Report the latency percentiles and dropped frames every 100 frames
+    latency = frame_latency_new(100);
+    if (!latency) {
+        panic("%s: Could not create frame latency", __func__);
     }
 
     syslog(LOG_INFO, "Start fetching video frames from VDO");
@@ -150,6 +245,74 @@ int main(int argc, char** argv) {
         panic("%s: Could not start image provider", __func__);
     }
 
+    // The times of the frame in each slot until its result is logged
+    frame_latency_frame_t slot_frames[MODEL_MAX_SLOTS];
+
+    // Fetch the next frame while larod analyzes the frames in flight
+    while (running && num_slots > 1) {
+        size_t slot        = 0;
+        bool has_free_slot = model_get_free_slot(model_provider, &slot);
+        // Only wait for a frame if there is a free slot to analyze it in
+        struct pollfd fds[] = {
+            {.fd = has_free_slot ? img_provider_get_fd(image_provider) : -1, .events = POLLIN},
+            {.fd = model_get_completion_fd(model_provider), .events = POLLIN},
+        };
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            panic("%s: Failed to poll: %s", __func__, strerror(errno));
+        }
+
+        if (fds[1].revents & POLLIN) {
+            size_t done_slot          = 0;
+            model_job_status_t status = model_handle_completion(model_provider, &done_slot);
+            if (status != MODEL_JOB_PENDING) {
+                finish_slot(model_provider,
+                            image_provider,
+                            latency,
+                            slot_frames,
+                            device_name,
+                            tensor_outputs,
+                            number_output_tensors,
+                            done_slot,
+                            status);
+            }
+        }
+
+        if (fds[0].revents & POLLIN) {
+            VdoBuffer* vdo_buf = img_provider_get_frame(image_provider);
+            if (!vdo_buf) {
+                panic("%s: No buffer because of changed global rotation.", __func__);
+            }
+            frame_latency_frame_dequeued(latency, vdo_buf);
+            slot_frames[slot] = frame_latency_get_frame(latency);
+            if (!model_submit_frame(model_provider, slot, vdo_buf)) {
+                // No power
+                if (!img_provider_return_frame(image_provider, &vdo_buf)) {
+                    panic("%s: Failed to return frame", __func__);
+                }
+                img_provider_flush_all_frames(image_provider);
+            }
+        }
+    }
+    // Let the frames in flight finish so they can be given back to vdo
+    while (num_slots > 1 && model_get_busy_slots(model_provider) > 0) {
+        size_t done_slot          = 0;
+        model_job_status_t status = model_handle_completion(model_provider, &done_slot);
+        if (status != MODEL_JOB_PENDING) {
+            finish_slot(model_provider,
+                        image_provider,
+                        latency,
+                        slot_frames,
+                        device_name,
+                        tensor_outputs,
+                        number_output_tensors,
+                        done_slot,
+                        status);
+        }
+    }
+
     while (running) {
         struct timeval start_ts, end_ts;
         unsigned int inference_ms     = 0;
@@ -161,15 +324,18 @@ int main(int argc, char** argv) {
             // the stream has to be restarted because rotation has been changed.
             panic("%s: No buffer because of changed global rotation.", __func__);
         }
+        frame_latency_frame_dequeued(latency, vdo_buf);
+        img_provider_frame_info_t frame_info = img_provider_get_frame_info(image_provider);
+        syslog(LOG_INFO,
+               "Fetched a frame %u ms old, skipped %u older frames",
+               (unsigned int)(frame_info.age_us / 1000),
+               frame_info.skipped_frames);
         // Convert data to the correct format
         gettimeofday(&start_ts, NULL);
         if (!model_run_inference(model_provider, vdo_buf)) {
             // No power
-            if (!vdo_stream_buffer_unref(image_provider->vdo_stream, &vdo_buf, &vdo_error)) {
-                if (!vdo_error_is_expected(&vdo_error)) {
-                    panic("%s: Unexpexted error: %s", __func__, vdo_error->message);
-                }
-                g_clear_error(&vdo_error);
+            if (!img_provider_return_frame(image_provider, &vdo_buf)) {
+                panic("%s: Failed to return frame", __func__);
             }
             img_provider_flush_all_frames(image_provider);
             continue;
@@ -183,42 +349,28 @@ int main(int argc, char** argv) {
         total_elapsed_ms = inference_ms;
 
         // Check if the framerate from vdo should be changed
-        img_provider_update_framerate(image_provider, total_elapsed_ms);
+        if (!img_provider_update_framerate(image_provider, total_elapsed_ms)) {
+            panic("%s: Failed to update framerate", __func__);
+        }
 
         for (size_t i = 0; i < number_output_tensors; i++) {
             if (!model_get_tensor_output_info(model_provider, i, &tensor_outputs[i])) {
                 panic("Failed to get output tensor info for %zu", i);
             }
         }
+        frame_latency_result_ready(latency);
 
-        if (strcmp(device_name, "ambarella-cvflow") != 0) {
-            uint8_t* person_pred = (uint8_t*)tensor_outputs[0].data;
-            uint8_t* car_pred    = (uint8_t*)tensor_outputs[1].data;
-            syslog(LOG_INFO,
-                   "Person detected: %.2f%% - Car detected: %.2f%%",
-                   (float)*person_pred / 2.55f,
-                   (float)*car_pred / 2.55f);
-        } else {
-            uint8_t* car_pred    = (uint8_t*)tensor_outputs[0].data;
-            uint8_t* person_pred = (uint8_t*)tensor_outputs[1].data;
-
-            float float_score_car    = *((float*)car_pred);
-            float float_score_person = *((float*)person_pred);
-            syslog(LOG_INFO,
-                   "Person detected: %.2f%% - Car detected: %.2f%%",
-                   float_score_person * 100,
-                   float_score_car * 100);
-        }
+        log_scores(device_name, tensor_outputs);
+        // There is no overlay, the result is committed when it has been logged
+        frame_latency_committed(latency);
 
         // This will allow vdo to fill this buffer with data again
-        if (!vdo_stream_buffer_unref(image_provider->vdo_stream, &vdo_buf, &vdo_error)) {
-            if (!vdo_error_is_expected(&vdo_error)) {
-                panic("%s: Unexpexted error: %s", __func__, vdo_error->message);
-            }
-            g_clear_error(&vdo_error);
+        if (!img_provider_return_frame(image_provider, &vdo_buf)) {
+            panic("%s: Failed to return frame", __func__);
         }
     }
 end:
+    frame_latency_destroy(latency);
     if (image_provider) {
         img_provider_destroy(image_provider);
     }